@@ -17481,6 +17481,7 @@ typedef volatile unsigned short vu16;
 #include "crc.h"
 #include "usbd.h"
 #include "pdma.h"
+#include "ringbuf.h"
 #include "ebi.h"
 #include "sc.h"
 #include "scuart.h"
@@ -0,0 +1,146 @@
+/**************************************************************************//**
+ * @file     ringbuf.h
+ * @version  V3.00
+ * @brief    NUC1261 series single-producer single-consumer byte ring buffer header file
+ *
+ * @note
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#ifndef __RINGBUF_H__
+#define __RINGBUF_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/** @addtogroup Standard_Driver Standard Driver
+  @{
+*/
+
+/** @addtogroup RINGBUF_Driver RINGBUF Driver
+  @{
+*/
+
+/** @addtogroup RINGBUF_EXPORTED_STRUCTS RINGBUF Exported Structs
+  @{
+*/
+/**
+  * @details    Byte ring buffer shared by one producer and one consumer, e.g. an interrupt handler and the main loop.
+  *             The producer only writes u32Tail and the consumer only writes u32Head. Both indexes run freely and
+  *             are masked when the buffer is accessed, so no interrupt has to be disabled to update the ring.
+  */
+typedef struct s_ringbuf
+{
+    uint8_t *pu8Buf;            /*!< Buffer of the ring */
+    uint32_t u32Mask;           /*!< Buffer size - 1. Buffer size must be a power of 2. */
+    volatile uint32_t u32Head;  /*!< Read index. Only updated by the consumer. */
+    volatile uint32_t u32Tail;  /*!< Write index. Only updated by the producer. */
+} S_RINGBUF_T;
+
+/*@}*/ /* end of group RINGBUF_EXPORTED_STRUCTS */
+
+
+/** @addtogroup RINGBUF_EXPORTED_FUNCTIONS RINGBUF Exported Functions
+  @{
+*/
+
+/**
+  * @brief      Get the number of bytes in the ring
+  * @param[in]  ring    The pointer of the ring buffer
+  * @return     Bytes can be read from the ring
+  */
+#define RINGBUF_GET_COUNT(ring)     ((ring)->u32Tail - (ring)->u32Head)
+
+/**
+  * @brief      Get the free space of the ring
+  * @param[in]  ring    The pointer of the ring buffer
+  * @return     Bytes can be written to the ring
+  */
+#define RINGBUF_GET_FREE(ring)      ((ring)->u32Mask + 1 - RINGBUF_GET_COUNT(ring))
+
+/**
+  * @brief      Check if the ring is empty
+  * @param[in]  ring    The pointer of the ring buffer
+  * @retval     0       The ring is not empty
+  * @retval     1       The ring is empty
+  */
+#define RINGBUF_IS_EMPTY(ring)      ((ring)->u32Tail == (ring)->u32Head)
+
+/**
+  * @brief      Check if the ring is full
+  * @param[in]  ring    The pointer of the ring buffer
+  * @retval     0       The ring is not full
+  * @retval     1       The ring is full
+  */
+#define RINGBUF_IS_FULL(ring)       (RINGBUF_GET_COUNT(ring) > (ring)->u32Mask)
+
+/**
+  * @brief      Put one byte to the ring. Called by the producer.
+  * @param[in]  psRing  The pointer of the ring buffer
+  * @param[in]  u8Data  The byte to put
+  * @retval     0       The ring is full and the byte is dropped
+  * @retval     1       The byte is put
+  */
+static __INLINE int32_t RINGBUF_Put(S_RINGBUF_T *psRing, uint8_t u8Data)
+{
+    uint32_t u32Tail = psRing->u32Tail;
+
+    if((u32Tail - psRing->u32Head) > psRing->u32Mask)
+        return 0;
+
+    psRing->pu8Buf[u32Tail & psRing->u32Mask] = u8Data;
+
+    /* Data must be in the buffer before the consumer can see the new tail */
+    __DMB();
+    psRing->u32Tail = u32Tail + 1;
+
+    return 1;
+}
+
+/**
+  * @brief      Get one byte from the ring. Called by the consumer.
+  * @param[in]  psRing  The pointer of the ring buffer
+  * @return     The byte got from the ring or -1 if the ring is empty
+  */
+static __INLINE int32_t RINGBUF_Get(S_RINGBUF_T *psRing)
+{
+    uint32_t u32Head = psRing->u32Head;
+    int32_t i32Data;
+
+    if(u32Head == psRing->u32Tail)
+        return -1;
+
+    i32Data = psRing->pu8Buf[u32Head & psRing->u32Mask];
+
+    /* Data must be read before the producer can reuse the space */
+    __DMB();
+    psRing->u32Head = u32Head + 1;
+
+    return i32Data;
+}
+
+void RINGBUF_Init(S_RINGBUF_T *psRing, uint8_t *pu8Buf, uint32_t u32Size);
+uint32_t RINGBUF_GetWriteSpan(S_RINGBUF_T *psRing, uint8_t **ppu8Span);
+void RINGBUF_CommitWrite(S_RINGBUF_T *psRing, uint32_t u32Len);
+uint32_t RINGBUF_GetReadSpan(S_RINGBUF_T *psRing, uint8_t **ppu8Span);
+void RINGBUF_CommitRead(S_RINGBUF_T *psRing, uint32_t u32Len);
+uint32_t RINGBUF_Write(S_RINGBUF_T *psRing, const uint8_t *pu8Data, uint32_t u32Len);
+uint32_t RINGBUF_Read(S_RINGBUF_T *psRing, uint8_t *pu8Data, uint32_t u32Len);
+
+/*@}*/ /* end of group RINGBUF_EXPORTED_FUNCTIONS */
+
+/*@}*/ /* end of group RINGBUF_Driver */
+
+/*@}*/ /* end of group Standard_Driver */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__RINGBUF_H__
+
+/*** (C) COPYRIGHT 2016 Nuvoton Technology Corp. ***/
@@ -35,6 +35,19 @@ typedef struct s_usbd_info
 
 extern const S_USBD_INFO_T gsInfo;
 
+typedef void (*BULK_PP_CB)(uint8_t *pu8Buf, uint32_t u32Size);   /*!< Functional pointer type declaration for bulk packet refill/drain callback */
+
+typedef struct s_usbd_bulk_pp
+{
+    uint32_t u32InEp;                     /*!< Hardware endpoint ID of bulk IN endpoint   */
+    uint32_t u32OutEp;                    /*!< Hardware endpoint ID of bulk OUT endpoint  */
+    uint32_t au32BufSeg[2];               /*!< USB SRAM offsets of the two packet buffers */
+    uint32_t u32MaxPktSize;               /*!< Maximum packet size of both endpoints      */
+    uint32_t u32InSize;                   /*!< Size of the IN packet prepared in the idle buffer */
+    BULK_PP_CB pfnFill;                   /*!< Callback to refill an IN packet buffer     */
+    BULK_PP_CB pfnDrain;                  /*!< Callback to drain an OUT packet buffer     */
+} S_USBD_BULK_PP_T;
+
 /*@}*/ /* end of group USBD_EXPORTED_STRUCTS */
 
 
@@ -44,6 +57,7 @@ extern const S_USBD_INFO_T gsInfo;
   @{
 */
 #define USBD_BUF_BASE   (USBD_BASE+0x100)
+#define USBD_BUF_SIZE   512     /*!< USB SRAM size in bytes */
 #define USBD_MAX_EP     8
 
 #define EP0     0       /*!< Endpoint 0 */
@@ -132,6 +146,7 @@ extern const S_USBD_INFO_T gsInfo;
 #define USBD_INT_FLDET          USBD_INTEN_VBDETIEN_Msk     /*!< USB VBUS Detection Interrupt */
 #define USBD_INT_VBDET          USBD_INTEN_VBDETIEN_Msk     /*!< USB VBUS Detection Interrupt */
 #define USBD_INT_WAKEUP_IDLE    (USBD_INTEN_WKIDLEIEN_Msk | USBD_INTEN_WKEN_Msk)    /*!< USB No-Event-Wake-Up Interrupt */
+#define USBD_INT_SOF            USBD_INTEN_SOFIEN_Msk       /*!< USB Start of Frame Interrupt */
 
 #define USBD_INTSTS_WAKEUP      USBD_INTSTS_WKIDLEIF_Msk    /*!< USB No-Event-Wake-Up Interrupt Status */
 #define USBD_INTSTS_FLDET       USBD_INTSTS_VBDETIF_Msk     /*!< USB Float Detect Interrupt Status */
@@ -147,6 +162,7 @@ extern const S_USBD_INFO_T gsInfo;
 #define USBD_INTSTS_EP5         USBD_INTSTS_EPEVT5_Msk      /*!< USB Endpoint 5 Event */
 #define USBD_INTSTS_EP6         USBD_INTSTS_EPEVT6_Msk      /*!< USB Endpoint 6 Event */
 #define USBD_INTSTS_EP7         USBD_INTSTS_EPEVT7_Msk      /*!< USB Endpoint 7 Event */
+#define USBD_INTSTS_SOF         USBD_INTSTS_SOFIF_Msk       /*!< USB Start of Frame Interrupt Status */
 
 #define USBD_STATE_USBRST       USBD_ATTR_USBRST_Msk        /*!< USB Bus Reset */
 #define USBD_STATE_SUSPEND      USBD_ATTR_SUSPEND_Msk       /*!< USB Bus Suspend */
@@ -517,24 +533,17 @@ extern const S_USBD_INFO_T gsInfo;
 #define USBD_GET_EP_STALL(ep)        (*((__IO uint32_t *) ((uint32_t)&USBD->EP[0].CFGP + (uint32_t)((ep) << 4))) & USBD_CFGP_SSTALL_Msk)
 
 /**
-  * @brief      To support byte access between USB SRAM and system SRAM
+  * @brief      Check if an address is located in USB SRAM
   *
-  * @param[in]  dest Destination pointer.
+  * @param[in]  addr The address to be checked.
   *
-  * @param[in]  src  Source pointer.
+  * @retval     0 The address is not in USB SRAM.
+  * @retval     1 The address is in USB SRAM.
   *
-  * @param[in]  size Byte count.
-  *
-  * @return     None
-  *
-  * @details    This function will copy the number of data specified by size and src parameters to the address specified by dest parameter.
+  * @details    USB SRAM starts at USBD_BUF_BASE and is USBD_BUF_SIZE bytes long.
   *
   */
-static __INLINE void USBD_MemCopy(uint8_t *dest, uint8_t *src, int32_t size)
-{
-    while(size--) *dest++ = *src++;
-}
-
+#define USBD_IS_BUF_ADDR(addr)      ((uint32_t)(((uint32_t)(addr) - USBD_BUF_BASE) < USBD_BUF_SIZE))
 
 /**
   * @brief       Set USB endpoint stall state
@@ -655,6 +664,16 @@ void USBD_SwReset(void);
 void USBD_SetVendorRequest(VENDOR_REQ pfnVendorReq);
 void USBD_SetConfigCallback(SET_CONFIG_CB pfnSetConfigCallback);
 void USBD_LockEpStall(uint32_t u32EpBitmap);
+void USBD_MemCopy(uint8_t *dest, uint8_t *src, int32_t size);
+uint8_t *USBD_AcquireEpBuf(uint32_t u32Ep);
+void USBD_ReleaseEpBuf(uint32_t u32Ep, uint32_t u32Size);
+uint32_t USBD_IsEpBufAcquired(uint32_t u32Ep);
+void USBD_BulkPPInit(S_USBD_BULK_PP_T *psPP, uint32_t u32InEp, uint32_t u32OutEp, uint32_t u32BufSeg0, uint32_t u32BufSeg1,
+                     uint32_t u32MaxPktSize, BULK_PP_CB pfnFill, BULK_PP_CB pfnDrain);
+void USBD_BulkPPPrepareIn(S_USBD_BULK_PP_T *psPP, uint32_t u32Size);
+void USBD_BulkPPTrigIn(S_USBD_BULK_PP_T *psPP);
+void USBD_BulkPPArmOut(S_USBD_BULK_PP_T *psPP);
+uint32_t USBD_BulkPPRecvOut(S_USBD_BULK_PP_T *psPP, uint32_t u32Rearm);
 
 /*@}*/ /* end of group USBD_EXPORTED_FUNCTIONS */
 
@@ -0,0 +1,205 @@
+/**************************************************************************//**
+ * @file     ringbuf.c
+ * @version  V3.00
+ * @brief    NUC1261 series single-producer single-consumer byte ring buffer source file
+ *
+ * @note
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+*****************************************************************************/
+#include "NUC1261.h"
+
+
+/** @addtogroup Standard_Driver Standard Driver
+  @{
+*/
+
+/** @addtogroup RINGBUF_Driver RINGBUF Driver
+  @{
+*/
+
+/** @addtogroup RINGBUF_EXPORTED_FUNCTIONS RINGBUF Exported Functions
+  @{
+*/
+
+/**
+  * @brief      Initialize a ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[in]  pu8Buf      The buffer used by the ring
+  * @param[in]  u32Size     Size of pu8Buf. It must be a power of 2.
+  *
+  * @return     None
+  *
+  * @details    The ring is empty after it is initialized. Neither the producer nor the consumer may use the ring
+  *             while this function is running.
+  */
+void RINGBUF_Init(S_RINGBUF_T *psRing, uint8_t *pu8Buf, uint32_t u32Size)
+{
+    psRing->pu8Buf = pu8Buf;
+    psRing->u32Mask = u32Size - 1;
+    psRing->u32Head = 0;
+    psRing->u32Tail = 0;
+}
+
+/**
+  * @brief      Get the contiguous free space of a ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[out] ppu8Span    The start address of the free space
+  *
+  * @return     Bytes can be written to the span
+  *
+  * @details    Called by the producer. The span ends at the end of the buffer, so the free space after wrapping
+  *             around is got by calling this function again after \ref RINGBUF_CommitWrite.
+  *             Data can be written to the span directly, e.g. by PDMA or USBD_MemCopy.
+  */
+uint32_t RINGBUF_GetWriteSpan(S_RINGBUF_T *psRing, uint8_t **ppu8Span)
+{
+    uint32_t u32Tail = psRing->u32Tail;
+    uint32_t u32Free, u32Span;
+
+    u32Free = psRing->u32Mask + 1 - (u32Tail - psRing->u32Head);
+    u32Span = psRing->u32Mask + 1 - (u32Tail & psRing->u32Mask);
+
+    *ppu8Span = &psRing->pu8Buf[u32Tail & psRing->u32Mask];
+
+    return (u32Free < u32Span) ? u32Free : u32Span;
+}
+
+/**
+  * @brief      Commit the data written to the ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[in]  u32Len      Bytes written to the span got by \ref RINGBUF_GetWriteSpan
+  *
+  * @return     None
+  *
+  * @details    Called by the producer. The data becomes visible to the consumer.
+  */
+void RINGBUF_CommitWrite(S_RINGBUF_T *psRing, uint32_t u32Len)
+{
+    __DMB();
+    psRing->u32Tail += u32Len;
+}
+
+/**
+  * @brief      Get the contiguous data of a ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[out] ppu8Span    The start address of the data
+  *
+  * @return     Bytes can be read from the span
+  *
+  * @details    Called by the consumer. The span ends at the end of the buffer, so the data after wrapping
+  *             around is got by calling this function again after \ref RINGBUF_CommitRead.
+  *             Data can be read from the span directly, e.g. by PDMA or USBD_MemCopy.
+  */
+uint32_t RINGBUF_GetReadSpan(S_RINGBUF_T *psRing, uint8_t **ppu8Span)
+{
+    uint32_t u32Head = psRing->u32Head;
+    uint32_t u32Count, u32Span;
+
+    u32Count = psRing->u32Tail - u32Head;
+    u32Span = psRing->u32Mask + 1 - (u32Head & psRing->u32Mask);
+
+    *ppu8Span = &psRing->pu8Buf[u32Head & psRing->u32Mask];
+
+    return (u32Count < u32Span) ? u32Count : u32Span;
+}
+
+/**
+  * @brief      Release the data read from the ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[in]  u32Len      Bytes read from the data got by \ref RINGBUF_GetReadSpan
+  *
+  * @return     None
+  *
+  * @details    Called by the consumer. The space becomes free for the producer.
+  */
+void RINGBUF_CommitRead(S_RINGBUF_T *psRing, uint32_t u32Len)
+{
+    __DMB();
+    psRing->u32Head += u32Len;
+}
+
+/**
+  * @brief      Write data to a ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[in]  pu8Data     The data to write
+  * @param[in]  u32Len      Bytes of the data
+  *
+  * @return     Bytes written. It is less than u32Len if the ring does not have enough free space.
+  *
+  * @details    Called by the producer.
+  */
+uint32_t RINGBUF_Write(S_RINGBUF_T *psRing, const uint8_t *pu8Data, uint32_t u32Len)
+{
+    uint32_t u32Done = 0;
+    uint32_t i, u32Span;
+    uint8_t *pu8Span;
+
+    /* At most two spans: up to the end of the buffer and from the beginning of the buffer */
+    while(u32Done < u32Len)
+    {
+        u32Span = RINGBUF_GetWriteSpan(psRing, &pu8Span);
+        if(u32Span == 0)
+            break;
+        if(u32Span > u32Len - u32Done)
+            u32Span = u32Len - u32Done;
+
+        for(i = 0; i < u32Span; i++)
+            pu8Span[i] = pu8Data[u32Done + i];
+
+        RINGBUF_CommitWrite(psRing, u32Span);
+        u32Done += u32Span;
+    }
+
+    return u32Done;
+}
+
+/**
+  * @brief      Read data from a ring buffer
+  *
+  * @param[in]  psRing      The pointer of the ring buffer
+  * @param[out] pu8Data     The buffer to store the data
+  * @param[in]  u32Len      Maximum bytes to read
+  *
+  * @return     Bytes read. It is less than u32Len if the ring does not have enough data.
+  *
+  * @details    Called by the consumer.
+  */
+uint32_t RINGBUF_Read(S_RINGBUF_T *psRing, uint8_t *pu8Data, uint32_t u32Len)
+{
+    uint32_t u32Done = 0;
+    uint32_t i, u32Span;
+    uint8_t *pu8Span;
+
+    while(u32Done < u32Len)
+    {
+        u32Span = RINGBUF_GetReadSpan(psRing, &pu8Span);
+        if(u32Span == 0)
+            break;
+        if(u32Span > u32Len - u32Done)
+            u32Span = u32Len - u32Done;
+
+        for(i = 0; i < u32Span; i++)
+            pu8Data[u32Done + i] = pu8Span[i];
+
+        RINGBUF_CommitRead(psRing, u32Span);
+        u32Done += u32Span;
+    }
+
+    return u32Done;
+}
+
+/*@}*/ /* end of group RINGBUF_EXPORTED_FUNCTIONS */
+
+/*@}*/ /* end of group RINGBUF_Driver */
+
+/*@}*/ /* end of group Standard_Driver */
+
+/*** (C) COPYRIGHT 2016 Nuvoton Technology Corp. ***/
@@ -56,6 +56,7 @@ static volatile uint32_t g_usbd_CtrlMaxPktSize = 8;
 static volatile uint32_t g_usbd_UsbAltInterface = 0;
 static volatile uint32_t g_usbd_CtrlOutToggle = 0;
 static volatile uint8_t  g_usbd_CtrlInZeroFlag = 0;
+static volatile uint8_t  g_usbd_au8EpBufOwned[USBD_MAX_EP];  /* One flag byte per endpoint buffer borrowed by class code */
 /**
  * @endcond
  */
@@ -684,6 +685,7 @@ void USBD_SwReset(void)
     g_usbd_CtrlOutSize = 0;
     g_usbd_CtrlOutSizeLimit = 0;
     g_u32EpStallLock = 0;
+    memset((void *)g_usbd_au8EpBufOwned, 0, sizeof(g_usbd_au8EpBufOwned));
     memset(g_usbd_SetupPacket, 0, 8);
 
     /* Reset PID DATA0 */
@@ -738,6 +740,240 @@ void USBD_LockEpStall(uint32_t u32EpBitmap)
     g_u32EpStallLock = u32EpBitmap;
 }
 
+/**
+ * @brief       Borrow the USB SRAM buffer of an endpoint
+ *
+ * @param[in]   u32Ep   The USB endpoint ID. Supports 8 hardware endpoint ID. This parameter could be 0 ~ 7.
+ *
+ * @return      Pointer to the endpoint buffer in USB SRAM, or NULL if it is already borrowed.
+ *
+ * @details     This function lets class code parse OUT data or build IN data in place without a staging buffer.
+ *              The buffer belongs to the caller until USBD_ReleaseEpBuf() re-arms the endpoint.
+ *              USB SRAM is in byte mode, so the buffer must be accessed by bytes or with USBD_MemCopy().
+ *              The owner flag of each endpoint is a byte of its own, so the buffer can be borrowed in
+ *              the IRQ and released in the main loop. It returns NULL if the buffer is still borrowed;
+ *              the caller should leave the data and try again later.
+ */
+uint8_t *USBD_AcquireEpBuf(uint32_t u32Ep)
+{
+    if(g_usbd_au8EpBufOwned[u32Ep])
+        return NULL;
+
+    g_usbd_au8EpBufOwned[u32Ep] = 1;
+
+    return (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(u32Ep));
+}
+
+/**
+ * @brief       Give an endpoint buffer back to the USB controller
+ *
+ * @param[in]   u32Ep   The USB endpoint ID. Supports 8 hardware endpoint ID. This parameter could be 0 ~ 7.
+ * @param[in]   u32Size For IN endpoint, the number of bytes to send. For OUT endpoint, the maximum packet size to receive.
+ *
+ * @return      None
+ *
+ * @details     This function ends the ownership taken by USBD_AcquireEpBuf() and writes u32Size to USB_MXPLDx
+ *              to trigger the next transaction of the endpoint.
+ */
+void USBD_ReleaseEpBuf(uint32_t u32Ep, uint32_t u32Size)
+{
+    g_usbd_au8EpBufOwned[u32Ep] = 0;
+    USBD_SET_PAYLOAD_LEN(u32Ep, u32Size);
+}
+
+/**
+ * @brief       Check if an endpoint buffer is borrowed
+ *
+ * @param[in]   u32Ep   The USB endpoint ID. Supports 8 hardware endpoint ID. This parameter could be 0 ~ 7.
+ *
+ * @retval      0       The endpoint buffer is owned by the USB controller.
+ * @retval      1       The endpoint buffer is borrowed by class code.
+ *
+ * @details     This function returns the ownership state set by USBD_AcquireEpBuf() and USBD_ReleaseEpBuf().
+ */
+uint32_t USBD_IsEpBufAcquired(uint32_t u32Ep)
+{
+    return g_usbd_au8EpBufOwned[u32Ep];
+}
+
+/**
+ * @brief      To support byte access between USB SRAM and system SRAM
+ *
+ * @param[in]  dest Destination pointer.
+ *
+ * @param[in]  src  Source pointer.
+ *
+ * @param[in]  size Byte count.
+ *
+ * @return     None
+ *
+ * @details    This function will copy the number of data specified by size and src parameters to the address specified by dest parameter.
+ *             USB SRAM is accessed in byte mode (BYTEM = 1), so any copy touching it is done by bytes, unrolled by 8.
+ *             A copy between two word-aligned system SRAM/flash buffers is done by words, unrolled by 4, with the
+ *             remaining tail copied by bytes.
+ *
+ */
+void USBD_MemCopy(uint8_t *dest, uint8_t *src, int32_t size)
+{
+    if((((uint32_t)dest | (uint32_t)src) & 0x3) == 0 && !USBD_IS_BUF_ADDR(dest) && !USBD_IS_BUF_ADDR(src))
+    {
+        uint32_t *pu32Dest = (uint32_t *)dest;
+        uint32_t *pu32Src = (uint32_t *)src;
+
+        while(size >= 16)
+        {
+            pu32Dest[0] = pu32Src[0];
+            pu32Dest[1] = pu32Src[1];
+            pu32Dest[2] = pu32Src[2];
+            pu32Dest[3] = pu32Src[3];
+            pu32Dest += 4;
+            pu32Src += 4;
+            size -= 16;
+        }
+        while(size >= 4)
+        {
+            *pu32Dest++ = *pu32Src++;
+            size -= 4;
+        }
+        dest = (uint8_t *)pu32Dest;
+        src = (uint8_t *)pu32Src;
+    }
+
+    while(size >= 8)
+    {
+        dest[0] = src[0];
+        dest[1] = src[1];
+        dest[2] = src[2];
+        dest[3] = src[3];
+        dest[4] = src[4];
+        dest[5] = src[5];
+        dest[6] = src[6];
+        dest[7] = src[7];
+        dest += 8;
+        src += 8;
+        size -= 8;
+    }
+    while(size-- > 0) *dest++ = *src++;
+}
+
+/**
+ * @brief       Initialize a ping-pong bulk engine
+ *
+ * @param[in]   psPP            The ping-pong bulk engine.
+ * @param[in]   u32InEp         Hardware endpoint ID of bulk IN endpoint. This parameter could be 0 ~ 7.
+ * @param[in]   u32OutEp        Hardware endpoint ID of bulk OUT endpoint. This parameter could be 0 ~ 7.
+ * @param[in]   u32BufSeg0      USB SRAM offset of the first packet buffer.
+ * @param[in]   u32BufSeg1      USB SRAM offset of the second packet buffer.
+ * @param[in]   u32MaxPktSize   Maximum packet size of both endpoints.
+ * @param[in]   pfnFill         Callback to copy the next IN packet into a USB SRAM buffer.
+ * @param[in]   pfnDrain        Callback to copy a received OUT packet out of a USB SRAM buffer.
+ *
+ * @return      None
+ *
+ * @details     The two packet buffers are shared by the bulk IN and OUT endpoints of a half-duplex class such as mass storage.
+ *              While one buffer is on the bus, the other one is refilled or drained so the endpoint can be re-armed
+ *              as soon as the previous transaction is acknowledged.
+ */
+void USBD_BulkPPInit(S_USBD_BULK_PP_T *psPP, uint32_t u32InEp, uint32_t u32OutEp, uint32_t u32BufSeg0, uint32_t u32BufSeg1,
+                     uint32_t u32MaxPktSize, BULK_PP_CB pfnFill, BULK_PP_CB pfnDrain)
+{
+    psPP->u32InEp = u32InEp;
+    psPP->u32OutEp = u32OutEp;
+    psPP->au32BufSeg[0] = u32BufSeg0;
+    psPP->au32BufSeg[1] = u32BufSeg1;
+    psPP->u32MaxPktSize = u32MaxPktSize;
+    psPP->u32InSize = 0;
+    psPP->pfnFill = pfnFill;
+    psPP->pfnDrain = pfnDrain;
+}
+
+/**
+ * @brief       Prepare the next bulk IN packet
+ *
+ * @param[in]   psPP    The ping-pong bulk engine.
+ * @param[in]   u32Size The packet size. It should not be larger than the maximum packet size.
+ *
+ * @return      None
+ *
+ * @details     The fill callback is called with the buffer that bulk IN endpoint is not using,
+ *              so the packet can be prepared while the previous one is still on the bus.
+ */
+void USBD_BulkPPPrepareIn(S_USBD_BULK_PP_T *psPP, uint32_t u32Size)
+{
+    uint32_t u32Idle;
+
+    u32Idle = (USBD_GET_EP_BUF_ADDR(psPP->u32InEp) == psPP->au32BufSeg[0]) ? psPP->au32BufSeg[1] : psPP->au32BufSeg[0];
+
+    psPP->pfnFill((uint8_t *)(USBD_BUF_BASE + u32Idle), u32Size);
+    psPP->u32InSize = u32Size;
+}
+
+/**
+ * @brief       Send the prepared bulk IN packet
+ *
+ * @param[in]   psPP    The ping-pong bulk engine.
+ *
+ * @return      None
+ *
+ * @details     Switch bulk IN endpoint to the buffer filled by USBD_BulkPPPrepareIn() and trigger the transaction.
+ *              The buffer sent before becomes idle and can be used to prepare the next packet.
+ */
+void USBD_BulkPPTrigIn(S_USBD_BULK_PP_T *psPP)
+{
+    if(USBD_GET_EP_BUF_ADDR(psPP->u32InEp) == psPP->au32BufSeg[0])
+        USBD_SET_EP_BUF_ADDR(psPP->u32InEp, psPP->au32BufSeg[1]);
+    else
+        USBD_SET_EP_BUF_ADDR(psPP->u32InEp, psPP->au32BufSeg[0]);
+
+    USBD_SET_PAYLOAD_LEN(psPP->u32InEp, psPP->u32InSize);
+}
+
+/**
+ * @brief       Arm the idle buffer to receive a bulk OUT packet
+ *
+ * @param[in]   psPP        The ping-pong bulk engine.
+ *
+ * @return      None
+ *
+ * @details     It resumes a bulk OUT endpoint left idle by USBD_BulkPPRecvOut(psPP, 0).
+ */
+void USBD_BulkPPArmOut(S_USBD_BULK_PP_T *psPP)
+{
+    if(USBD_GET_EP_BUF_ADDR(psPP->u32OutEp) == psPP->au32BufSeg[0])
+        USBD_SET_EP_BUF_ADDR(psPP->u32OutEp, psPP->au32BufSeg[1]);
+    else
+        USBD_SET_EP_BUF_ADDR(psPP->u32OutEp, psPP->au32BufSeg[0]);
+
+    USBD_SET_PAYLOAD_LEN(psPP->u32OutEp, psPP->u32MaxPktSize);
+}
+
+/**
+ * @brief       Receive a bulk OUT packet
+ *
+ * @param[in]   psPP        The ping-pong bulk engine.
+ * @param[in]   u32Rearm    1: More OUT packets are expected. The other buffer is armed before draining this one.
+ *                          0: This is the last packet. Bulk OUT endpoint is left idle.
+ *
+ * @return      The size of the received packet.
+ *
+ * @details     The drain callback is called with the buffer just received by bulk OUT endpoint.
+ *              When u32Rearm is set, the host can send the next packet into the other buffer during the drain.
+ */
+uint32_t USBD_BulkPPRecvOut(S_USBD_BULK_PP_T *psPP, uint32_t u32Rearm)
+{
+    uint32_t u32BufSeg, u32Size;
+
+    u32BufSeg = USBD_GET_EP_BUF_ADDR(psPP->u32OutEp);
+    u32Size = USBD_GET_PAYLOAD_LEN(psPP->u32OutEp);
+
+    if(u32Rearm)
+        USBD_BulkPPArmOut(psPP);
+
+    psPP->pfnDrain((uint8_t *)(USBD_BUF_BASE + u32BufSeg), u32Size);
+
+    return u32Size;
+}
+
 
 
 
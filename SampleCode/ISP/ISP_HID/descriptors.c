@@ -59,9 +59,9 @@ const uint8_t gu8ConfigDescriptor[] =
     LEN_CONFIG,     /* bLength */
     DESC_CONFIG,    /* bDescriptorType */
     /* wTotalLength */
-    (LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2) & 0x00FF,
-    (((LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2) & 0xFF00) >> 8),
-    0x01,           /* bNumInterfaces */
+    (LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2 + LEN_BULK_INTERFACE) & 0x00FF,
+    (((LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2 + LEN_BULK_INTERFACE) & 0xFF00) >> 8),
+    0x01 + ISP_BULK,    /* bNumInterfaces */
     0x01,           /* bConfigurationValue */
     0x00,           /* iConfiguration */
     0x80 | (USBD_SELF_POWERED << 6) | (USBD_REMOTE_WAKEUP << 5),/* bmAttributes */
@@ -107,7 +107,40 @@ const uint8_t gu8ConfigDescriptor[] =
     /* wMaxPacketSize */
     EP3_MAX_PKT_SIZE & 0x00FF,
     ((EP3_MAX_PKT_SIZE & 0xFF00) >> 8),
-    HID_DEFAULT_INT_IN_INTERVAL     /* bInterval */
+    HID_DEFAULT_INT_IN_INTERVAL,    /* bInterval */
+
+#if ISP_BULK
+    /* I/F descr: Vendor bulk */
+    LEN_INTERFACE,  /* bLength */
+    DESC_INTERFACE, /* bDescriptorType */
+    0x01,           /* bInterfaceNumber */
+    0x00,           /* bAlternateSetting */
+    0x02,           /* bNumEndpoints */
+    0xFF,           /* bInterfaceClass */
+    0x00,           /* bInterfaceSubClass */
+    0x00,           /* bInterfaceProtocol */
+    0x00,           /* iInterface */
+
+    /* EP Descriptor: bulk in. */
+    LEN_ENDPOINT,   /* bLength */
+    DESC_ENDPOINT,  /* bDescriptorType */
+    (BULK_IN_EP_NUM | EP_INPUT),    /* bEndpointAddress */
+    EP_BULK,        /* bmAttributes */
+    /* wMaxPacketSize */
+    EP4_MAX_PKT_SIZE & 0x00FF,
+    ((EP4_MAX_PKT_SIZE & 0xFF00) >> 8),
+    0x00,           /* bInterval */
+
+    /* EP Descriptor: bulk out. */
+    LEN_ENDPOINT,   /* bLength */
+    DESC_ENDPOINT,  /* bDescriptorType */
+    (BULK_OUT_EP_NUM | EP_OUTPUT),  /* bEndpointAddress */
+    EP_BULK,        /* bmAttributes */
+    /* wMaxPacketSize */
+    EP5_MAX_PKT_SIZE & 0x00FF,
+    ((EP5_MAX_PKT_SIZE & 0xFF00) >> 8),
+    0x00,           /* bInterval */
+#endif
 };
 
 /*!<USB Language String Descriptor */
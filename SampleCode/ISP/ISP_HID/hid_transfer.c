@@ -122,12 +122,20 @@ void USBD_IRQHandler(void)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP4);
+#if ISP_BULK
+            // Bulk IN
+            EP4_Handler();
+#endif
         }
 
         if(u32IntSts & USBD_INTSTS_EP5)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP5);
+#if ISP_BULK
+            // Bulk OUT
+            EP5_Handler();
+#endif
         }
 
         if(u32IntSts & USBD_INTSTS_EP6)
@@ -164,6 +172,116 @@ void EP3_Handler(void)  /* Interrupt OUT handler */
     USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
 }
 
+#if ISP_BULK
+/* Each bulk endpoint switches between its two buffers. The OUT endpoint receives the next packet into one
+   buffer while the other waits to be parsed, and the IN endpoint sends a response from one buffer while
+   the next response is written to the other. BULK_NONE means the endpoint is not armed. */
+#define BULK_NONE   2
+
+static uint8_t s_u8BulkOutArm;      /* OUT buffer being received to */
+static uint8_t s_u8BulkOutNext;     /* OUT buffer to parse next */
+static uint8_t s_u8BulkOutFull;     /* Bit n is set if OUT buffer n holds a packet */
+static uint8_t s_u8BulkInArm;       /* IN buffer being sent */
+static uint8_t s_u8BulkInNext;      /* IN buffer to write the next response to */
+static uint8_t s_u8BulkInFull;      /* Bit n is set if IN buffer n holds a response */
+
+static void BULK_ArmOut(uint8_t u8Idx)
+{
+    s_u8BulkOutArm = u8Idx;
+    USBD_SET_EP_BUF_ADDR(EP5, EP5_BUF_BASE + u8Idx * EP5_MAX_PKT_SIZE);
+    USBD_SET_PAYLOAD_LEN(EP5, EP5_MAX_PKT_SIZE);
+}
+
+static void BULK_ArmIn(uint8_t u8Idx)
+{
+    s_u8BulkInArm = u8Idx;
+    USBD_SET_EP_BUF_ADDR(EP4, EP4_BUF_BASE + u8Idx * EP4_MAX_PKT_SIZE);
+    USBD_SET_PAYLOAD_LEN(EP4, EP4_MAX_PKT_SIZE);
+}
+
+void EP4_Handler(void)  /* Bulk IN handler */
+{
+    /* The response is sent. Send the other buffer if it is written. */
+    s_u8BulkInFull &= ~(1 << s_u8BulkInArm);
+    s_u8BulkInArm ^= 1;
+
+    if(s_u8BulkInFull & (1 << s_u8BulkInArm))
+    {
+        BULK_ArmIn(s_u8BulkInArm);
+    }
+    else
+    {
+        s_u8BulkInArm = BULK_NONE;
+    }
+}
+
+void EP5_Handler(void)  /* Bulk OUT handler */
+{
+    /* Receive to the other buffer at once if it is parsed. Otherwise NAK until BULK_GetCmd() frees it. */
+    s_u8BulkOutFull |= (1 << s_u8BulkOutArm);
+
+    if(s_u8BulkOutFull & (1 << (s_u8BulkOutArm ^ 1)))
+    {
+        s_u8BulkOutArm = BULK_NONE;
+    }
+    else
+    {
+        BULK_ArmOut(s_u8BulkOutArm ^ 1);
+    }
+}
+
+void BULK_Init(void)
+{
+    USBD_STOP_TRANSACTION(EP4);
+    USBD_STOP_TRANSACTION(EP5);
+    /* EP4 ==> Bulk IN endpoint, address 3 */
+    USBD_CONFIG_EP(EP4, USBD_CFG_EPMODE_IN | BULK_IN_EP_NUM);
+    /* EP5 ==> Bulk OUT endpoint, address 4 */
+    USBD_CONFIG_EP(EP5, USBD_CFG_EPMODE_OUT | BULK_OUT_EP_NUM);
+
+    s_u8BulkOutNext = 0;
+    s_u8BulkOutFull = 0;
+    s_u8BulkInArm = BULK_NONE;
+    s_u8BulkInNext = 0;
+    s_u8BulkInFull = 0;
+    /* trigger to receive OUT data */
+    BULK_ArmOut(0);
+}
+
+/* Get the next command packet. A packet is given only when there is a free IN buffer for its response. */
+int32_t BULK_GetCmd(uint8_t *pu8Buf)
+{
+    if(((s_u8BulkOutFull & (1 << s_u8BulkOutNext)) == 0) || (s_u8BulkInFull & (1 << s_u8BulkInNext)))
+    {
+        return 0;
+    }
+
+    USBD_MemCopy(pu8Buf, (uint8_t *)(USBD_BUF_BASE + EP5_BUF_BASE + s_u8BulkOutNext * EP5_MAX_PKT_SIZE), EP5_MAX_PKT_SIZE);
+    s_u8BulkOutFull &= ~(1 << s_u8BulkOutNext);
+
+    /* The endpoint waits for this buffer if both were full */
+    if(s_u8BulkOutArm == BULK_NONE)
+    {
+        BULK_ArmOut(s_u8BulkOutNext);
+    }
+
+    s_u8BulkOutNext ^= 1;
+    return 1;
+}
+
+void BULK_SendResponse(uint8_t *pu8Buf)
+{
+    USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + EP4_BUF_BASE + s_u8BulkInNext * EP4_MAX_PKT_SIZE), pu8Buf, EP4_MAX_PKT_SIZE);
+    s_u8BulkInFull |= (1 << s_u8BulkInNext);
+
+    if(s_u8BulkInArm == BULK_NONE)
+    {
+        BULK_ArmIn(s_u8BulkInNext);
+    }
+
+    s_u8BulkInNext ^= 1;
+}
+#endif
 
 /*--------------------------------------------------------------------------*/
 /**
@@ -196,6 +314,11 @@ void HID_Init(void)
     USBD_SET_EP_BUF_ADDR(EP3, EP3_BUF_BASE);
     /* trigger to receive OUT data */
     USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+#if ISP_BULK
+    /* Start the bulk endpoints again whenever Host sets the configuration */
+    BULK_Init();
+    USBD_SetConfigCallback(BULK_Init);
+#endif
 }
 
 void HID_ClassRequest(void)
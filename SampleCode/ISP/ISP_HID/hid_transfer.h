@@ -13,6 +13,13 @@
 #define USBD_VID        0x0416
 #define USBD_PID        0x3F00
 
+/* Add a vendor class interface with bulk endpoints. It takes the same 64-byte command packets as HID,
+   but Host can queue many packets in a transfer instead of one report per frame. It needs a driver
+   such as WinUSB or libusb on Host, so it is disabled by default. */
+#ifndef ISP_BULK
+#define ISP_BULK        0
+#endif
+
 /*!<Define HID Class Specific Request */
 #define GET_REPORT          0x01
 #define GET_IDLE            0x02
@@ -37,6 +44,8 @@
 #define EP1_MAX_PKT_SIZE    EP0_MAX_PKT_SIZE
 #define EP2_MAX_PKT_SIZE    64
 #define EP3_MAX_PKT_SIZE    64
+#define EP4_MAX_PKT_SIZE    64
+#define EP5_MAX_PKT_SIZE    64
 
 #define SETUP_BUF_BASE  0
 #define SETUP_BUF_LEN   8
@@ -48,10 +57,17 @@
 #define EP2_BUF_LEN     EP2_MAX_PKT_SIZE
 #define EP3_BUF_BASE    (EP2_BUF_BASE + EP2_BUF_LEN)
 #define EP3_BUF_LEN     EP3_MAX_PKT_SIZE
+/* Bulk endpoints have two buffers each and switch between them by each packet */
+#define EP4_BUF_BASE    (EP3_BUF_BASE + EP3_BUF_LEN)
+#define EP4_BUF_LEN     (EP4_MAX_PKT_SIZE * 2)
+#define EP5_BUF_BASE    (EP4_BUF_BASE + EP4_BUF_LEN)
+#define EP5_BUF_LEN     (EP5_MAX_PKT_SIZE * 2)
 
 /* Define the EP number */
 #define INT_IN_EP_NUM       0x01
 #define INT_OUT_EP_NUM      0x02
+#define BULK_IN_EP_NUM      0x03
+#define BULK_OUT_EP_NUM     0x04
 
 /* Define Descriptor information */
 #define HID_DEFAULT_INT_IN_INTERVAL     1
@@ -61,6 +77,12 @@
 
 #define LEN_CONFIG_AND_SUBORDINATE      (LEN_CONFIG+LEN_INTERFACE+LEN_HID+LEN_ENDPOINT)
 
+#if ISP_BULK
+#define LEN_BULK_INTERFACE              (LEN_INTERFACE+LEN_ENDPOINT*2)
+#else
+#define LEN_BULK_INTERFACE              0
+#endif
+
 
 /*-------------------------------------------------------------*/
 
@@ -75,6 +97,12 @@ void EP3_Handler(void);
 void HID_SetInReport(void);
 void HID_GetOutReport(uint8_t *pu8EpBuf, uint32_t u32Size);
 
+void BULK_Init(void);
+int32_t BULK_GetCmd(uint8_t *pu8Buf);
+void BULK_SendResponse(uint8_t *pu8Buf);
+void EP4_Handler(void);
+void EP5_Handler(void);
+
 #endif  /* __USBD_HID_H_ */
 
 /*** (C) COPYRIGHT 2019 Nuvoton Technology Corp. ***/
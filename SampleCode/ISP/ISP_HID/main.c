@@ -57,7 +57,7 @@ int32_t main(void)
     /* Init system and multi-function I/O */
     if( SYS_Init() < 0 ) goto _APROM;
 
-    CLK->AHBCLK |= CLK_AHBCLK_ISPCKEN_Msk;
+    CLK->AHBCLK |= (CLK_AHBCLK_ISPCKEN_Msk | CLK_AHBCLK_CRCCKEN_Msk);
     FMC->ISPCTL |= FMC_ISPCTL_ISPEN_Msk;
 
     /* Get APROM size, data flash size and address */
@@ -134,7 +134,23 @@ int32_t main(void)
                 ParseCmd((uint8_t *)usb_rcvbuf, 64);
                 EP2_Handler();
                 bUsbDataReady = FALSE;
+#if ISP_MULTI_WORD
+                /* Program the staged data while Host handles the response */
+                ProgramPending();
+#endif
             }
+
+#if ISP_BULK
+            /* Commands from the bulk interface are parsed in the same way */
+            if(BULK_GetCmd((uint8_t *)usb_rcvbuf))
+            {
+                ParseCmd((uint8_t *)usb_rcvbuf, 64);
+                BULK_SendResponse(response_buff);
+#if ISP_MULTI_WORD
+                ProgramPending();
+#endif
+            }
+#endif
         }
     }
 
@@ -764,6 +764,26 @@ extern "C"
         g_u32EpStallLock = u32EpBitmap;
     }
 
+    /**
+     * @brief      To support byte access between USB SRAM and system SRAM
+     *
+     * @param[in]  dest Destination pointer.
+     *
+     * @param[in]  src  Source pointer.
+     *
+     * @param[in]  size Byte count.
+     *
+     * @return     None
+     *
+     * @details    This function will copy the number of data specified by size and src parameters to the address specified by dest parameter.
+     *             The loader keeps the byte loop for code size. The unrolled copy is in usbd.c.
+     *
+     */
+    void USBD_MemCopy(uint8_t *dest, uint8_t *src, int32_t size)
+    {
+        while(size--) *dest++ = *src++;
+    }
+
     /*@}*/ /* end of group USBD_EXPORTED_FUNCTIONS */
 
     /*@}*/ /* end of group USBD_Driver */
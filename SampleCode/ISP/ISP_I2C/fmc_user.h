@@ -12,6 +12,7 @@
 #include "targetdev.h"
 
 extern int FMC_Proc(unsigned int u32Cmd, unsigned int addr_start, unsigned int addr_end, unsigned int *data);
+extern int FMC_GetCheckSum_User(unsigned int u32Addr, unsigned int u32Size, unsigned int *data);
 
 
 #define Config0         FMC_CONFIG_BASE
@@ -19,6 +20,15 @@ extern int FMC_Proc(unsigned int u32Cmd, unsigned int addr_start, unsigned int a
 
 #define ISPGO           0x01
 
+/* Program the updates by multi-word program commands in blocks of FMC_MULTI_PROG_SIZE bytes, and verify each
+   page by FMC checksum. Off by default, so the loader fits in the 4 KB LDROM. Otherwise a packet is programmed
+   word by word and read back. */
+#ifndef ISP_MULTI_WORD
+#define ISP_MULTI_WORD          0
+#endif
+
+#define FMC_MULTI_PROG_SIZE     256     /* Bytes programmed by a multi-word program command at most */
+
 
 /**
  * @brief       Read 32-bit Data from specified address of flash
@@ -27,6 +27,31 @@
 #define CMD_CONNECT           0x000000AE
 #define CMD_GET_DEVICEID      0x000000B1
 #define CMD_UPDATE_DATAFLASH  0x000000C3
+#define CMD_GET_CRC32         0x000000C8
+#define CMD_CHECK_PAGES       0x000000C9
+#define CMD_UPDATE_PAGES      0x000000CA
+#define CMD_UPDATE_APROM_LZ   0x000000CB
+
+/* Optional commands. They are off by default, so the loader fits in the 4 KB LDROM.
+   ISP_DIFF_UPDATE adds CMD_CHECK_PAGES and CMD_UPDATE_PAGES. ISP_LZ adds CMD_UPDATE_APROM_LZ, which decodes
+   to the staging blocks of ISP_MULTI_WORD. */
+#ifndef ISP_DIFF_UPDATE
+#define ISP_DIFF_UPDATE       0
+#endif
+
+#ifndef ISP_LZ
+#define ISP_LZ                0
+#endif
+
+#if ISP_LZ && !ISP_MULTI_WORD
+#error "ISP_LZ needs ISP_MULTI_WORD"
+#endif
+
+/* CMD_UPDATE_APROM_LZ gives the decoded length at +8 and the compressed length at +12 of the first packet.
+   The compressed stream is groups of a flag byte and 8 items, bit 0 first. A set bit is a literal byte.
+   A clear bit is a match of 2 bytes, (b1 << 8 | b0) = ((offset - 1) << 6) | (length - 3), which copies
+   3 ~ 66 bytes from 1 ~ LZ_WIN_SIZE bytes back. The stream can end in a group. */
+#define LZ_WIN_SIZE           1024
 #define CMD_RESEND_PACKET     0x000000FF
 
 #define V6M_AIRCR_VECTKEY_DATA    0x05FA0000UL
@@ -38,6 +63,7 @@ extern uint32_t GetApromSize(void);
 
 // isp_user.c
 extern int ParseCmd(unsigned char *buffer, uint8_t len);
+extern void ProgramPending(void);
 extern uint32_t g_apromSize, g_dataFlashAddr, g_dataFlashSize;
 extern __attribute__((aligned(4))) uint8_t response_buff[64];
 extern volatile uint8_t bISPDataReady;
@@ -85,7 +85,7 @@ int main(void)
     if( SYS_Init() < 0 ) goto _APROM;
 
     /* Enable ISP */
-    CLK->AHBCLK |= CLK_AHBCLK_ISPCKEN_Msk;
+    CLK->AHBCLK |= (CLK_AHBCLK_ISPCKEN_Msk | CLK_AHBCLK_CRCCKEN_Msk);
     FMC->ISPCTL |= (FMC_ISPCTL_ISPEN_Msk | FMC_ISPCTL_APUEN_Msk);
 
     /* Get APROM size, data flash size and address */
@@ -133,6 +133,10 @@ _ISP:
             u8I2cDataReady = 0;
             /* Parse the current command */
             ParseCmd((unsigned char *)au8CmdBuff, 64);
+#if ISP_MULTI_WORD
+            /* Program the staged data while master reads the response */
+            ProgramPending();
+#endif
         }
     }
 
@@ -99,6 +99,9 @@ int32_t main(void)
     /* Init UART */
     UART_Init();
 
+    /* Enable CRC to verify the programmed pages */
+    CLK->AHBCLK |= CLK_AHBCLK_CRCCKEN_Msk;
+
     /* Enable FMC ISP */
     FMC->ISPCTL |= FMC_ISPCTL_ISPEN_Msk;
 
@@ -152,6 +155,9 @@ int32_t main(void)
 
             nRTSPin = REVEIVE_MODE;         /* Control RTS in reveive mode */
             NVIC_EnableIRQ(UART_T_IRQn);    /* Enable NVIC */
+#if ISP_MULTI_WORD
+            ProgramPending();               /* Program the staged data while master handles the response */
+#endif
 
         }
 
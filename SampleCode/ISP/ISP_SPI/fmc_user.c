@@ -9,6 +9,86 @@
 #include <stdio.h>
 #include "fmc_user.h"
 
+#if ISP_MULTI_WORD
+/*
+    Program u32Words words (a multiple of 4 in one FMC_MULTI_PROG_SIZE block) by the multi-word program command.
+    MPDAT0/1 and MPDAT2/3 are refilled in turn while FMC programs the other two words.
+*/
+static int FMC_MultiProg(unsigned int u32Addr, unsigned int *data, unsigned int u32Words)
+{
+    volatile uint32_t *pu32MpDat = &FMC->MPDAT0;
+    unsigned int i = 0, Reg;
+    uint32_t u32TimeOutCnt;
+
+retrigger:
+    FMC->ISPCMD = FMC_ISPCMD_MULTI_PROG;
+    FMC->ISPADDR = u32Addr + i * 4;
+    pu32MpDat[0] = data[i];
+    pu32MpDat[1] = data[i + 1];
+    pu32MpDat[2] = data[i + 2];
+    pu32MpDat[3] = data[i + 3];
+    FMC->ISPTRG = 0x1;
+
+    for(i += 4; i < u32Words; i += 2)
+    {
+        Reg = (i & 2) ? (3 << FMC_MPSTS_D2_Pos) : (3 << FMC_MPSTS_D0_Pos);
+
+        /* Mask interrupts so the data is given in time. FMC stops when the data registers run empty. */
+        __set_PRIMASK(1);
+        u32TimeOutCnt = FMC_TIMEOUT_WRITE;
+
+        do
+        {
+            if((FMC->MPSTS & FMC_MPSTS_MPBUSY_Msk) == 0)
+            {
+                __set_PRIMASK(0);
+
+                Reg = FMC->ISPCTL;
+
+                if(Reg & FMC_ISPCTL_ISPFF_Msk)
+                {
+                    FMC->ISPCTL = Reg;
+                    return -1;
+                }
+
+                /* FMC stopped. Go on from the 16 bytes it was programming. */
+                i = ((FMC->MPADDR & ~0xFul) - u32Addr) / 4;
+                goto retrigger;
+            }
+
+            if(--u32TimeOutCnt == 0)
+            {
+                __set_PRIMASK(0);
+                return -1;
+            }
+        }
+        while(FMC->MPSTS & Reg);
+
+        pu32MpDat[i & 2] = data[i];
+        pu32MpDat[(i & 2) + 1] = data[i + 1];
+        __set_PRIMASK(0);
+    }
+
+    /* Wait for multi-word program done. */
+    u32TimeOutCnt = FMC_TIMEOUT_WRITE;
+    while(FMC->ISPSTS & FMC_ISPSTS_ISPBUSY_Msk)
+    {
+        if(--u32TimeOutCnt == 0)
+            return -1;
+    }
+
+    Reg = FMC->ISPCTL;
+
+    if(Reg & FMC_ISPCTL_ISPFF_Msk)
+    {
+        FMC->ISPCTL = Reg;
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
 int FMC_Proc(unsigned int u32Cmd, unsigned int addr_start, unsigned int addr_end, unsigned int *data)
 {
     unsigned int u32Addr, Reg;
@@ -16,6 +96,24 @@ int FMC_Proc(unsigned int u32Cmd, unsigned int addr_start, unsigned int addr_end
 
     for(u32Addr = addr_start; u32Addr < addr_end; data++)
     {
+#if ISP_MULTI_WORD
+        /* Program the 16-byte aligned data in bursts up to the end of each FMC_MULTI_PROG_SIZE block */
+        if((u32Cmd == FMC_ISPCMD_PROGRAM) && ((u32Addr & 0xF) == 0) && (addr_end - u32Addr >= 16))
+        {
+            Reg = FMC_MULTI_PROG_SIZE - (u32Addr & (FMC_MULTI_PROG_SIZE - 1));
+
+            if(Reg > ((addr_end - u32Addr) & ~0xFu))
+                Reg = (addr_end - u32Addr) & ~0xFu;
+
+            if(FMC_MultiProg(u32Addr, data, Reg / 4))
+                return -1;
+
+            u32Addr += Reg;
+            data += Reg / 4 - 1;    /* data++ of the loop moves the last word */
+            continue;
+        }
+#endif
+
         FMC->ISPCMD = u32Cmd;
         FMC->ISPADDR = u32Addr;
 
@@ -120,10 +218,9 @@ void ReadData(unsigned int addr_start, unsigned int addr_end, unsigned int *data
     return;
 }
 
-void WriteData(unsigned int addr_start, unsigned int addr_end, unsigned int *data)  // Write data into flash
+int WriteData(unsigned int addr_start, unsigned int addr_end, unsigned int *data)   // Write data into flash
 {
-    FMC_Proc(FMC_ISPCMD_PROGRAM, addr_start, addr_end, data);
-    return;
+    return FMC_Proc(FMC_ISPCMD_PROGRAM, addr_start, addr_end, data);
 }
 
 int EraseAP(unsigned int addr_start, unsigned int size)
@@ -131,6 +228,42 @@ int EraseAP(unsigned int addr_start, unsigned int size)
     return FMC_Proc(FMC_ISPCMD_PAGE_ERASE, addr_start, addr_start + size, NULL);
 }
 
+int FMC_GetCheckSum_User(unsigned int u32Addr, unsigned int u32Size, unsigned int *data)
+{
+    unsigned int Reg;
+    uint32_t u32TimeOutCnt;
+
+    FMC->ISPCMD = FMC_ISPCMD_CAL_CHECKSUM;
+    FMC->ISPADDR = u32Addr;
+    FMC->ISPDAT = u32Size;
+    FMC->ISPTRG = 0x1;
+    __ISB();
+
+    /* Wait for checksum calculation done. */
+    u32TimeOutCnt = FMC_TIMEOUT_CHKSUM;
+    while(FMC->ISPTRG & 0x1)
+        if(--u32TimeOutCnt == 0) return -1;
+
+    FMC->ISPCMD = FMC_ISPCMD_CHECKSUM;
+    FMC->ISPTRG = 0x1;
+    __ISB();
+
+    u32TimeOutCnt = FMC_TIMEOUT_CHKSUM;
+    while(FMC->ISPTRG & 0x1)
+        if(--u32TimeOutCnt == 0) return -1;
+
+    Reg = FMC->ISPCTL;
+
+    if(Reg & FMC_ISPCTL_ISPFF_Msk)
+    {
+        FMC->ISPCTL = Reg;
+        return -1;
+    }
+
+    *data = FMC->ISPDAT;
+    return 0;
+}
+
 void UpdateConfig(unsigned int *data, unsigned int *res)
 {
     // For NUC1261 series, CONIFG2 must be 0xFFFFFF5A (Don't modify this value. It should be 0xFFFFFF5A after reset.)
@@ -16,6 +16,15 @@
 
 #define ISPGO           0x01
 
+/* Program the updates by multi-word program commands in blocks of FMC_MULTI_PROG_SIZE bytes, and verify each
+   page by FMC checksum. Off by default, so the loader fits in the 4 KB LDROM. Otherwise a packet is programmed
+   word by word and read back. */
+#ifndef ISP_MULTI_WORD
+#define ISP_MULTI_WORD          0
+#endif
+
+#define FMC_MULTI_PROG_SIZE     256     /* Bytes programmed by a multi-word program command at most */
+
 /*---------------------------------------------------------------------------------------------------------*/
 /* Define parameter                                                                                        */
 /*---------------------------------------------------------------------------------------------------------*/
@@ -30,11 +39,12 @@
 extern int EraseAP(unsigned int addr_start, unsigned int addr_end);
 extern void UpdateConfig(unsigned int *data, unsigned int *res);
 extern void ReadData(unsigned int addr_start, unsigned int addr_end, unsigned int *data);
-extern void WriteData(unsigned int addr_start, unsigned int addr_end, unsigned int *data);
+extern int WriteData(unsigned int addr_start, unsigned int addr_end, unsigned int *data);
 extern void GetDataFlashInfo(uint32_t *addr, uint32_t *size);
 int FMC_Write_User(unsigned int u32Addr, unsigned int u32Data);
 int FMC_Read_User(unsigned int u32Addr, unsigned int *data);
 int FMC_Erase_User(unsigned int u32Addr);
+int FMC_GetCheckSum_User(unsigned int u32Addr, unsigned int u32Size, unsigned int *data);
 
 #endif
 
@@ -30,6 +30,243 @@ static uint16_t Checksum(unsigned char *buf, int len)
     return (c);
 }
 
+/* Check the range starts at a page and is in APROM or Data Flash */
+static int IsPageRange(uint32_t u32Addr, uint32_t u32Size)
+{
+    uint32_t u32ApromEnd = (g_apromSize < g_dataFlashAddr) ? g_apromSize : g_dataFlashAddr;
+
+    if(u32Addr & (FMC_FLASH_PAGE_SIZE - 1))
+    {
+        return FALSE;
+    }
+
+    if((u32Addr < u32ApromEnd) && (u32Size <= u32ApromEnd - u32Addr))
+    {
+        return TRUE;
+    }
+
+    return (u32Addr >= g_dataFlashAddr) && (u32Addr < g_dataFlashAddr + g_dataFlashSize) &&
+           (u32Size <= g_dataFlashAddr + g_dataFlashSize - u32Addr);
+}
+
+static uint32_t ProgErr;        /* Set if programming failed in the update */
+
+#if ISP_MULTI_WORD
+/* The update data is staged in blocks of PROG_BLK_SIZE bytes. A full block is programmed by one
+   multi-word program in ProgramPending(), which is called after the response is sent, so the block
+   is programmed while Host handles the response and sends the next packet. */
+#define PROG_BLK_SIZE   FMC_MULTI_PROG_SIZE
+
+__attribute__((aligned(4))) static uint8_t prog_buf[2][PROG_BLK_SIZE];
+static uint32_t ProgAddr;       /* Flash address of the staging block */
+static uint32_t ProgLen;        /* Bytes in the staging block */
+static uint32_t ProgIdx;        /* prog_buf[ProgIdx] is the staging block. The other is the pending block. */
+static uint32_t PendAddr;       /* Flash address of the pending block */
+static uint32_t PendLen;        /* Bytes to program of the pending block. 0 if none. */
+
+/* Each programmed page is verified by comparing its FMC checksum with the CRC32 of the staged data.
+   The FMC checksum is the CRC32 of the CRC controller with the settings of PageCrcStart(). */
+static void PageCrcStart(uint32_t u32Addr, uint32_t *pu32Data)
+{
+    uint32_t n;
+
+    CRC->CTL = CRC_CTL_CRCEN_Msk | CRC_32 | CRC_CPU_WDATA_32 | CRC_WDATA_RVS | CRC_CHECKSUM_RVS | CRC_CHECKSUM_COM;
+    CRC->SEED = 0xFFFFFFFF;
+    CRC->CTL |= CRC_CTL_CHKSINIT_Msk;
+
+    /* Add the data between the page start and u32Addr */
+    for(n = (u32Addr & (FMC_FLASH_PAGE_SIZE - 1)) / 4; n; n--)
+    {
+        CRC->DAT = *pu32Data++;
+    }
+}
+
+static void VerifyPage(uint32_t u32Addr)
+{
+    uint32_t u32Page, u32Sum;
+
+    /* The page is erased after u32Addr */
+    u32Page = (u32Addr - 1) & ~(FMC_FLASH_PAGE_SIZE - 1);
+
+    for(; u32Addr < u32Page + FMC_FLASH_PAGE_SIZE; u32Addr += 4)
+    {
+        CRC->DAT = 0xFFFFFFFF;
+    }
+
+    if(FMC_GetCheckSum_User(u32Page, FMC_FLASH_PAGE_SIZE, &u32Sum) || (u32Sum != CRC->CHECKSUM))
+    {
+        ProgErr = TRUE;
+    }
+}
+
+static void QueueBlock(uint32_t len)
+{
+    uint32_t i;
+
+    if((ProgAddr & (FMC_FLASH_PAGE_SIZE - 1)) == 0)
+    {
+        PageCrcStart(ProgAddr, NULL);
+    }
+
+    for(i = 0; i < PROG_BLK_SIZE; i += 4)
+    {
+        CRC->DAT = inpw(&prog_buf[ProgIdx][i]);
+    }
+
+    PendAddr = ProgAddr;
+    PendLen = len;
+    ProgIdx ^= 1;
+    ProgAddr += PROG_BLK_SIZE;
+    ProgLen = 0;
+}
+
+static void StageData(uint8_t *src, uint32_t len)
+{
+    uint32_t n;
+
+    while(len)
+    {
+        n = PROG_BLK_SIZE - ProgLen;
+
+        if(n > len)
+        {
+            n = len;
+        }
+
+        memcpy(&prog_buf[ProgIdx][ProgLen], src, n);
+        ProgLen += n;
+        src += n;
+        len -= n;
+
+        if(ProgLen == PROG_BLK_SIZE)
+        {
+            ProgramPending();
+            QueueBlock(PROG_BLK_SIZE);
+        }
+    }
+}
+
+void ProgramPending(void)
+{
+    if(PendLen)
+    {
+        if(WriteData(PendAddr, PendAddr + PendLen, (uint32_t *)prog_buf[ProgIdx ^ 1]))
+        {
+            ProgErr = TRUE;
+        }
+
+        if(((PendAddr + PROG_BLK_SIZE) & (FMC_FLASH_PAGE_SIZE - 1)) == 0)
+        {
+            VerifyPage(PendAddr + PROG_BLK_SIZE);
+        }
+
+        PendLen = 0;
+    }
+}
+#endif
+
+#if ISP_LZ
+/* Decoder of CMD_UPDATE_APROM_LZ. The state is kept between packets. */
+static uint8_t lz_win[LZ_WIN_SIZE];
+static uint32_t LzPos;          /* Bytes decoded. lz_win[LzPos % LZ_WIN_SIZE] is the next one. */
+static uint32_t LzOutLen;       /* Bytes left to decode */
+static uint32_t LzFlags;        /* Flags of the group over a 1 bit. 1 if a flag byte is next. */
+static uint32_t LzMatch;        /* First byte of a match over 0x100. 0 if none. */
+
+static void LzStart(uint32_t u32OutLen)
+{
+    LzPos = 0;
+    LzOutLen = u32OutLen;
+    LzFlags = 1;
+    LzMatch = 0;
+}
+
+static int LzPut(uint8_t c)
+{
+    if(LzOutLen == 0)
+    {
+        return -1;
+    }
+
+    LzOutLen--;
+    lz_win[LzPos++ & (LZ_WIN_SIZE - 1)] = c;
+    prog_buf[ProgIdx][ProgLen++] = c;
+
+    if(ProgLen == PROG_BLK_SIZE)
+    {
+        ProgramPending();
+        QueueBlock(PROG_BLK_SIZE);
+    }
+
+    return 0;
+}
+
+static int LzDecode(uint8_t *src, uint32_t len)
+{
+    uint32_t c, n;
+
+    while(len--)
+    {
+        c = *src++;
+
+        if(LzFlags == 1)
+        {
+            LzFlags = c | 0x100;
+            continue;
+        }
+
+        if(LzFlags & 1)
+        {
+            if(LzPut(c))
+            {
+                return -1;
+            }
+        }
+        else if(LzMatch == 0)
+        {
+            LzMatch = c | 0x100;
+            continue;
+        }
+        else
+        {
+            c = (c << 8) | (LzMatch & 0xFF);
+            LzMatch = 0;
+
+            /* Offset is (c >> 6) + 1. It must not reach before the stream. */
+            if((c >> 6) >= LzPos)
+            {
+                return -1;
+            }
+
+            for(n = (c & 0x3F) + 3; n; n--)
+            {
+                if(LzPut(lz_win[(LzPos - (c >> 6) - 1) & (LZ_WIN_SIZE - 1)]))
+                {
+                    return -1;
+                }
+            }
+        }
+
+        LzFlags >>= 1;
+    }
+
+    return 0;
+}
+#endif
+
+/* Commands of the optional features. A disabled command is ignored like an unknown one. */
+#if ISP_DIFF_UPDATE
+#define IS_PAGES_CMD(cmd)   ((cmd) == CMD_UPDATE_PAGES)
+#else
+#define IS_PAGES_CMD(cmd)   0
+#endif
+
+#if ISP_LZ
+#define IS_LZ_CMD(cmd)      ((cmd) == CMD_UPDATE_APROM_LZ)
+#else
+#define IS_LZ_CMD(cmd)      0
+#endif
+
 int ParseCmd(unsigned char *buffer, uint8_t len)
 {
     static uint32_t StartAddress, TotalLen, LastDataLen, g_packno = 1;
@@ -38,6 +275,10 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
     uint32_t lcmd, srclen, i, regcnf0, security;
     unsigned char *pSrc;
     static uint32_t gcmd;
+#if ISP_MULTI_WORD
+    /* Program the block of the last packet before the next command */
+    ProgramPending();
+#endif
     response = response_buff;
     pSrc = buffer;
     srclen = len;
@@ -68,6 +309,65 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
         outpw(response + 8, SYS->PDID);
         goto out;
     }
+    else if(lcmd == CMD_GET_CRC32)
+    {
+        /* CRC32 of the flash by FMC checksum. The range is extended to whole pages, so Host pads the image
+           by 0xFF to the page end. The size is 0 if it failed, the flash is locked, or the range is not
+           in APROM or Data Flash. */
+        i = inpw(pSrc) & ~(FMC_FLASH_PAGE_SIZE - 1);
+        srclen = inpw(pSrc + 4) + (inpw(pSrc) - i);
+
+        if((security == 0) || (srclen == 0) || (srclen < inpw(pSrc + 4)) || !IsPageRange(i, srclen))
+        {
+            srclen = 0;
+        }
+        else
+        {
+            /* The region ends are page aligned, so the rounded range is still in it */
+            srclen = (srclen + FMC_FLASH_PAGE_SIZE - 1) & ~(FMC_FLASH_PAGE_SIZE - 1);
+
+            if(FMC_GetCheckSum_User(i, srclen, (uint32_t *)(response + 8)))
+            {
+                srclen = 0;
+            }
+        }
+
+        outpw(response + 12, srclen);
+        goto out;
+    }
+#if ISP_DIFF_UPDATE
+    else if(lcmd == CMD_CHECK_PAGES)
+    {
+        /* Compare the CRC32 of the pages from the address with their FMC checksums. A bit is set for each page
+           which differs, so Host updates only those pages by CMD_UPDATE_PAGES. The count is 0 for a locked
+           chip, which must be updated as a whole. */
+        uint32_t u32Sum, u32Diff = 0, n;
+        i = inpw(pSrc);
+        srclen = inpw(pSrc + 4);
+
+        if(srclen > (uint32_t)(len - 16) / 4)
+        {
+            srclen = (uint32_t)(len - 16) / 4;
+        }
+
+        if((security == 0) || !IsPageRange(i, srclen * FMC_FLASH_PAGE_SIZE))
+        {
+            srclen = 0;
+        }
+
+        for(n = 0; n < srclen; n++, i += FMC_FLASH_PAGE_SIZE)
+        {
+            if(FMC_GetCheckSum_User(i, FMC_FLASH_PAGE_SIZE, &u32Sum) || (u32Sum != inpw(pSrc + 8 + n * 4)))
+            {
+                u32Diff |= (1 << n);
+            }
+        }
+
+        outpw(response + 8, u32Diff);
+        outpw(response + 12, srclen);
+        goto out;
+    }
+#endif
     else if(lcmd == CMD_RUN_APROM || lcmd == CMD_RUN_LDROM || lcmd == CMD_RESET)
     {
         outpw(&SYS->RSTSTS, 3);//clear bit
@@ -96,9 +396,10 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
     else if(lcmd == CMD_CONNECT)
     {
         g_packno = 1;
+        ProgErr = 0;
         goto out;
     }
-    else if((lcmd == CMD_UPDATE_APROM) || (lcmd == CMD_ERASE_ALL))
+    else if((lcmd == CMD_UPDATE_APROM) || IS_LZ_CMD(lcmd) || (lcmd == CMD_ERASE_ALL))
     {
         EraseAP(FMC_APROM_BASE, g_dataFlashAddr); // erase APROM
 
@@ -112,7 +413,7 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
         bUpdateApromCmd = TRUE;
     }
 
-    if((lcmd == CMD_UPDATE_APROM) || (lcmd == CMD_UPDATE_DATAFLASH))
+    if((lcmd == CMD_UPDATE_APROM) || (lcmd == CMD_UPDATE_DATAFLASH) || IS_PAGES_CMD(lcmd) || IS_LZ_CMD(lcmd))
     {
         if(lcmd == CMD_UPDATE_DATAFLASH)
         {
@@ -127,6 +428,20 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
                 goto out;
             }
         }
+        else if(IS_PAGES_CMD(lcmd))
+        {
+            /* Erase only the pages of the range. Not for a locked chip, which must be erased as a whole. */
+            StartAddress = inpw(pSrc);
+
+            if((security == 0) || !IsPageRange(StartAddress, inpw(pSrc + 4)))
+            {
+                ProgErr = TRUE;
+                gcmd = 0;
+                goto out;
+            }
+
+            EraseAP(StartAddress, (inpw(pSrc + 4) + FMC_FLASH_PAGE_SIZE - 1) & ~(FMC_FLASH_PAGE_SIZE - 1));
+        }
         else
         {
             StartAddress = 0;
@@ -134,6 +449,29 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
 
         //StartAddress = inpw(pSrc);
         TotalLen = inpw(pSrc + 4);
+        ProgErr = 0;
+#if ISP_MULTI_WORD
+        ProgAddr = StartAddress;
+        ProgLen = 0;
+        ReadData(ProgAddr & ~(FMC_FLASH_PAGE_SIZE - 1), ProgAddr, (uint32_t *)aprom_buf);
+        PageCrcStart(ProgAddr, (uint32_t *)aprom_buf);
+#endif
+
+#if ISP_LZ
+        /* TotalLen counts the compressed data. The decoded image must fit in APROM. */
+        if(lcmd == CMD_UPDATE_APROM_LZ)
+        {
+            LzStart(inpw(pSrc));
+
+            if(!IsPageRange(0, LzOutLen))
+            {
+                ProgErr = TRUE;
+                gcmd = 0;
+                goto out;
+            }
+        }
+#endif
+
         pSrc += 8;
         srclen -= 8;
     }
@@ -151,6 +489,14 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
     else if(lcmd == CMD_RESEND_PACKET)      //for APROM&Data flash only
     {
         uint32_t PageAddress;
+
+        /* The decoder can't go back. Fail the compressed update, so Host starts it again. */
+        if(IS_LZ_CMD(gcmd))
+        {
+            ProgErr = TRUE;
+            goto out;
+        }
+
         StartAddress -= LastDataLen;
         TotalLen += LastDataLen;
         PageAddress = StartAddress & (0x100000 - FMC_FLASH_PAGE_SIZE);
@@ -160,6 +506,22 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
             goto out;
         }
 
+#if ISP_MULTI_WORD
+        if(StartAddress < ProgAddr)
+        {
+            /* The packet starts in the last programmed block. Program the page again without the block
+               and stage the block up to the packet. */
+            ReadData(PageAddress, ProgAddr, (uint32_t *)aprom_buf);
+            ProgAddr -= PROG_BLK_SIZE;
+            FMC_Erase_User(PageAddress);
+            WriteData(PageAddress, ProgAddr, (uint32_t *)aprom_buf);
+            memcpy(prog_buf[ProgIdx], &aprom_buf[ProgAddr - PageAddress], StartAddress - ProgAddr);
+            PageCrcStart(ProgAddr, (uint32_t *)aprom_buf);
+        }
+
+        /* Drop the packet from the staging block */
+        ProgLen = StartAddress - ProgAddr;
+#else
         ReadData(PageAddress, StartAddress, (uint32_t *)aprom_buf);
         FMC_Erase_User(PageAddress);
         WriteData(PageAddress, StartAddress, (uint32_t *)aprom_buf);
@@ -168,11 +530,11 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
         {
             FMC_Erase_User(PageAddress + FMC_FLASH_PAGE_SIZE);
         }
-
+#endif
         goto out;
     }
 
-    if((gcmd == CMD_UPDATE_APROM) || (gcmd == CMD_UPDATE_DATAFLASH))
+    if((gcmd == CMD_UPDATE_APROM) || (gcmd == CMD_UPDATE_DATAFLASH) || IS_PAGES_CMD(gcmd) || IS_LZ_CMD(gcmd))
     {
         if(TotalLen < srclen)
         {
@@ -180,15 +542,62 @@ int ParseCmd(unsigned char *buffer, uint8_t len)
         }
 
         TotalLen -= srclen;
-        WriteData(StartAddress, StartAddress + srclen, (uint32_t *)pSrc);
-        memset(pSrc, 0, srclen);
-        ReadData(StartAddress, StartAddress + srclen, (uint32_t *)pSrc);
+
+        if(IS_LZ_CMD(gcmd))
+        {
+#if ISP_LZ
+            /* The whole stream must decode to the image exactly */
+            if(LzDecode(pSrc, srclen) || ((TotalLen == 0) && (LzOutLen || LzMatch)))
+            {
+                ProgErr = TRUE;
+            }
+#endif
+        }
+        else
+        {
+#if ISP_MULTI_WORD
+            StageData(pSrc, srclen);
+#else
+            /* Program the packet and read it back, so the checksum of the response tells Host the result */
+            WriteData(StartAddress, StartAddress + srclen, (uint32_t *)pSrc);
+            memset(pSrc, 0, srclen);
+            ReadData(StartAddress, StartAddress + srclen, (uint32_t *)pSrc);
+#endif
+        }
+
+#if ISP_MULTI_WORD
+        if(TotalLen == 0)
+        {
+            /* Program the rest now, so the response of the last packet tells the result */
+            ProgramPending();
+
+            if(ProgLen)
+            {
+                memset(&prog_buf[ProgIdx][ProgLen], 0xFF, PROG_BLK_SIZE - ProgLen);
+                QueueBlock((ProgLen + 15) & ~15);
+                ProgramPending();
+            }
+
+            if(ProgAddr & (FMC_FLASH_PAGE_SIZE - 1))
+            {
+                VerifyPage(ProgAddr);
+            }
+        }
+#endif
+
         StartAddress += srclen;
         LastDataLen =  srclen;
     }
 
 out:
     lcksum = Checksum(buffer, len);
+
+    /* A wrong checksum stops Host if programming failed */
+    if(ProgErr)
+    {
+        lcksum = ~lcksum;
+    }
+
     outps(response, lcksum);
     ++g_packno;
     outpw(response + 4, g_packno);
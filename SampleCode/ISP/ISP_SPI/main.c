@@ -116,7 +116,7 @@ int32_t main(void)
     SPI_Init();
     TIMER3_Init();
 
-    CLK->AHBCLK |= CLK_AHBCLK_ISPCKEN_Msk;
+    CLK->AHBCLK |= (CLK_AHBCLK_ISPCKEN_Msk | CLK_AHBCLK_CRCCKEN_Msk);
     FMC->ISPCTL |= (FMC_ISPCTL_ISPEN_Msk | FMC_ISPCTL_APUEN_Msk);
 
     /* Get APROM size, data flash size and address */
@@ -144,6 +144,10 @@ _ISP:
             memcpy(cmd_buff, spi_rcvbuf, 64);
             bSpiDataReady = 0;
             ParseCmd((unsigned char *)cmd_buff, 64);
+#if ISP_MULTI_WORD
+            /* Program the staged data while master reads the response */
+            ProgramPending();
+#endif
         }
     }
 
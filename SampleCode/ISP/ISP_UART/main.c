@@ -91,6 +91,9 @@ int32_t main(void)
     /* Init UART */
     UART_Init();
 
+    /* Enable CRC to verify the programmed pages */
+    CLK->AHBCLK |= CLK_AHBCLK_CRCCKEN_Msk;
+
     /* Enable FMC ISP */
     FMC->ISPCTL |= FMC_ISPCTL_ISPEN_Msk;
 
@@ -133,6 +136,10 @@ int32_t main(void)
             bUartDataReady = FALSE;
             ParseCmd(uart_rcvbuf, 64);
             PutString();
+#if ISP_MULTI_WORD
+            /* Program the staged data while Host handles the response */
+            ProgramPending();
+#endif
         }
     }
 
@@ -36,12 +36,48 @@ uint8_t gu8DeviceDescriptor[] =
     0x01            /* bNumConfigurations */
 };
 
+/* Standard AS interface, class-spec AS interface and Type I format type descriptors of an alternate setting */
+#define UAC_AS_ALT_DESC(intf, alt, eps, link, ch, bits, rate) \
+    0x09, 0x04, (intf), (alt), (eps), 0x01, 0x02, 0x00, 0x00, \
+    0x07, 0x24, 0x01, (link), 0x01, 0x01, 0x00, \
+    0x0B, 0x24, 0x02, 0x01, (ch), ((bits) + 7) / 8, (bits), 0x01, \
+    UAC_RATE_LO(rate), UAC_RATE_MD(rate), UAC_RATE_HI(rate)
+#define UAC_AS_ALT_LEN      (9 + 7 + 11)
+
+/* Standard and class-spec AS ISO audio data endpoint descriptors of record */
+#define UAC_REC_EP_DESC(size) \
+    0x09, 0x05, ISO_IN_EP_NUM | EP_INPUT, 0x0d, ((size) & 0xFF), (((size) >> 8) & 0xFF), 0x01, 0x00, 0x00, \
+    0x07, 0x25, 0x01, 0x00, 0x00, 0x00, 0x00
+#define UAC_REC_EP_LEN      (9 + 7)
+
+/* Standard and class-spec AS ISO audio data endpoint descriptors of play, and the synch endpoint descriptor
+   for the feedback. ISO OUT is asynchronous with the feedback, or adaptive. */
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+#define UAC_PLAY_EP_NUM     0x02
+#define UAC_PLAY_EP_DESC(size) \
+    0x09, 0x05, ISO_OUT_EP_NUM | EP_OUTPUT, 0x05, ((size) & 0xFF), (((size) >> 8) & 0xFF), 0x01, 0x00, ISO_FB_EP_NUM | EP_INPUT, \
+    0x07, 0x25, 0x01, 0x80, 0x00, 0x00, 0x00, \
+    0x09, 0x05, ISO_FB_EP_NUM | EP_INPUT, 0x01, EP4_MAX_PKT_SIZE, 0x00, 0x01, UAC_FB_REFRESH, 0x00
+#define UAC_PLAY_EP_LEN     (9 + 7 + 9)
+#else
+#define UAC_PLAY_EP_NUM     0x01
+#define UAC_PLAY_EP_DESC(size) \
+    0x09, 0x05, ISO_OUT_EP_NUM | EP_OUTPUT, 0x0d, ((size) & 0xFF), (((size) >> 8) & 0xFF), 0x01, 0x00, 0x00, \
+    0x07, 0x25, 0x01, 0x80, 0x00, 0x00, 0x00
+#define UAC_PLAY_EP_LEN     (9 + 7)
+#endif
+
+/* Configuration, AC interface with its units and terminals, and both AS interfaces */
+#define UAC_CFG_LEN     (LEN_CONFIG + 81 + \
+                         9 + UAC_REC_ALT_NUM * (UAC_AS_ALT_LEN + UAC_REC_EP_LEN) + \
+                         9 + UAC_PLAY_ALT_NUM * (UAC_AS_ALT_LEN + UAC_PLAY_EP_LEN))
+
 /*!<USB Configure Descriptor */
 uint8_t gu8ConfigDescriptor[] =
 {
     LEN_CONFIG,     /* bLength */
     DESC_CONFIG,    /* bDescriptorType */
-    0xC2, 0x00,     /* wTotalLength */
+    (UAC_CFG_LEN & 0xFF), ((UAC_CFG_LEN >> 8) & 0xFF), /* wTotalLength */
     0x03,           /* bNumInterfaces */
     0x01,           /* bConfigurationValue */
     0x00,           /* iConfiguration */
@@ -148,55 +184,21 @@ uint8_t gu8ConfigDescriptor[] =
     0x00,           /* bInterfaceProtocol */
     0x00,           /* iInterface */
 
-    /* Standard AS interface 1, alternate 1 */
-    0x09,           /* bLength */
-    0x04,           /* bDescriptorType */
-    0x01,           /* bInterfaceNumber */
-    0x01,           /* bAlternateSetting */
-    0x01,           /* bNumEndpoints */
-    0x01,           /* bInterfaceClass:AUDIO */
-    0x02,           /* bInterfaceSubClass:AUDIOSTREAMING */
-    0x00,           /* bInterfaceProtocol */
-    0x00,           /* iInterface */
-
-    /* Class-spec AS interface, this interface's endpoint connect to TID 0x02 */
-    0x07,           /* bLength */
-    0x24,           /* bDescriptorType:CS_INTERFACE */
-    0x01,           /* bDescriptorSubType:AS_GENERAL */
-    0x02,           /* bTernimalLink */
-    0x01,           /* bDelay */
-    0x01, 0x00,     /* wFormatTag:0x0001 PCM */
-
-    /* Type I format type Descriptor */
-    0x0B,           /* bLength */
-    0x24,           /* bDescriptorType:CS_INTERFACE */
-    0x02,           /* bDescriptorSubType:FORMAT_TYPE */
-    0x01,           /* bFormatType:FORMAT_TYPE_I */
-    REC_CHANNELS,   /* bNrChannels */
-    0x02,           /* bSubFrameSize */
-    0x10,           /* bBitResolution */
-    0x01,           /* bSamFreqType : 0 continuous; 1 discrete */
-    REC_RATE_LO,
-    REC_RATE_MD,
-    REC_RATE_HI,    /* Sample Frequency */
-
-    /* Standard AS ISO Audio Data Endpoint */
-    0x09,                       /* bLength */
-    0x05,                       /* bDescriptorType */
-    ISO_IN_EP_NUM | EP_INPUT,   /* bEndpointAddress */
-    0x0d,                       /* bmAttributes */
-    (EP2_MAX_PKT_SIZE & 0xFF), ((EP2_MAX_PKT_SIZE >> 8) & 0xFF), /* wMaxPacketSize*/
-    0x01,                       /* bInterval*/
-    0x00,                       /* bRefresh*/
-    0x00,                       /* bSynchAddress*/
-
-    /* Class-spec AS ISO Audio Data endpoint Descriptor */
-    0x07,           /* bLength */
-    0x25,           /* bDescriptorType:CS_ENDPOINT */
-    0x01,           /* bDescriptorSubType:EP_GENERAL */
-    0x00,           /* bmAttributes */
-    0x00,           /* bLockDelayUnits */
-    0x00, 0x00,     /* wLockDelay */
+    /* AS interface 1, alternate 1 ~ UAC_REC_ALT_NUM. The endpoints connect to TID 0x02 */
+    UAC_AS_ALT_DESC(0x01, 0x01, 0x01, 0x02, REC_CHANNELS, UAC_REC_ALT1_BITS, UAC_REC_ALT1_RATE),
+    UAC_REC_EP_DESC(UAC_PKT_SIZE(UAC_REC_ALT1_RATE, UAC_REC_ALT1_BITS / 8, REC_CHANNELS)),
+#if (UAC_REC_ALT_NUM >= 2)
+    UAC_AS_ALT_DESC(0x01, 0x02, 0x01, 0x02, REC_CHANNELS, UAC_REC_ALT2_BITS, UAC_REC_ALT2_RATE),
+    UAC_REC_EP_DESC(UAC_PKT_SIZE(UAC_REC_ALT2_RATE, UAC_REC_ALT2_BITS / 8, REC_CHANNELS)),
+#endif
+#if (UAC_REC_ALT_NUM >= 3)
+    UAC_AS_ALT_DESC(0x01, 0x03, 0x01, 0x02, REC_CHANNELS, UAC_REC_ALT3_BITS, UAC_REC_ALT3_RATE),
+    UAC_REC_EP_DESC(UAC_PKT_SIZE(UAC_REC_ALT3_RATE, UAC_REC_ALT3_BITS / 8, REC_CHANNELS)),
+#endif
+#if (UAC_REC_ALT_NUM >= 4)
+    UAC_AS_ALT_DESC(0x01, 0x04, 0x01, 0x02, REC_CHANNELS, UAC_REC_ALT4_BITS, UAC_REC_ALT4_RATE),
+    UAC_REC_EP_DESC(UAC_PKT_SIZE(UAC_REC_ALT4_RATE, UAC_REC_ALT4_BITS / 8, REC_CHANNELS)),
+#endif
 
     /* Standard AS interface 2, alternate 0 */
     0x09,           /* bLength */
@@ -209,55 +211,21 @@ uint8_t gu8ConfigDescriptor[] =
     0x00,           /* bInterfaceProtocol */
     0x00,           /* iInterface */
 
-    /* Standard AS interface 2, alternate 1 */
-    0x09,           /* bLength */
-    0x04,           /* bDescriptorType */
-    0x02,           /* bInterfaceNumber */
-    0x01,           /* bAlternateSetting */
-    0x01,           /* bNumEndpoints */
-    0x01,           /* bInterfaceClass:AUDIO */
-    0x02,           /* bInterfaceSubClass:AUDIOSTREAMING */
-    0x00,           /* bInterfaceProtocol */
-    0x00,           /* iInterface */
-
-    /* Class-spec AS inf this interface's endpoint connect to TID 0x01 */
-    0x07,           /* bLength */
-    0x24,           /* bDescriptorType:CS_INTERFACE */
-    0x01,           /* bDescriptorSubType:AS_GENERAL */
-    0x01,           /* bTernimalLink */
-    0x01,           /* bDelay */
-    0x01, 0x00,     /* wFormatTag:0x0001 PCM */
-
-    /* Type I format type Descriptor */
-    0x0B,           /* bLength */
-    0x24,           /* bDescriptorType:CS_INTERFACE */
-    0x02,           /* bDescriptorSubType:FORMAT_TYPE */
-    0x01,           /* bFormatType:FORMAT_TYPE_I */
-    PLAY_CHANNELS,  /* bNrChannels */
-    0x02,           /* bSubFrameSize */
-    0x10,           /* bBitResolution */
-    0x01,           /* bSamFreqType : 0 continuous; 1 discrete */
-    PLAY_RATE_LO,
-    PLAY_RATE_MD,
-    PLAY_RATE_HI,   /* Sample Frequency */
-
-    /* Standard AS ISO Audio Data Endpoint, output, addtess 2, Max 0x40 */
-    0x09,                       /* bLength */
-    0x05,                       /* bDescriptorType */
-    ISO_OUT_EP_NUM | EP_OUTPUT, /* bEndpointAddress */
-    0x0d,                       /* bmAttributes */
-    EP3_MAX_PKT_SIZE, 0x00,     /* wMaxPacketSize */
-    0x01,                       /* bInterval */
-    0x00,                       /* bRefresh */
-    0x00,                       /* bSynchAddress */
-
-    /* Class-spec AS ISO Audio Data endpoint Descriptor */
-    0x07,           /* bLength */
-    0x25,           /* bDescriptorType:CS_ENDPOINT */
-    0x01,           /* bDescriptorSubType:EP_GENERAL */
-    0x80,           /* bmAttributes */
-    0x00,           /* bLockDelayUnits */
-    0x00, 0x00,     /* wLockDelay */
+    /* AS interface 2, alternate 1 ~ UAC_PLAY_ALT_NUM. The endpoints connect to TID 0x01 */
+    UAC_AS_ALT_DESC(0x02, 0x01, UAC_PLAY_EP_NUM, 0x01, PLAY_CHANNELS, UAC_PLAY_ALT1_BITS, UAC_PLAY_ALT1_RATE),
+    UAC_PLAY_EP_DESC(UAC_PKT_SIZE(UAC_PLAY_ALT1_RATE, UAC_PLAY_ALT1_BITS / 8, PLAY_CHANNELS)),
+#if (UAC_PLAY_ALT_NUM >= 2)
+    UAC_AS_ALT_DESC(0x02, 0x02, UAC_PLAY_EP_NUM, 0x01, PLAY_CHANNELS, UAC_PLAY_ALT2_BITS, UAC_PLAY_ALT2_RATE),
+    UAC_PLAY_EP_DESC(UAC_PKT_SIZE(UAC_PLAY_ALT2_RATE, UAC_PLAY_ALT2_BITS / 8, PLAY_CHANNELS)),
+#endif
+#if (UAC_PLAY_ALT_NUM >= 3)
+    UAC_AS_ALT_DESC(0x02, 0x03, UAC_PLAY_EP_NUM, 0x01, PLAY_CHANNELS, UAC_PLAY_ALT3_BITS, UAC_PLAY_ALT3_RATE),
+    UAC_PLAY_EP_DESC(UAC_PKT_SIZE(UAC_PLAY_ALT3_RATE, UAC_PLAY_ALT3_BITS / 8, PLAY_CHANNELS)),
+#endif
+#if (UAC_PLAY_ALT_NUM >= 4)
+    UAC_AS_ALT_DESC(0x02, 0x04, UAC_PLAY_EP_NUM, 0x01, PLAY_CHANNELS, UAC_PLAY_ALT4_BITS, UAC_PLAY_ALT4_RATE),
+    UAC_PLAY_EP_DESC(UAC_PKT_SIZE(UAC_PLAY_ALT4_RATE, UAC_PLAY_ALT4_BITS / 8, PLAY_CHANNELS)),
+#endif
 };
 
 /*!<USB Language String Descriptor */
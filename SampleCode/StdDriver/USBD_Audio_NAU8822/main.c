@@ -17,6 +17,10 @@
 #define TRIM_INIT           (SYS_BASE+0x118)
 #define TRIM_THRESHOLD      16      /* Each value is 0.125%, max 2% */
 
+/* PLL settings of I2S master mode. I2S MCLK is PLL / 10 for 256 * 48000 or 256 * 44100. */
+#define PLLCTL_48K          (CLK_PLLCTL_PLLSRC_HIRC | CLK_PLLCTL_NR(9) | CLK_PLLCTL_NF(50) | CLK_PLLCTL_NO_1)    /* 122880000Hz */
+#define PLLCTL_44K          (CLK_PLLCTL_PLLSRC_HIRC | CLK_PLLCTL_NR(12) | CLK_PLLCTL_NF(98) | CLK_PLLCTL_NO_2)   /* 90316800Hz */
+
 static volatile uint32_t s_u32DefaultTrim, s_u32LastTrim;
 extern volatile uint32_t g_u32MasterSlave;
 extern volatile uint32_t g_u32Master;
@@ -65,7 +69,7 @@ void SYS_Init(void)
     /* Set core clock */
     if(g_u32Master)
     {
-        CLK->PLLCTL = CLK_PLLCTL_PLLSRC_Msk | 0x0e30; // 122880000Hz
+        CLK->PLLCTL = PLLCTL_48K;
         CLK->CLKDIV0 = (CLK->CLKDIV0 & ~CLK_CLKDIV0_HCLKDIV_Msk) | CLK_CLKDIV0_HCLK(2);
         CLK->CLKSEL0 = CLK_CLKSEL0_HCLKSEL_PLL;
 
@@ -86,6 +90,7 @@ void SYS_Init(void)
     CLK_EnableModuleClock(TMR0_MODULE);
     CLK_EnableModuleClock(I2C0_MODULE);
     CLK_EnableModuleClock(SPI0_MODULE);
+    CLK_EnableModuleClock(PDMA_MODULE);
 
     /* Select module clock source */
     CLK_SetModuleClock(UART0_MODULE, CLK_CLKSEL1_UARTSEL_HIRC, CLK_CLKDIV0_UART(1));
@@ -155,6 +160,48 @@ void I2C0_Init(void)
     printf("I2C clock %d Hz\n", I2C_GetBusClockFreq(I2C0));
 }
 
+/**
+  * @brief  Set the sampling rate of I2S.
+  * @param  u32Rate: Sampling rate. 48000, 44100, 32000, 16000 or 8000.
+  * @retval None.
+  * @details In master mode, PLL is switched between 122.88 MHz and 90.3168 MHz for 48 kHz and 44.1 kHz
+  *          families. HCLK is PLL / 2, so I2C is opened again for the new PCLK.
+  *          BCLK is 64 * rate for the 32-bit stereo slots. In slave mode, the clocks come from the codec.
+  */
+void I2S_SetRate(uint32_t u32Rate)
+{
+    uint32_t u32Pll, u32Reg, u32Div;
+
+    if(g_u32Master == 0)
+        return;
+
+    u32Pll = (u32Rate % 8000) ? PLLCTL_44K : PLLCTL_48K;
+    if(CLK->PLLCTL != u32Pll)
+    {
+        /* Run from HIRC while PLL is changing */
+        CLK_SetHCLK(CLK_CLKSEL0_HCLKSEL_HIRC, CLK_CLKDIV0_HCLK(1));
+        CLK->PLLCTL = u32Pll;
+        CLK_WaitClockReady(CLK_STATUS_PLLSTB_Msk);
+        CLK_SetHCLK(CLK_CLKSEL0_HCLKSEL_PLL, CLK_CLKDIV0_HCLK(2));
+
+        I2C_Open(I2C0, 100000);
+    }
+
+    /* MCLK is 256 * 48000 or 256 * 44100. Codec divides it for the lower rates. */
+    u32Div = CLK_GetPLLClockFreq() / (256 * ((u32Rate % 8000) ? 44100 : 48000)) / 2;
+    u32Reg = (SPI0->I2SCLK & ~SPI_I2SCLK_MCLKDIV_Msk) | (u32Div << SPI_I2SCLK_MCLKDIV_Pos);
+
+    u32Div = CLK_GetPLLClockFreq() / (64 * u32Rate) / 2 - 1;
+    u32Reg = (u32Reg & ~SPI_I2SCLK_BCLKDIV_Msk) | (u32Div << SPI_I2SCLK_BCLKDIV_Pos);
+
+    /* I2S clock divider is set again to fix BCLK/MCLK phase delay */
+    SPI0->I2SCLK = 0;
+    __NOP();
+    __NOP();
+    __NOP();
+    SPI0->I2SCLK = u32Reg;
+}
+
 
 
 /*---------------------------------------------------------------------------------------------------------*/
@@ -162,11 +209,10 @@ void I2C0_Init(void)
 /*---------------------------------------------------------------------------------------------------------*/
 int32_t main(void)
 {
-    int32_t i;
-
     /*
         This sample code is used to demo USB Audio Class + NAU8822.
-        User can define PLAY_RATE in usbd_audio.h to support 48000Hz.
+        User can define the sampling rate and bits of each alternate setting (UAC_REC_ALTn_RATE, UAC_REC_ALTn_BITS,
+        UAC_PLAY_ALTn_RATE, UAC_PLAY_ALTn_BITS) in usbd_audio.h. Host selects one of them at run-time.
 
         The audio is input from NAU8822 AUXIN.
         The audio is output by NAU8822 Headphone output.
@@ -194,13 +240,15 @@ int32_t main(void)
             MCLK= 12,288,000 Hz (48000 * 256)
             Sample Rate = 48000 Hz
 
+            For 44100 Hz, PLL = 90,316,800 Hz, CPU = 45,158,400 Hz and MCLK = 11,289,600 Hz (44100 * 256).
+
         Clock config (I2S Slave Mode):
             PLL = 144,000,000 Hz
             CPU = 72,000,000 Hz
             I2S Clock Src = PLL
 
             MCLK = 12,000,000 Hz
-            Sample Rate = (Based on Codec. 48000 Hz)
+            Sample Rate = (Based on Codec PLL. 48000 Hz or 44100 Hz)
 
         USB Clock Src = HIRC48 (48MHz)
 
@@ -226,7 +274,8 @@ int32_t main(void)
     /* Initialize NAU8822 codec */
     NAU8822_Setup();
 
-    SPII2S_Open(SPI0, g_u32MasterSlave, PLAY_RATE, SPII2S_DATABIT_16, SPII2S_STEREO, SPII2S_FORMAT_I2S);
+    /* I2S slots are 32-bit. 16-bit and 24-bit data are MSB-aligned. */
+    SPII2S_Open(SPI0, g_u32MasterSlave, UAC_DEF_RATE, SPII2S_DATABIT_32, SPII2S_STEREO, SPII2S_FORMAT_I2S);
     /* SPII2S driver will overwrite SPI clock source setting. Just re-set it here */
     CLK_SetModuleClock(SPI0_MODULE, CLK_CLKSEL2_SPI0SEL_PLL, 0);
 
@@ -251,12 +300,9 @@ int32_t main(void)
     }
 
 
-    /* Fill dummy data to I2S Tx for start I2S iteration */
-    for(i = 0; i < 4; i++)
-        SPII2S_WRITE_TX_FIFO(SPI0, 0);
-
-    /* Start I2S play iteration */
-    SPII2S_EnableInt(SPI0, SPII2S_FIFO_TXTH_INT_MASK | SPII2S_FIFO_RXTH_INT_MASK);
+    /* I2S TX and RX are started by UAC_DeviceEnable(). The data are moved by PDMA. */
+    SPII2S_DISABLE_TX(SPI0);
+    SPII2S_DISABLE_RX(SPI0);
 
     USBD_Open(&gsInfo, UAC_ClassRequest, (SET_INTERFACE_REQ)UAC_SetInterface);
     /* Endpoint configuration */
@@ -273,7 +319,10 @@ int32_t main(void)
     /* Clear SOF */
     USBD->INTSTS = USBD_INTSTS_SOFIF_Msk;
 
-    NVIC_EnableIRQ(SPI0_IRQn);
+    /* SOF interrupt is used to measure I2S rate. SOF for HIRC48 trim is got from g_u8UsbSof. */
+    USBD_ENABLE_INT(USBD_INT_SOF);
+
+    NVIC_EnableIRQ(PDMA_IRQn);
 
     while(1)
     {
@@ -285,10 +334,10 @@ int32_t main(void)
         if((SYS->IRCTCTL1 & SYS_IRCTCTL1_FREQSEL_Msk) != 2)
         {
             /* Start USB trim only when SOF */
-            if(USBD->INTSTS & USBD_INTSTS_SOFIF_Msk)
+            if(g_u8UsbSof)
             {
                 /* Clear SOF */
-                USBD->INTSTS = USBD_INTSTS_SOFIF_Msk;
+                g_u8UsbSof = 0;
 
                 /* Re-enable crystal-less */
                 SYS->IRCTCTL1 = HIRC48_AUTO_TRIM;
@@ -308,7 +357,7 @@ int32_t main(void)
             SYS->IRCTISTS = SYS_IRCTISTS_CLKERRIF1_Msk | SYS_IRCTISTS_TFAILIF1_Msk;
 
             /* Clear SOF */
-            USBD->INTSTS = USBD_INTSTS_SOFIF_Msk;
+            g_u8UsbSof = 0;
         }
 
         /* Check trim value whether it is over the threshold */
@@ -323,9 +372,13 @@ int32_t main(void)
             s_u32LastTrim =  M32(TRIM_INIT);
         }
 
-        /* Adjust codec sampling rate to synch with USB. The adjustment range is +-0.005% */
+        /* Adjust codec sampling rate to synch with USB when UAC_PLAY_SYNC is UAC_SYNC_PLL.
+           The adjustment range is +-0.005% */
         AdjFreq();
 
+        /* Set I2S and codec to the sampling rate of the alternate setting selected by Host */
+        UAC_RateControl();
+
         /* Set audio volume according USB volume control settings */
         VolumnControl();
 
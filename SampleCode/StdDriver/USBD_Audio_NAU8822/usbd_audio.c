@@ -30,9 +30,15 @@ volatile int16_t g_usbd_RecResVolume  = 0x400;
 volatile uint8_t g_usbd_PlayMute      = 0x01;     /* Play MUTE control. 0 = normal. 1 = MUTE */
 volatile int16_t g_usbd_PlayVolumeL   = 0x1000;   /* Play left channel volume. Range is -32768 ~ 32767 */
 volatile int16_t g_usbd_PlayVolumeR   = 0x1000;   /* PLay right channel volume. Range is -32768 ~ 32767 */
+#if (UAC_SW_MIXER)
+volatile int16_t g_usbd_PlayMaxVolume = 0x0000;   /* 0 dB */
+volatile int16_t g_usbd_PlayMinVolume = 0xC100;   /* -63 dB */
+volatile int16_t g_usbd_PlayResVolume = 0x100;    /* 1 dB */
+#else
 volatile int16_t g_usbd_PlayMaxVolume = 0x7FFF;
 volatile int16_t g_usbd_PlayMinVolume = 0x8000;
 volatile int16_t g_usbd_PlayResVolume = 0x400;
+#endif
 
 static volatile uint8_t g_u8RecEn = 0;
 static volatile uint8_t g_u8PlayEn = 0;      /* To indicate data is output to I2S */
@@ -48,17 +54,186 @@ typedef enum
     E_RS_DOWN           // down sampling
 } RESAMPLE_STATE_T;
 
-/* Temp buffer for play and record */
-uint32_t g_au32UsbTmpBuf[((PLAY_RATE > REC_RATE) ? PLAY_RATE : REC_RATE) / 2000 * ((PLAY_CHANNELS > REC_CHANNELS) ? PLAY_CHANNELS : REC_CHANNELS)] = {0};
+typedef struct dma_desc_t
+{
+    uint32_t ctl;
+    uint32_t src;
+    uint32_t dest;
+    uint32_t offset;
+} DMA_DESC_T;
+
+/* Format of an alternate setting */
+typedef struct
+{
+    uint32_t u32Rate;       /* Sampling rate */
+    uint32_t u32Bytes;      /* Bytes of a channel in USB packets */
+} UAC_ALT_T;
+
+/* Formats of record alternate settings 1 ~ UAC_REC_ALT_NUM */
+static const UAC_ALT_T s_asRecAlt[UAC_REC_ALT_NUM] =
+{
+    {UAC_REC_ALT1_RATE, UAC_REC_ALT1_BITS / 8},
+#if (UAC_REC_ALT_NUM >= 2)
+    {UAC_REC_ALT2_RATE, UAC_REC_ALT2_BITS / 8},
+#endif
+#if (UAC_REC_ALT_NUM >= 3)
+    {UAC_REC_ALT3_RATE, UAC_REC_ALT3_BITS / 8},
+#endif
+#if (UAC_REC_ALT_NUM >= 4)
+    {UAC_REC_ALT4_RATE, UAC_REC_ALT4_BITS / 8},
+#endif
+};
+
+/* Formats of play alternate settings 1 ~ UAC_PLAY_ALT_NUM */
+static const UAC_ALT_T s_asPlayAlt[UAC_PLAY_ALT_NUM] =
+{
+    {UAC_PLAY_ALT1_RATE, UAC_PLAY_ALT1_BITS / 8},
+#if (UAC_PLAY_ALT_NUM >= 2)
+    {UAC_PLAY_ALT2_RATE, UAC_PLAY_ALT2_BITS / 8},
+#endif
+#if (UAC_PLAY_ALT_NUM >= 3)
+    {UAC_PLAY_ALT3_RATE, UAC_PLAY_ALT3_BITS / 8},
+#endif
+#if (UAC_PLAY_ALT_NUM >= 4)
+    {UAC_PLAY_ALT4_RATE, UAC_PLAY_ALT4_BITS / 8},
+#endif
+};
+
+volatile uint32_t g_u32I2sRate = UAC_DEF_RATE;          /* Sampling rate of I2S and codec */
+static volatile uint32_t s_u32ReqRate = UAC_DEF_RATE;   /* Sampling rate of the last selected alternate setting */
+
+/* Record settings of the current alternate setting. Lengths are in samples. */
+static uint32_t s_u32RecBytes = 2;                            /* Bytes of a channel in ISO IN packets */
+static uint32_t s_u32RecBlkLen = UAC_DEF_RATE / 1000;         /* Samples of a PDMA block */
+static uint32_t s_u32RecBufLen = UAC_DEF_RATE / 1000 * REC_BLK_NUM;
+static uint32_t s_u32RecRateRem = UAC_DEF_RATE % 1000;        /* Samples over s_u32RecBlkLen in 1000 frames */
+static uint32_t s_u32RecFrac = 0;                             /* Accumulated s_u32RecRateRem */
+static uint32_t s_u32RecMaxPkt = 0;                           /* EP2 maximum packet size. 0 for alternate 0. */
+static uint32_t s_u32RecRate = 0;                             /* Sampling rate of record. 0 for alternate 0. */
+
+/* Play settings of the current alternate setting. Lengths are in samples. */
+static uint32_t s_u32PlayBytes = 2;                           /* Bytes of a channel in ISO OUT packets */
+static uint32_t s_u32PlayBlkLen = UAC_DEF_RATE / 1000;        /* Samples of a PDMA block */
+static uint32_t s_u32PlayBufLen = BUF_LEN;                    /* Ring length. A multiple of s_u32PlayBlkLen. */
+static uint32_t s_u32PlayMaxPkt = 0;                          /* EP3 maximum packet size. 0 for alternate 0. */
+static uint32_t s_u32PlayRate = 0;                            /* Sampling rate of play. 0 for alternate 0. */
+
+/* Recoder Buffer and its pointer. PDMA fills the blocks of g_au32PcmRecBuf in turn. */
+uint32_t g_au32PcmRecBuf[REC_BUF_LEN * REC_CHANNELS] = {0};
+volatile uint32_t g_u32RecPos_In = 0;        /* Ring index after the last block finished by PDMA */
+volatile uint32_t g_u32RecPos_Out = 0;       /* Ring index of the next sample to send to Host */
+
+/* Player Buffer and its pointer. PDMA plays g_au32PcmPlayBuf block by block. */
+uint32_t g_au32PcmPlayBuf[BUF_LEN * PLAY_CHANNELS] = {0};
+volatile uint32_t g_u32PlayPos_Out = 0;      /* Next sample to play. It is the start of the block played by PDMA. */
+volatile uint32_t g_u32PlayPos_In = 0;       /* Next sample to write */
+
+volatile uint8_t g_u8UsbSof = 0;             /* Set by every SOF. Used to start HIRC48 trim. */
+volatile uint32_t g_u32PlayCnt = 0;          /* Samples of the finished PDMA blocks. Counts the I2S sample clock. */
+
+volatile uint32_t g_u32PlayUnderrun = 0;     /* Times the play buffer ran out of data */
+volatile uint32_t g_u32PlayOverrun = 0;      /* Times ISO OUT data was dropped because the play buffer was full */
+volatile uint32_t g_u32RecOverrun = 0;       /* Times the record data was overwritten before it was sent */
+
+/* I2S TX and RX PDMA. Each channel has two descriptor tables linked to each other. When a block is done,
+   PDMA goes on with the other table and the done table is loaded with the block after it. */
+DMA_DESC_T g_asPlayDesc[2];
+DMA_DESC_T g_asRecDesc[2];
+static volatile uint32_t s_u32PlayDesc;      /* Descriptor table being played by PDMA */
+static volatile uint32_t s_u32RecDesc;       /* Descriptor table being filled by PDMA */
+static uint32_t s_u32RecNext;                /* Block of g_au32PcmRecBuf to load into the next descriptor table */
+
+#if (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE) || (UAC_SW_MIXER)
+static uint32_t s_au32PlayBlk[2][UAC_MAX_BLK_LEN * PLAY_CHANNELS];  /* Resampled or mixed play data of each descriptor table */
+#endif
+#if (UAC_PLAY_SYNC != UAC_SYNC_RESAMPLE)
+#define UAC_PLAY_SILENCE    BUF_LEN               /* Block position of s_au32PlaySilence */
+static uint32_t s_au32PlaySilence[UAC_MAX_BLK_LEN * PLAY_CHANNELS]; /* Played when there is no data in the play buffer */
+static uint32_t s_au32PlayBlkPos[2];              /* Position in g_au32PcmPlayBuf of the block of each descriptor table */
+static uint32_t s_u32PlayNext;                    /* Position of the next block to load into a descriptor table */
+#endif
+
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+#define UAC_FB_NOMINAL(rate)    ((uint32_t)(rate) * (1 << 14) / 1000)  /* Samples per frame in 10.14 format */
+
+static uint32_t s_u32FbNominal = UAC_FB_NOMINAL(UAC_DEF_RATE);      /* Nominal feedback of the play sampling rate */
+volatile uint32_t g_u32PlayFeedback = UAC_FB_NOMINAL(UAC_DEF_RATE); /* Feedback value sent to Host */
+static volatile uint32_t s_u32FbFrames = 0;   /* Frames measured in the current window. 0 to restart. */
+#endif
 
-/* Recoder Buffer and its pointer */
-uint32_t g_au32PcmRecBuf[96] = {0};
-volatile uint32_t g_u32RecPos = 0;
+#if (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE)
+/* 4-tap (Catmull-Rom) polyphase interpolation filter with 32 phases. Q15. */
+static const int16_t s_ai16RsCoef[32][4] =
+{
+    {     0,  32767,      1,      0},
+    {  -480,  32690,    574,    -16},
+    {  -900,  32460,   1268,    -60},
+    { -1262,  32088,   2072,   -130},
+    { -1568,  31584,   2976,   -224},
+    { -1822,  30956,   3972,   -338},
+    { -2028,  30212,   5052,   -468},
+    { -2188,  29362,   6206,   -612},
+    { -2304,  28416,   7424,   -768},
+    { -2380,  27382,   8698,   -932},
+    { -2420,  26268,  10020,  -1100},
+    { -2426,  25084,  11380,  -1270},
+    { -2400,  23840,  12768,  -1440},
+    { -2346,  22544,  14176,  -1606},
+    { -2268,  21204,  15596,  -1764},
+    { -2168,  19830,  17018,  -1912},
+    { -2048,  18432,  18432,  -2048},
+    { -1912,  17018,  19830,  -2168},
+    { -1764,  15596,  21204,  -2268},
+    { -1606,  14176,  22544,  -2346},
+    { -1440,  12768,  23840,  -2400},
+    { -1270,  11380,  25084,  -2426},
+    { -1100,  10020,  26268,  -2420},
+    {  -932,   8698,  27382,  -2380},
+    {  -768,   7424,  28416,  -2304},
+    {  -612,   6206,  29362,  -2188},
+    {  -468,   5052,  30212,  -2028},
+    {  -338,   3972,  30956,  -1822},
+    {  -224,   2976,  31584,  -1568},
+    {  -130,   2072,  32088,  -1262},
+    {   -60,   1268,  32460,   -900},
+    {   -16,    574,  32690,   -480},
+};
+
+#define UAC_RS_ONE          (1 << 24)                /* Resampler step 1.0 in Q24 */
+#define UAC_RS_MAX_ADJ      (UAC_RS_ONE / 500)       /* Step is adjusted by 0.2% at most */
+
+static volatile uint32_t s_u32RsStep = UAC_RS_ONE;   /* Play buffer samples per I2S sample. Q24. */
+static uint32_t s_u32RsPos = 0;                      /* Position between s_au32RsHist[1] and [2]. Q24. */
+static uint32_t s_au32RsHist[4 * PLAY_CHANNELS];     /* Last 4 samples got from play buffer */
+static int32_t s_i32RsLevel = BUF_LEN / 2 * 64;      /* Filtered play buffer level x 64 */
+#endif
 
-/* Player Buffer and its pointer */
-uint32_t g_au32PcmPlayBuf[BUF_LEN] = {0};
-volatile uint32_t g_u32PlayPos_Out = 0;
-volatile uint32_t g_u32PlayPos_In = 0;
+#if (UAC_SW_MIXER)
+/* Gain (Q15) of 0 dB ~ -63 dB in 1 dB steps */
+static const uint16_t s_au16MixGain[64] =
+{
+    32767, 29204, 26028, 23197, 20675, 18426, 16422, 14636,
+    13045, 11626, 10362,  9235,  8231,  7336,  6538,  5827,
+     5193,  4628,  4125,  3677,  3277,  2920,  2603,  2320,
+     2067,  1843,  1642,  1464,  1304,  1163,  1036,   923,
+      823,   734,   654,   583,   519,   463,   413,   368,
+      328,   292,   260,   232,   207,   184,   164,   146,
+      130,   116,   104,    92,    82,    73,    65,    58,
+       52,    46,    41,    37,    33,    29,    26,    23
+};
+
+/* Software mixer state of a play channel */
+typedef struct
+{
+    volatile int32_t i32Next;   /* Gain (Q15) set by VolumnControl(). Taken as the target at a zero cross. */
+    int32_t i32Target;          /* Gain (Q15) being ramped to */
+    int32_t i32Gain;            /* Gain (Q15) of the current sample */
+    int32_t i32Last;            /* Last input sample (24-bit). To find the zero cross. */
+    uint32_t u32ZcWait;         /* Samples waited for a zero cross */
+} UAC_MIX_CH_T;
+
+static UAC_MIX_CH_T s_asMixCh[PLAY_CHANNELS];
+#endif
 
 
 
@@ -69,13 +244,177 @@ uint32_t GetSamplesInBuf(void)
     i32Tmp = g_u32PlayPos_In;
     i32Tmp -= g_u32PlayPos_Out;
     if(i32Tmp < 0)
-        i32Tmp += BUF_LEN;
+        i32Tmp += s_u32PlayBufLen;
 
     return (uint32_t)i32Tmp;
 }
 
+/**
+ * @brief       Get the progress of a PDMA block
+ *
+ * @param[in]   u32Ch       PDMA channel
+ * @param[in]   u32BlkLen   Samples in a block
+ *
+ * @return      Whole samples PDMA has moved in the current block
+ *
+ * @details     A block which is done but not handled by PDMA_IRQHandler() yet is counted as a whole block.
+ *              A sample has a word for each of the 2 channels. Interrupts must be disabled by caller.
+ */
+static uint32_t UAC_GetDmaCnt(uint32_t u32Ch, uint32_t u32BlkLen)
+{
+    uint32_t u32Ctl;
+
+    /* Read the count before the done flag. The count of the next block is not used if the block is done between. */
+    u32Ctl = PDMA->DSCT[u32Ch].CTL;
+    if(PDMA_GET_TD_STS() & (1 << u32Ch))
+        return u32BlkLen;
+
+    if((u32Ctl & PDMA_DSCT_CTL_OPMODE_Msk) == 0)
+        return 0;
+
+    return (u32BlkLen * 2 - 1 - ((u32Ctl & PDMA_DSCT_CTL_TXCNT_Msk) >> PDMA_DSCT_CTL_TXCNT_Pos)) >> 1;
+}
+
+/**
+ * @brief       Unpack USB audio data to PCM words
+ *
+ * @param[in]   pu32Dst     PCM words. A word for each channel.
+ * @param[in]   pu8Src      USB audio data. Little-endian.
+ * @param[in]   u32Words    Number of words
+ * @param[in]   u32Bytes    Bytes of a channel in USB audio data. 2 or 3.
+ *
+ * @return      The USB audio data after the unpacked ones
+ *
+ * @details     The data are MSB-aligned in the PCM words for the 32-bit I2S slot.
+ */
+static uint8_t *UAC_UnpackPcm(uint32_t *pu32Dst, uint8_t *pu8Src, uint32_t u32Words, uint32_t u32Bytes)
+{
+    uint32_t i;
+
+    if(u32Bytes == 2)
+    {
+        for(i = 0; i < u32Words; i++)
+        {
+            pu32Dst[i] = ((uint32_t)pu8Src[0] << 16) | ((uint32_t)pu8Src[1] << 24);
+            pu8Src += 2;
+        }
+    }
+    else
+    {
+        for(i = 0; i < u32Words; i++)
+        {
+            pu32Dst[i] = ((uint32_t)pu8Src[0] << 8) | ((uint32_t)pu8Src[1] << 16) | ((uint32_t)pu8Src[2] << 24);
+            pu8Src += 3;
+        }
+    }
+
+    return pu8Src;
+}
+
+/**
+ * @brief       Pack PCM words to USB audio data
+ *
+ * @param[in]   pu8Dst      USB audio data. Little-endian.
+ * @param[in]   pu32Src     PCM words. A word for each channel. MSB-aligned.
+ * @param[in]   u32Words    Number of words
+ * @param[in]   u32Bytes    Bytes of a channel in USB audio data. 2 or 3.
+ *
+ * @return      The USB audio data after the packed ones
+ */
+static uint8_t *UAC_PackPcm(uint8_t *pu8Dst, uint32_t *pu32Src, uint32_t u32Words, uint32_t u32Bytes)
+{
+    uint32_t i, u32Data;
+
+    if(u32Bytes == 2)
+    {
+        for(i = 0; i < u32Words; i++)
+        {
+            u32Data = pu32Src[i];
+            pu8Dst[0] = (uint8_t)(u32Data >> 16);
+            pu8Dst[1] = (uint8_t)(u32Data >> 24);
+            pu8Dst += 2;
+        }
+    }
+    else
+    {
+        for(i = 0; i < u32Words; i++)
+        {
+            u32Data = pu32Src[i];
+            pu8Dst[0] = (uint8_t)(u32Data >> 8);
+            pu8Dst[1] = (uint8_t)(u32Data >> 16);
+            pu8Dst[2] = (uint8_t)(u32Data >> 24);
+            pu8Dst += 3;
+        }
+    }
+
+    return pu8Dst;
+}
+
 /*--------------------------------------------------------------------------*/
 
+/**
+ * @brief       SOF Handler
+ *
+ * @param[in]   None
+ *
+ * @return      None
+ *
+ * @details     This function is called every USB frame. It measures the I2S rate for the feedback endpoint,
+ *              or updates the resampler step from the play buffer level.
+ */
+static void UAC_SofHandler(void)
+{
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+    static uint32_t s_u32StartCnt = 0;
+    uint32_t u32Cnt;
+    int32_t i32Fb;
+
+    __set_PRIMASK(1);
+    u32Cnt = g_u32PlayCnt + UAC_GetDmaCnt(UAC_PLAY_PDMA_CH, s_u32PlayBlkLen);
+    __set_PRIMASK(0);
+
+    /* Count the I2S samples played in 2^UAC_FB_WINDOW_SHIFT frames */
+    if(s_u32FbFrames == 0)
+        s_u32StartCnt = u32Cnt;
+
+    if(++s_u32FbFrames > (1 << UAC_FB_WINDOW_SHIFT))
+    {
+        /* Samples per frame in 10.14 format */
+        i32Fb = (u32Cnt - s_u32StartCnt) << (14 - UAC_FB_WINDOW_SHIFT);
+
+        /* Ask Host for more or less data to keep the play buffer half full */
+        i32Fb += ((int32_t)(s_u32PlayBufLen / 2) - (int32_t)GetSamplesInBuf()) << UAC_FB_LEVEL_SHIFT;
+
+        /* Host may send one sample more or less than the nominal rate */
+        if(i32Fb > (int32_t)(s_u32FbNominal + (1 << 14)))
+            i32Fb = s_u32FbNominal + (1 << 14);
+        if(i32Fb < (int32_t)(s_u32FbNominal - (1 << 14)))
+            i32Fb = s_u32FbNominal - (1 << 14);
+
+        g_u32PlayFeedback = i32Fb;
+
+        s_u32StartCnt = u32Cnt;
+        s_u32FbFrames = 1;
+    }
+#elif (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE)
+    int32_t i32Adj;
+
+    /* Filter out the jitter of ISO OUT packets. Time constant is 64 frames. */
+    s_i32RsLevel += (int32_t)GetSamplesInBuf() - (s_i32RsLevel >> 6);
+
+    /* Consume play data faster when the buffer is more than half full */
+    i32Adj = ((s_i32RsLevel >> 6) - (int32_t)(s_u32PlayBufLen / 2)) * UAC_RS_GAIN;
+    if(i32Adj > UAC_RS_MAX_ADJ)
+        i32Adj = UAC_RS_MAX_ADJ;
+    if(i32Adj < -UAC_RS_MAX_ADJ)
+        i32Adj = -UAC_RS_MAX_ADJ;
+
+    s_u32RsStep = UAC_RS_ONE + i32Adj;
+#endif
+
+    g_u8UsbSof = 1;
+}
+
 
 /**
  * @brief       USBD Interrupt Service Routine
@@ -140,6 +479,15 @@ void USBD_IRQHandler(void)
         }
     }
 
+//------------------------------------------------------------------
+    if(u32IntSts & USBD_INTSTS_SOF)
+    {
+        /* Clear event flag */
+        USBD_CLR_INT_FLAG(USBD_INTSTS_SOF);
+
+        UAC_SofHandler();
+    }
+
 //------------------------------------------------------------------
     if(u32IntSts & USBD_INTSTS_USB)
     {
@@ -198,6 +546,9 @@ void USBD_IRQHandler(void)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP4);
+
+            // Isochronous IN of feedback
+            EP4_Handler();
         }
 
         if(u32IntSts & USBD_INTSTS_EP5)
@@ -262,58 +613,52 @@ void EP2_Handler(void)
 void EP3_Handler(void)
 {
 
-    uint32_t u32Len;
-    int32_t i;
-    uint8_t *pu8Buf;
+    uint32_t u32Len, u32Free, u32Span;
     uint8_t *pu8Src;
     uint32_t u32Idx;
 
     /* Get the address in USB buffer */
     pu8Src = (uint8_t *)((uint32_t)USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
 
-    /* Prepare for nex OUT packet */
-    USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
-
-    /* Get the temp buffer */
-    pu8Buf = (uint8_t *)g_au32UsbTmpBuf;
+    /* Get byte size of play data. It changes with the feedback in asynchronous mode. */
+    u32Len = USBD_GET_PAYLOAD_LEN(EP3);
+    if(u32Len > s_u32PlayMaxPkt)
+        u32Len = s_u32PlayMaxPkt;
 
-    /* Calculate byte size of play data */
-    u32Len = PLAY_RATE / 1000 * PLAY_CHANNELS * 2;
+    /* Calculate sample length */
+    u32Len = u32Len / (s_u32PlayBytes * PLAY_CHANNELS);
 
-    /* Copy all data from USB buffer to SRAM buffer */
-    /* We assume the source data are 4 bytes alignment. */
-    for(i = 0; i < u32Len; i += 4)
+    /* The block being played by PDMA starts at g_u32PlayPos_Out. Keep one sample free to tell full from empty. */
+    u32Free = s_u32PlayBufLen - 1 - GetSamplesInBuf();
+    if(u32Len > u32Free)
     {
-        pu8Buf[i] = pu8Src[i];
-        pu8Buf[i + 1] = pu8Src[i + 1];
-        pu8Buf[i + 2] = pu8Src[i + 2];
-        pu8Buf[i + 3] = pu8Src[i + 3];
+        /* Update play ring buffer only when it is not full */
+        u32Len = u32Free;
+        g_u32PlayOverrun++;
     }
 
-    /* Calculate word length */
-    u32Len = u32Len >> 2;
-    for(i = 0; i < u32Len; i++)
-    {
-        /* Check ring buffer turn around */
-        u32Idx = g_u32PlayPos_In + 1;
-        if(u32Idx >= BUF_LEN)
-            u32Idx = 0;
-
-        /* Check if buffer full */
-        if(u32Idx != g_u32PlayPos_Out)
-        {
-            /* Update play ring buffer only when it is not full */
-            g_au32PcmPlayBuf[u32Idx] = g_au32UsbTmpBuf[i];
+    /* Unpack the data from USB buffer to the play buffer read by PDMA directly */
+    u32Idx = g_u32PlayPos_In;
+    u32Span = s_u32PlayBufLen - u32Idx;
+    if(u32Span > u32Len)
+        u32Span = u32Len;
+    pu8Src = UAC_UnpackPcm(&g_au32PcmPlayBuf[u32Idx * PLAY_CHANNELS], pu8Src, u32Span * PLAY_CHANNELS, s_u32PlayBytes);
+    if(u32Len > u32Span)
+        UAC_UnpackPcm(&g_au32PcmPlayBuf[0], pu8Src, (u32Len - u32Span) * PLAY_CHANNELS, s_u32PlayBytes);
+
+    /* Update IN index */
+    u32Idx += u32Len;
+    if(u32Idx >= s_u32PlayBufLen)
+        u32Idx -= s_u32PlayBufLen;
+    g_u32PlayPos_In = u32Idx;
 
-            /* Update IN index */
-            g_u32PlayPos_In = u32Idx;
-        }
-    }
+    /* Prepare for nex OUT packet */
+    USBD_SET_PAYLOAD_LEN(EP3, s_u32PlayMaxPkt);
 
     if(g_u8PlayEn == 0)
     {
         /* Start play data output through I2S only when we have enough data in buffer */
-        if(GetSamplesInBuf() > BUF_LEN / 2)
+        if(GetSamplesInBuf() > s_u32PlayBufLen / 2)
             g_u8PlayEn = 1;
     }
 
@@ -322,6 +667,36 @@ void EP3_Handler(void)
 
 
 
+/**
+ * @brief       EP4 Handler (ISO IN feedback interrupt handler)
+ *
+ * @param[in]   None
+ *
+ * @return      None
+ *
+ * @details     This function is used to prepare the feedback of ISO OUT for the next poll of Host.
+ */
+void EP4_Handler(void)
+{
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+    uint8_t *pu8Buf;
+    uint32_t u32Fb;
+
+    /* Get the address in USB buffer */
+    pu8Buf = (uint8_t *)((uint32_t)USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP4));
+
+    /* 10.14 format in 3 bytes, little-endian */
+    u32Fb = g_u32PlayFeedback;
+    pu8Buf[0] = (uint8_t)u32Fb;
+    pu8Buf[1] = (uint8_t)(u32Fb >> 8);
+    pu8Buf[2] = (uint8_t)(u32Fb >> 16);
+
+    USBD_SET_PAYLOAD_LEN(EP4, EP4_MAX_PKT_SIZE);
+#endif
+}
+
+
+
 /*--------------------------------------------------------------------------*/
 /**
  * @brief       UAC Class Initial
@@ -358,10 +733,16 @@ void UAC_Init(void)
     /*****************************************************/
     /* EP3 ==> Isochronous OUT endpoint, address 2 */
     USBD_CONFIG_EP(EP3, USBD_CFG_EPMODE_OUT | ISO_OUT_EP_NUM | USBD_CFG_TYPE_ISO);
-    /* Buffer offset for EP3 */
-    USBD_SET_EP_BUF_ADDR(EP3, EP3_BUF_BASE);
-    /* trigger receive OUT data */
-    USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+    /* Buffer offset for EP3. It is moved by UAC_SetInterface() to fit the packet size of the alternate setting. */
+    USBD_SET_EP_BUF_ADDR(EP3, EP3_BUF_BASE(EP3_MAX_PKT_SIZE));
+
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+    /*****************************************************/
+    /* EP4 ==> Isochronous IN endpoint for feedback, address 3 */
+    USBD_CONFIG_EP(EP4, USBD_CFG_EPMODE_IN | ISO_FB_EP_NUM | USBD_CFG_TYPE_ISO);
+    /* Buffer offset for EP4 */
+    USBD_SET_EP_BUF_ADDR(EP4, EP4_BUF_BASE);
+#endif
 }
 
 
@@ -627,12 +1008,17 @@ void UAC_ClassRequest(void)
  *
  * @return      None
  *
- * @details     This function is used to set UAC Class relative setting
+ * @details     This function is used to set UAC Class relative setting.
+ *              Buffer sizes and packet sizes are set by the format of the alternate setting, and the sampling rate
+ *              is passed to UAC_RateControl(). The request is stalled when the EP2 and EP3 buffers of the selected
+ *              settings don't fit in USB SRAM together, or when the rate differs from the rate of the other active
+ *              direction because play and record share I2S.
  */
 void UAC_SetInterface(void)
 {
     uint8_t buf[8];
-    uint32_t u32AltInterface;
+    uint32_t u32AltInterface, u32MaxPkt;
+    const UAC_ALT_T *psAlt;
 
     USBD_GetSetupPacket(buf);
 
@@ -641,35 +1027,134 @@ void UAC_SetInterface(void)
     if(buf[4] == 1)
     {
         /* Audio Iso IN interface */
-        if(u32AltInterface == 1)
+        if(u32AltInterface > UAC_REC_ALT_NUM)
         {
+            /* Setup error, stall the device */
+            USBD_SetStall(0);
+            return;
+        }
+
+        if(u32AltInterface != 0)
+        {
+            psAlt = &s_asRecAlt[u32AltInterface - 1];
+
+            /* EP2 buffer grows up to EP3 buffer. Play must be stopped or at the same rate. */
+            u32MaxPkt = UAC_PKT_SIZE(psAlt->u32Rate, psAlt->u32Bytes, REC_CHANNELS);
+            if((EP2_BUF_BASE + u32MaxPkt > EP3_BUF_BASE(s_u32PlayMaxPkt)) ||
+                    (s_u32PlayRate && (s_u32PlayRate != psAlt->u32Rate)))
+            {
+                USBD_SetStall(0);
+                return;
+            }
+
+            /* Restart record with the new format */
+            UAC_DeviceDisable(UAC_MICROPHONE);
+
+            s_u32RecMaxPkt = u32MaxPkt;
+            s_u32RecRate = psAlt->u32Rate;
+            s_u32RecBytes = psAlt->u32Bytes;
+            s_u32RecBlkLen = psAlt->u32Rate / 1000;
+            s_u32RecBufLen = s_u32RecBlkLen * REC_BLK_NUM;
+            s_u32RecRateRem = psAlt->u32Rate % 1000;
+            s_u32RecFrac = 0;
+            s_u32ReqRate = psAlt->u32Rate;
+
             g_usbd_UsbAudioState = UAC_START_AUDIO_RECORD;
             USBD_SET_DATA1(EP2);
             USBD_SET_PAYLOAD_LEN(EP2, 0);
             UAC_DeviceEnable(UAC_MICROPHONE);
 
         }
-        else if(u32AltInterface == 0)
+        else
         {
             UAC_DeviceDisable(UAC_MICROPHONE);
             USBD_SET_DATA1(EP2);
             USBD_SET_PAYLOAD_LEN(EP2, 0);
             g_usbd_UsbAudioState = UAC_STOP_AUDIO_RECORD;
+            s_u32RecMaxPkt = 0;
+            s_u32RecRate = 0;
         }
     }
     else if(buf[4] == 2)
     {
         /* Audio Iso OUT interface */
-        if(u32AltInterface == 1)
+        if(u32AltInterface > UAC_PLAY_ALT_NUM)
+        {
+            /* Setup error, stall the device */
+            USBD_SetStall(0);
+            return;
+        }
+
+        if(u32AltInterface != 0)
         {
-            USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+            psAlt = &s_asPlayAlt[u32AltInterface - 1];
+
+            /* EP3 buffer grows down to EP2 buffer. Record must be stopped or at the same rate. */
+            u32MaxPkt = UAC_PKT_SIZE(psAlt->u32Rate, psAlt->u32Bytes, PLAY_CHANNELS);
+            if((EP2_BUF_BASE + s_u32RecMaxPkt > EP3_BUF_BASE(u32MaxPkt)) ||
+                    (s_u32RecRate && (s_u32RecRate != psAlt->u32Rate)))
+            {
+                USBD_SetStall(0);
+                return;
+            }
+
+            /* Restart play with the new format */
+            UAC_DeviceDisable(UAC_SPEAKER);
+
+            s_u32PlayMaxPkt = u32MaxPkt;
+            s_u32PlayRate = psAlt->u32Rate;
+            s_u32PlayBytes = psAlt->u32Bytes;
+            s_u32PlayBlkLen = psAlt->u32Rate / 1000;
+            s_u32PlayBufLen = BUF_LEN - BUF_LEN % s_u32PlayBlkLen;
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+            s_u32FbNominal = UAC_FB_NOMINAL(psAlt->u32Rate);
+#endif
+            s_u32ReqRate = psAlt->u32Rate;
+
+            USBD_SET_EP_BUF_ADDR(EP3, EP3_BUF_BASE(u32MaxPkt));
+            USBD_SET_PAYLOAD_LEN(EP3, u32MaxPkt);
             UAC_DeviceEnable(UAC_SPEAKER);
+
+            /* Prepare the first feedback */
+            EP4_Handler();
         }
         else
+        {
             UAC_DeviceDisable(UAC_SPEAKER);
+            s_u32PlayMaxPkt = 0;
+            s_u32PlayRate = 0;
+        }
     }
 }
 
+/**
+ * @brief       Sampling rate control
+ *
+ * @param[in]   None
+ *
+ * @return      None
+ *
+ * @details     This function is called by main loop. It sets I2S and codec to the sampling rate of the last
+ *              selected alternate setting. The clocks and I2C can't be changed in USB interrupt.
+ *              Play and record share I2S. UAC_SetInterface() only accepts a rate equal to the rate of the other
+ *              active direction, so the last selected rate suits both.
+ */
+void UAC_RateControl(void)
+{
+    uint32_t u32Rate;
+
+    u32Rate = s_u32ReqRate;
+    if(u32Rate == g_u32I2sRate)
+        return;
+
+    g_u32I2sRate = u32Rate;
+
+    I2S_SetRate(u32Rate);
+    NAU8822_SetRate(u32Rate);
+
+    printf("Sampling rate %d Hz\n", u32Rate);
+}
+
 uint32_t g_u32I2cFlow = 0;
 
 int32_t I2C_WaitReady(I2C_T *i2c)
@@ -756,44 +1241,15 @@ void NAU8822_Setup(void)
 
     I2C_WriteNAU8822(2,  0x1BF);   /* Enable L/R Headphone, ADC Mix/Boost, ADC */
     I2C_WriteNAU8822(3,  0x07F);   /* Enable L/R main mixer, DAC */
-    I2C_WriteNAU8822(4,  0x010);   /* 16-bit word length, I2S format, Stereo */
+    I2C_WriteNAU8822(4,  0x070);   /* 32-bit word length, I2S format, Stereo. 16/24-bit data are MSB-aligned. */
     I2C_WriteNAU8822(5,  0x000);   /* Companding control and loop back mode (all disable) */
 
     if(g_u32Master == 1)
-    {
         g_u32MasterSlave = SPII2S_MODE_MASTER;
-#if(PLAY_RATE == 48000)
-        I2C_WriteNAU8822(6, 0x000);    /* Divide by 1, 48K */
-        I2C_WriteNAU8822(7, 0x000);    /* 48K for internal filter cofficients */
-#elif(PLAY_RATE == 32000)
-        I2C_WriteNAU8822(6, 0x020);    /* Divide by 1.5, 32K */
-        I2C_WriteNAU8822(7, 0x002);    /* 32 for internal filter cofficients */
-#elif(PLAY_RATE == 16000)
-        I2C_WriteNAU8822(6, 0x060);    /* Divide by 3, 16K */
-        I2C_WriteNAU8822(7, 0x006);    /* 16K for internal filter cofficients */
-#else
-        I2C_WriteNAU8822(6, 0x0A0);    /* Divide by 6, 8K */
-        I2C_WriteNAU8822(7, 0x00A);    /* 8K for internal filter cofficients */
-#endif
-    }
     else
-    {
         g_u32MasterSlave = SPII2S_MODE_SLAVE;
 
-#if(PLAY_RATE == 48000)
-        I2C_WriteNAU8822(6,  0x14D);   /* Divide by 2, 48K */
-        I2C_WriteNAU8822(7,  0x000);   /* 48K for internal filter coefficients */
-#elif(PLAY_RATE == 32000)
-        I2C_WriteNAU8822(6,  0x16D);   /* Divide by 3, 32K */
-        I2C_WriteNAU8822(7,  0x002);   /* 32K for internal filter coefficients */
-#elif(PLAY_RATE == 16000)
-        I2C_WriteNAU8822(6,  0x1AD);   /* Divide by 6, 16K */
-        I2C_WriteNAU8822(7,  0x006);   /* 16K for internal filter coefficients */
-#else
-        I2C_WriteNAU8822(6,  0x1ED);   /* Divide by 12, 8K */
-        I2C_WriteNAU8822(7,  0x00A);   /* 8K for internal filter coefficients */
-#endif
-    }
+    NAU8822_SetRate(g_u32I2sRate);
 
 
     I2C_WriteNAU8822(10, 0x008);   /* DAC soft mute is disabled, DAC oversampling rate is 128x */
@@ -820,69 +1276,415 @@ void NAU8822_Setup(void)
     printf("NAU8822 setup ready!\n");
 }
 
+/**
+  * @brief  Set the sampling rate of NAU8822.
+  * @param  u32Rate: Sampling rate. 48000, 44100, 32000, 16000 or 8000.
+  * @retval None.
+  * @details In I2S master mode, MCLK is 256 * 48000 or 256 * 44100 and is divided for the lower rates.
+  *          In I2S slave mode, the codec PLL makes the clock from 12 MHz MCLK and BCLK is 64 * rate.
+  */
+void NAU8822_SetRate(uint32_t u32Rate)
+{
+    uint32_t u32R6, u32R7;
+
+    switch(u32Rate)
+    {
+        case 32000:
+            u32R6 = 0x020;     /* Divide by 1.5, 32K */
+            u32R7 = 0x002;     /* 32K for internal filter coefficients */
+            break;
+        case 16000:
+            u32R6 = 0x060;     /* Divide by 3, 16K */
+            u32R7 = 0x006;     /* 16K for internal filter coefficients */
+            break;
+        case 8000:
+            u32R6 = 0x0A0;     /* Divide by 6, 8K */
+            u32R7 = 0x00A;     /* 8K for internal filter coefficients */
+            break;
+        case 48000:
+        case 44100:
+        default:
+            u32R6 = 0x000;     /* Divide by 1, 48K or 44.1K */
+            u32R7 = 0x000;     /* 48K for internal filter coefficients */
+            break;
+    }
+
+    if(g_u32Master == 0)
+    {
+        /* PLL output is 12.288 MHz * 8 or 11.2896 MHz * 8 from 12 MHz MCLK */
+        if(u32Rate == 44100)
+        {
+            I2C_WriteNAU8822(36, 0x007);   /* PLLN = 7 */
+            I2C_WriteNAU8822(37, 0x021);   /* PLLK = 0x86C226 */
+            I2C_WriteNAU8822(38, 0x161);
+            I2C_WriteNAU8822(39, 0x026);
+        }
+        else
+        {
+            I2C_WriteNAU8822(36, 0x008);   /* PLLN = 8 */
+            I2C_WriteNAU8822(37, 0x00C);   /* PLLK = 0x3126E9 */
+            I2C_WriteNAU8822(38, 0x093);
+            I2C_WriteNAU8822(39, 0x0E9);
+        }
 
+        /* Clock from PLL, divided twice as much (next MCLKSEL code), BCLK = MCLK / 4, master mode */
+        u32R6 = (u32R6 + 0x040) | 0x109;
+    }
+
+    I2C_WriteNAU8822(6, u32R6);
+    I2C_WriteNAU8822(7, u32R7);
+}
 
-void SPI0_IRQHandler(void)
+
+
+#if (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE)
+/**
+  * @brief  Get the next I2S sample from the play buffer with the fractional resampler.
+  * @param  pu32Out: Words of the sample for I2S TX. A word for each channel.
+  * @return None.
+  * @details Play buffer samples are consumed at s_u32RsStep per I2S sample. The output is interpolated
+  *          between s_au32RsHist[1] and s_au32RsHist[2] by the polyphase filter.
+  *          The 24-bit data is filtered in 16-bit high and 8-bit low parts to keep the products in 32 bits.
+  */
+static void UAC_ResampleNext(uint32_t *pu32Out)
 {
-    uint32_t u32I2SIntFlag;
-    uint32_t i, u32Idx;
+    const int16_t *pi16Coef;
+    uint32_t i, j, u32Idx;
+    int32_t i32AccH, i32AccL, i32Out;
+
+    /* Get the play buffer samples passed by the new position */
+    s_u32RsPos += s_u32RsStep;
+    while(s_u32RsPos >= UAC_RS_ONE)
+    {
+        s_u32RsPos -= UAC_RS_ONE;
+
+        for(i = 0; i < 3 * PLAY_CHANNELS; i++)
+            s_au32RsHist[i] = s_au32RsHist[i + PLAY_CHANNELS];
+
+        /* Check buffer empty */
+        if((g_u32PlayPos_Out != g_u32PlayPos_In) && g_u8PlayEn)
+        {
+            u32Idx = g_u32PlayPos_Out;
+            for(j = 0; j < PLAY_CHANNELS; j++)
+                s_au32RsHist[3 * PLAY_CHANNELS + j] = g_au32PcmPlayBuf[u32Idx * PLAY_CHANNELS + j];
 
-    u32I2SIntFlag = SPI0->STATUS;//  I2S_GET_INT_FLAG(I2S, I2S_STATUS_I2STXINT_Msk | I2S_STATUS_I2SRXINT_Msk);
+            /* Check ring buffer trun around */
+            if(++u32Idx >= s_u32PlayBufLen)
+                u32Idx = 0;
+
+            /* Update OUT index */
+            g_u32PlayPos_Out = u32Idx;
+        }
+        else
+        {
+            /* Buffer underrun. Disable play */
+            if(g_u8PlayEn)
+                g_u32PlayUnderrun++;
+            for(j = 0; j < PLAY_CHANNELS; j++)
+                s_au32RsHist[3 * PLAY_CHANNELS + j] = 0;
+            g_u8PlayEn = 0;
+        }
+    }
 
-    if(u32I2SIntFlag & SPI_STATUS_TXTHIF_Msk)
+    /* The phase is the top 5 bits of the fraction */
+    pi16Coef = s_ai16RsCoef[s_u32RsPos >> 19];
+
+    /* Channel data are MSB-aligned 24-bit */
+    for(j = 0; j < PLAY_CHANNELS; j++)
     {
+        i32AccH = 0;
+        i32AccL = 0;
+        for(i = 0; i < 4; i++)
+        {
+            i32AccH += pi16Coef[i] * ((int32_t)s_au32RsHist[i * PLAY_CHANNELS + j] >> 16);
+            i32AccL += pi16Coef[i] * (int32_t)((s_au32RsHist[i * PLAY_CHANNELS + j] >> 8) & 0xFF);
+        }
 
-        /* Fill 2 word data when it is Tx threshold interrupt */
-        for(i = 0; i < 2; i++)
+        /* (i32AccH * 256 + i32AccL) / 32768 with rounding */
+        i32Out = (i32AccH >> 7) + ((((i32AccH & 0x7F) << 8) + i32AccL + 0x4000) >> 15);
+        if(i32Out > 0x7FFFFF)
+            i32Out = 0x7FFFFF;
+        if(i32Out < -0x800000)
+            i32Out = -0x800000;
+
+        pu32Out[j] = (uint32_t)i32Out << 8;
+    }
+}
+#endif
+
+#if (UAC_SW_MIXER)
+/**
+  * @brief  Multiply a 24-bit sample by a Q15 gain.
+  * @param  i32Data: 24-bit sample.
+  * @param  i32Gain: Gain in Q15. 0 ~ 32767.
+  * @return The 24-bit product.
+  * @details The sample is split into 16-bit high and 8-bit low parts to keep the products in 32 bits.
+  */
+static __INLINE int32_t UAC_MixMul(int32_t i32Data, int32_t i32Gain)
+{
+    return (((i32Data >> 8) * i32Gain) >> 7) + (((i32Data & 0xFF) * i32Gain) >> 15);
+}
+
+/**
+  * @brief  Mix a block of play data for I2S TX.
+  * @param  pu32Dst: Mixed block. MSB-aligned 24-bit words. A word for each channel.
+  * @param  pu32Src: Play data in the same format. It could be the same as pu32Dst.
+  * @param  u32Len: Samples of the block.
+  * @return None.
+  * @details Each channel is scaled by its gain, which ramps by UAC_MIX_RAMP_STEP per sample to a new
+  *          target. A new target is taken when the input crosses zero, or after UAC_MIX_ZC_TIMEOUT samples.
+  *          The latest recorded block is added as sidetone when record runs at the same rate.
+  *          The sum is limited by a soft clipper.
+  */
+static void UAC_MixBlock(uint32_t *pu32Dst, uint32_t *pu32Src, uint32_t u32Len)
+{
+    UAC_MIX_CH_T *psCh;
+    uint32_t *pu32Mic;
+    uint32_t i, j, u32Idx;
+    int32_t i32In, i32Out;
+
+    /* The record block finished last. It is not overwritten by PDMA before this block is played. */
+    pu32Mic = 0;
+    if(UAC_MIX_SIDETONE && g_u8RecEn && (s_u32RecBlkLen == u32Len))
+    {
+        u32Idx = (g_u32RecPos_In >= u32Len) ? (g_u32RecPos_In - u32Len) : (g_u32RecPos_In + s_u32RecBufLen - u32Len);
+        pu32Mic = &g_au32PcmRecBuf[u32Idx * REC_CHANNELS];
+    }
+
+    for(j = 0; j < PLAY_CHANNELS; j++)
+    {
+        psCh = &s_asMixCh[j];
+
+        for(i = 0; i < u32Len; i++)
         {
-            /* Check buffer empty */
-            if((g_u32PlayPos_Out != g_u32PlayPos_In) && g_u8PlayEn)
+            i32In = (int32_t)pu32Src[i * PLAY_CHANNELS + j] >> 8;
+
+            /* Take the new gain at a zero cross so the step is not heard */
+            if(psCh->i32Next != psCh->i32Target)
             {
+                if(((i32In ^ psCh->i32Last) < 0) || (i32In == 0) || (++psCh->u32ZcWait >= UAC_MIX_ZC_TIMEOUT))
+                {
+                    psCh->i32Target = psCh->i32Next;
+                    psCh->u32ZcWait = 0;
+                }
+            }
+            psCh->i32Last = i32In;
 
-                /* Check ring buffer trun around */
-                u32Idx = g_u32PlayPos_Out + 1;
-                if(u32Idx >= BUF_LEN)
-                    u32Idx = 0;
+            /* Ramp to the target gain */
+            if(psCh->i32Gain < psCh->i32Target)
+            {
+                psCh->i32Gain += UAC_MIX_RAMP_STEP;
+                if(psCh->i32Gain > psCh->i32Target)
+                    psCh->i32Gain = psCh->i32Target;
+            }
+            else if(psCh->i32Gain > psCh->i32Target)
+            {
+                psCh->i32Gain -= UAC_MIX_RAMP_STEP;
+                if(psCh->i32Gain < psCh->i32Target)
+                    psCh->i32Gain = psCh->i32Target;
+            }
 
-                /* Play to I2S */
-                SPII2S_WRITE_TX_FIFO(SPI0, g_au32PcmPlayBuf[u32Idx]);
+            i32Out = UAC_MixMul(i32In, psCh->i32Gain);
 
-                /* Update OUT index */
-                g_u32PlayPos_Out = u32Idx;
+            if(pu32Mic)
+                i32Out += UAC_MixMul((int32_t)pu32Mic[i * REC_CHANNELS + (j % REC_CHANNELS)] >> 8, UAC_MIX_SIDETONE);
+
+            /* Soft clipper. The peak of a full scale play with full scale sidetone stays under full scale. */
+            if(i32Out > UAC_MIX_KNEE)
+            {
+                i32Out = UAC_MIX_KNEE + ((i32Out - UAC_MIX_KNEE) >> 2);
+                if(i32Out > 0x7FFFFF)
+                    i32Out = 0x7FFFFF;
             }
-            else
+            else if(i32Out < -UAC_MIX_KNEE)
             {
-                /* Fill 0x0 when buffer is empty */
-                SPII2S_WRITE_TX_FIFO(SPI0, 0x00);
-                /* Buffer underrun. Disable play */
-                g_u8PlayEn = 0;
+                i32Out = -UAC_MIX_KNEE + ((i32Out + UAC_MIX_KNEE) >> 2);
+                if(i32Out < -0x800000)
+                    i32Out = -0x800000;
             }
+
+            pu32Dst[i * PLAY_CHANNELS + j] = (uint32_t)i32Out << 8;
         }
+    }
+}
+#endif
+
+/**
+  * @brief  Load a descriptor table with the next block to play.
+  * @param  u32Desc: Index of the descriptor table in g_asPlayDesc.
+  * @retval None.
+  * @details The play buffer is read by PDMA directly. Silence is played when a whole block is not ready.
+  *          In resampling mode the block is made by UAC_ResampleNext() instead.
+  *          With UAC_SW_MIXER, PDMA reads the block mixed by UAC_MixBlock().
+  */
+static void UAC_PlayDescLoad(uint32_t u32Desc)
+{
+#if (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE)
+    uint32_t i;
+
+    for(i = 0; i < s_u32PlayBlkLen; i++)
+        UAC_ResampleNext(&s_au32PlayBlk[u32Desc][i * PLAY_CHANNELS]);
+
+#if (UAC_SW_MIXER)
+    UAC_MixBlock(s_au32PlayBlk[u32Desc], s_au32PlayBlk[u32Desc], s_u32PlayBlkLen);
+#endif
+    g_asPlayDesc[u32Desc].src = (uint32_t)s_au32PlayBlk[u32Desc];
+#else
+    int32_t i32Len;
+
+    i32Len = (int32_t)g_u32PlayPos_In - (int32_t)s_u32PlayNext;
+    if(i32Len < 0)
+        i32Len += s_u32PlayBufLen;
+
+    if(g_u8PlayEn && (i32Len >= (int32_t)s_u32PlayBlkLen))
+    {
+        s_au32PlayBlkPos[u32Desc] = s_u32PlayNext;
+        g_asPlayDesc[u32Desc].src = (uint32_t)&g_au32PcmPlayBuf[s_u32PlayNext * PLAY_CHANNELS];
+
+        s_u32PlayNext += s_u32PlayBlkLen;
+        if(s_u32PlayNext >= s_u32PlayBufLen)
+            s_u32PlayNext = 0;
+    }
+    else
+    {
+        /* Buffer underrun. Disable play until the buffer is half full again. */
+        if(g_u8PlayEn)
+            g_u32PlayUnderrun++;
+        g_u8PlayEn = 0;
+
+        s_au32PlayBlkPos[u32Desc] = UAC_PLAY_SILENCE;
+        g_asPlayDesc[u32Desc].src = (uint32_t)s_au32PlaySilence;
+    }
+
+#if (UAC_SW_MIXER)
+    /* Silence is mixed too, so the ramps and sidetone go on when there is no play data */
+    UAC_MixBlock(s_au32PlayBlk[u32Desc], (uint32_t *)g_asPlayDesc[u32Desc].src, s_u32PlayBlkLen);
+    g_asPlayDesc[u32Desc].src = (uint32_t)s_au32PlayBlk[u32Desc];
+#endif
+#endif
 
+    g_asPlayDesc[u32Desc].ctl = ((s_u32PlayBlkLen * PLAY_CHANNELS - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_WIDTH_32 | PDMA_SAR_INC | PDMA_DAR_FIX |
+                                PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+}
+
+/**
+  * @brief  Load a descriptor table with the next block to record.
+  * @param  u32Desc: Index of the descriptor table in g_asRecDesc.
+  * @retval None.
+  */
+static void UAC_RecDescLoad(uint32_t u32Desc)
+{
+    g_asRecDesc[u32Desc].dest = (uint32_t)&g_au32PcmRecBuf[s_u32RecNext * REC_CHANNELS];
+
+    s_u32RecNext += s_u32RecBlkLen;
+    if(s_u32RecNext >= s_u32RecBufLen)
+        s_u32RecNext = 0;
+
+    g_asRecDesc[u32Desc].ctl = ((s_u32RecBlkLen * REC_CHANNELS - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC |
+                               PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+}
+
+/**
+  * @brief  Start to play by PDMA.
+  * @param  None.
+  * @retval None.
+  * @details The PDMA channel must be stopped before.
+  */
+static void UAC_PlayDmaStart(void)
+{
+    uint32_t i;
+
+    PDMA_CLR_TD_FLAG(1 << UAC_PLAY_PDMA_CH);
+
+#if (UAC_PLAY_SYNC != UAC_SYNC_RESAMPLE)
+    s_u32PlayNext = g_u32PlayPos_Out;
+#endif
+    for(i = 0; i < 2; i++)
+    {
+        UAC_PlayDescLoad(i);
+        g_asPlayDesc[i].dest = (uint32_t)&SPI0->TX;
+        g_asPlayDesc[i].offset = (uint32_t)&g_asPlayDesc[i ^ 1] - (PDMA->SCATBA);
     }
+    s_u32PlayDesc = 0;
+
+    PDMA_Open(1 << UAC_PLAY_PDMA_CH);
+    PDMA_SetTransferMode(UAC_PLAY_PDMA_CH, PDMA_SPI0_TX, TRUE, (uint32_t)&g_asPlayDesc[0]);
+    PDMA_EnableInt(UAC_PLAY_PDMA_CH, PDMA_INT_TRANS_DONE);
+
+    SPII2S_ENABLE_TXDMA(SPI0);
+}
 
-    if(u32I2SIntFlag & SPI_STATUS_RXTHIF_Msk)
+/**
+  * @brief  Start to record by PDMA.
+  * @param  None.
+  * @retval None.
+  * @details The PDMA channel must be stopped before.
+  */
+static void UAC_RecDmaStart(void)
+{
+    uint32_t i;
+
+    PDMA_CLR_TD_FLAG(1 << UAC_REC_PDMA_CH);
+
+    s_u32RecNext = 0;
+    for(i = 0; i < 2; i++)
     {
-        static int16_t i16Cnt = 0;
-        if((g_u32RecPos < 96) && g_u8RecEn)
-        {
+        UAC_RecDescLoad(i);
+        g_asRecDesc[i].src = (uint32_t)&SPI0->RX;
+        g_asRecDesc[i].offset = (uint32_t)&g_asRecDesc[i ^ 1] - (PDMA->SCATBA);
+    }
+    s_u32RecDesc = 0;
 
-            g_au32PcmRecBuf[g_u32RecPos  ] = SPII2S_READ_RX_FIFO(SPI0);
-            g_au32PcmRecBuf[g_u32RecPos + 1] = SPII2S_READ_RX_FIFO(SPI0);
-            g_au32PcmRecBuf[g_u32RecPos + 2] = SPII2S_READ_RX_FIFO(SPI0);
-            g_au32PcmRecBuf[g_u32RecPos + 3] = SPII2S_READ_RX_FIFO(SPI0);
-            g_u32RecPos += 4;
-            if(i16Cnt > 512) i16Cnt = -512;
-        }
+    PDMA_Open(1 << UAC_REC_PDMA_CH);
+    PDMA_SetTransferMode(UAC_REC_PDMA_CH, PDMA_SPI0_RX, TRUE, (uint32_t)&g_asRecDesc[0]);
+    PDMA_EnableInt(UAC_REC_PDMA_CH, PDMA_INT_TRANS_DONE);
+
+    SPII2S_ENABLE_RXDMA(SPI0);
+}
+
+void PDMA_IRQHandler(void)
+{
+    uint32_t u32Status = PDMA_GET_INT_STATUS();
+    uint32_t u32Desc;
+
+    if(u32Status & PDMA_INTSTS_ABTIF_Msk)
+    {
+        /* Clear all target abort flags */
+        PDMA->ABTSTS = PDMA->ABTSTS;
+    }
+
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << UAC_PLAY_PDMA_CH)))
+    {
+        /* A block is played. PDMA goes on with the other descriptor table. */
+        PDMA_CLR_TD_FLAG(1 << UAC_PLAY_PDMA_CH);
+
+        g_u32PlayCnt += s_u32PlayBlkLen;
+
+        u32Desc = s_u32PlayDesc;
+#if (UAC_PLAY_SYNC != UAC_SYNC_RESAMPLE)
+        /* Release the played block. The block being played must not be overwritten by EP3_Handler(). */
+        if(s_au32PlayBlkPos[u32Desc ^ 1] != UAC_PLAY_SILENCE)
+            g_u32PlayPos_Out = s_au32PlayBlkPos[u32Desc ^ 1];
         else
-        {
-            SPII2S_READ_RX_FIFO(SPI0);
-            SPII2S_READ_RX_FIFO(SPI0);
-            SPII2S_READ_RX_FIFO(SPI0);
-            SPII2S_READ_RX_FIFO(SPI0);
-        }
+            g_u32PlayPos_Out = s_u32PlayNext;
+#endif
+        UAC_PlayDescLoad(u32Desc);
+        s_u32PlayDesc = u32Desc ^ 1;
     }
 
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << UAC_REC_PDMA_CH)))
+    {
+        /* A block is recorded. PDMA goes on with the other descriptor table. */
+        PDMA_CLR_TD_FLAG(1 << UAC_REC_PDMA_CH);
+
+        g_u32RecPos_In += s_u32RecBlkLen;
+        if(g_u32RecPos_In >= s_u32RecBufLen)
+            g_u32RecPos_In = 0;
+
+        u32Desc = s_u32RecDesc;
+        UAC_RecDescLoad(u32Desc);
+        s_u32RecDesc = u32Desc ^ 1;
+    }
 }
 
 
@@ -895,29 +1697,58 @@ void SPI0_IRQHandler(void)
 void UAC_SendRecData(void)
 {
     uint8_t *pu8Buf;
-    uint32_t u32Size;
-    int32_t i;
+    uint32_t u32In, u32Cnt, u32Len, u32Pkt, u32Idx, u32Span;
 
     /* Get the address in USB buffer */
     pu8Buf = (uint8_t *)((uint32_t)USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP2));
 
-    /* Prepare the data to USB IN buffer */
-    u32Size = g_u32RecPos * 4;
-    if(u32Size > EP2_MAX_PKT_SIZE) u32Size = EP2_MAX_PKT_SIZE;
-    USBD_MemCopy(pu8Buf, (uint8_t *)g_au32PcmRecBuf, u32Size);
+    /* Get the samples of the finished blocks and the samples PDMA has put in current block */
+    __set_PRIMASK(1);
+    u32In = g_u32RecPos_In;
+    u32Cnt = (g_u8RecEn) ? UAC_GetDmaCnt(UAC_REC_PDMA_CH, s_u32RecBlkLen) : 0;
+    __set_PRIMASK(0);
 
-    /* Trigger ISO IN */
-    USBD_SET_PAYLOAD_LEN(EP2, u32Size);
+    /* Samples not sent yet. Both positions are ring indexes, so it is their difference in the ring. */
+    u32Len = (u32In + u32Cnt + s_u32RecBufLen - g_u32RecPos_Out) % s_u32RecBufLen;
 
-    __set_PRIMASK(1);
-    /*g_au32PcmRecBuf is not ring buffer. We need to copy remained data to buffer front */
-    g_u32RecPos -= (u32Size / 4);
-    if(g_u32RecPos)
+    /* Only the two blocks before current block are kept. The older data is overwritten by PDMA. */
+    if(u32Len > 2 * s_u32RecBlkLen + u32Cnt)
     {
-        for(i = 0; i < g_u32RecPos; i++)
-            g_au32PcmRecBuf[i] = g_au32PcmRecBuf[i + u32Size / 4];
+        g_u32RecPos_Out = (u32In + s_u32RecBufLen - 2 * s_u32RecBlkLen) % s_u32RecBufLen;
+        u32Len = 2 * s_u32RecBlkLen + u32Cnt;
+        g_u32RecOverrun++;
     }
-    __set_PRIMASK(0);
+
+    /* Send (rate / 1000) samples and one sample more in (rate % 1000) of 1000 frames, e.g. 9 packets of 44 samples
+       and 1 packet of 45 samples at 44.1 kHz. One more sample is sent to catch up when there is more than a block. */
+    u32Pkt = s_u32RecBlkLen;
+    s_u32RecFrac += s_u32RecRateRem;
+    if(s_u32RecFrac >= 1000)
+    {
+        s_u32RecFrac -= 1000;
+        u32Pkt++;
+    }
+
+    if(u32Len > u32Pkt + s_u32RecBlkLen)
+        u32Pkt++;
+    if(u32Len > u32Pkt)
+        u32Len = u32Pkt;
+
+    /* Prepare the data to USB IN buffer */
+    u32Idx = g_u32RecPos_Out;
+    u32Span = s_u32RecBufLen - u32Idx;
+    if(u32Span > u32Len)
+        u32Span = u32Len;
+    pu8Buf = UAC_PackPcm(pu8Buf, &g_au32PcmRecBuf[u32Idx * REC_CHANNELS], u32Span * REC_CHANNELS, s_u32RecBytes);
+    if(u32Len > u32Span)
+        UAC_PackPcm(pu8Buf, &g_au32PcmRecBuf[0], (u32Len - u32Span) * REC_CHANNELS, s_u32RecBytes);
+
+    /* Trigger ISO IN */
+    USBD_SET_PAYLOAD_LEN(EP2, u32Len * REC_CHANNELS * s_u32RecBytes);
+
+    g_u32RecPos_Out += u32Len;
+    if(g_u32RecPos_Out >= s_u32RecBufLen)
+        g_u32RecPos_Out -= s_u32RecBufLen;
 
 }
 
@@ -935,14 +1766,16 @@ void UAC_DeviceEnable(uint8_t u8Object)
         {
             /* Reset record buffer */
             memset(g_au32PcmRecBuf, 0, sizeof(g_au32PcmRecBuf));
-            g_u32RecPos = 0;
+            g_u32RecPos_In = 0;
+            g_u32RecPos_Out = 0;
+
+            SPII2S_CLR_RX_FIFO(SPI0);
+            UAC_RecDmaStart();
         }
 
         /* Enable record hardware */
         g_u8RecEn = 1;
 
-        SPII2S_CLR_RX_FIFO(SPI0);
-        SPII2S_EnableInt(SPI0, SPII2S_FIFO_RXTH_INT_MASK);
         SPII2S_ENABLE_RX(SPI0);
     }
     else
@@ -950,17 +1783,32 @@ void UAC_DeviceEnable(uint8_t u8Object)
         /* Reset Play buffer */
         if(g_u8PlayEn == 0)
         {
+            /* PDMA keeps playing silence after buffer underrun. Stop it before the buffer is reset. */
+            SPII2S_DISABLE_TXDMA(SPI0);
+            PDMA->RESET = (1 << UAC_PLAY_PDMA_CH);
+
             /* Fill 0x0 to buffer before playing for buffer operation smooth */
             memset(g_au32PcmPlayBuf, 0, sizeof(g_au32PcmPlayBuf));
-            g_u32PlayPos_In = BUF_LEN / 2;
+            g_u32PlayPos_In = s_u32PlayBufLen / 2;
             g_u32PlayPos_Out = 0;
-        }
 
-        /* Eanble play hardware */
-        g_u8PlayEn = 1;
+#if (UAC_PLAY_SYNC == UAC_SYNC_FEEDBACK)
+            /* Restart the I2S rate measurement */
+            g_u32PlayFeedback = s_u32FbNominal;
+            s_u32FbFrames = 0;
+#elif (UAC_PLAY_SYNC == UAC_SYNC_RESAMPLE)
+            memset(s_au32RsHist, 0, sizeof(s_au32RsHist));
+            s_u32RsPos = 0;
+            s_i32RsLevel = s_u32PlayBufLen / 2 * 64;
+#endif
+
+            /* Eanble play hardware */
+            g_u8PlayEn = 1;
+
+            SPII2S_CLR_TX_FIFO(SPI0);
+            UAC_PlayDmaStart();
+        }
 
-        SPII2S_CLR_TX_FIFO(SPI0);
-        SPII2S_EnableInt(SPI0, SPII2S_FIFO_TXTH_INT_MASK);
         SPII2S_ENABLE_TX(SPI0);
     }
 }
@@ -978,7 +1826,8 @@ void UAC_DeviceDisable(uint8_t u8Object)
         /* Disable record hardware/stop record */
         g_u8RecEn = 0;
 
-        SPII2S_DisableInt(SPI0, SPII2S_FIFO_RXTH_INT_MASK);
+        SPII2S_DISABLE_RXDMA(SPI0);
+        PDMA->RESET = (1 << UAC_REC_PDMA_CH);
         SPII2S_DISABLE_RX(SPI0);
         SPII2S_CLR_RX_FIFO(SPI0);
     }
@@ -987,7 +1836,8 @@ void UAC_DeviceDisable(uint8_t u8Object)
         /* Disable play hardware/stop play */
         g_u8PlayEn = 0;
 
-        SPII2S_DisableInt(SPI0, SPII2S_FIFO_TXTH_INT_MASK);
+        SPII2S_DISABLE_TXDMA(SPI0);
+        PDMA->RESET = (1 << UAC_PLAY_PDMA_CH);
         SPII2S_DISABLE_TX(SPI0);
         SPII2S_CLR_TX_FIFO(SPI0);
     }
@@ -1028,6 +1878,7 @@ void AdjustCodecPll(RESAMPLE_STATE_T r)
 
 void AdjFreq(void)
 {
+#if (UAC_PLAY_SYNC == UAC_SYNC_PLL)
     uint32_t u32Size;
     static int32_t i32PreFlag = 0;
     static int32_t i32Cnt = 0;
@@ -1045,13 +1896,13 @@ void AdjFreq(void)
     if(g_i32AdjFlag == 0)
     {
         /* Check if we need to adjust the frequency when we didn't in adjusting state */
-        if(u32Size > (BUF_LEN * 3 / 4))
+        if(u32Size > (s_u32PlayBufLen * 3 / 4))
         {
             /* USB rate > I2S rate. So we increase I2S rate here */
             AdjustCodecPll(E_RS_UP);
             g_i32AdjFlag = -1;
         }
-        else if(u32Size < (BUF_LEN * 1 / 4))
+        else if(u32Size < (s_u32PlayBufLen * 1 / 4))
         {
             /* USB rate < I2S rate. So we decrease I2S rate here */
             AdjustCodecPll(E_RS_DOWN);
@@ -1061,13 +1912,13 @@ void AdjFreq(void)
     else
     {
         /* Check if we need to stop adjust the frequency when we are in adjusting state */
-        if((g_i32AdjFlag > 0) && (u32Size > BUF_LEN / 2))
+        if((g_i32AdjFlag > 0) && (u32Size > s_u32PlayBufLen / 2))
         {
             AdjustCodecPll(E_RS_NONE);
             g_i32AdjFlag = 0;
         }
 
-        if((g_i32AdjFlag < 0) && (u32Size < BUF_LEN / 2))
+        if((g_i32AdjFlag < 0) && (u32Size < s_u32PlayBufLen / 2))
         {
             AdjustCodecPll(E_RS_NONE);
             g_i32AdjFlag = 0;
@@ -1081,19 +1932,42 @@ void AdjFreq(void)
 //        printf("%d %d %d %d %x\n", g_i32AdjFlag, u32Size, g_usbd_PlayVolumeL, g_usbd_RecVolumeL, (uint32_t)FAUDIOCFG);
         i32Cnt = 0;
     }
+#endif
+}
+
+#if (UAC_SW_MIXER)
+/**
+  * @brief  Get the software mixer gain of a play volume.
+  * @param  i16Volume: Play volume in 1/256 dB. -63 dB ~ 0 dB.
+  * @return Gain in Q15.
+  */
+static int32_t UAC_MixGain(int16_t i16Volume)
+{
+    int32_t i32Atten;
 
+    /* Attenuation in dB, rounded to the nearest step */
+    i32Atten = (-(int32_t)i16Volume + 0x80) >> 8;
+    if(i32Atten < 0)
+        i32Atten = 0;
+    if(i32Atten > 63)
+        i32Atten = 63;
+
+    return s_au16MixGain[i32Atten];
 }
+#endif
 
 void VolumnControl(void)
 {
+#if (UAC_SW_MIXER == 0)
     static uint8_t u8PrePlayMute = 0;
-    static uint8_t u8PreRecMute = 0;
     static int16_t i16PrePlayVolumeL = 0;
     static int16_t i16PrePlayVolumeR = 0;
+    uint32_t u32R52, u32R53;
+#endif
+    static uint8_t u8PreRecMute = 0;
     static int16_t i16PreRecVolumeL = 0;
     static int16_t i16PreRecVolumeR = 0;
     uint8_t IsChange = 0;
-    uint32_t u32R52, u32R53;
     uint32_t u32R15, u32R16;
 
     /*
@@ -1108,8 +1982,16 @@ void VolumnControl(void)
         NAU8822 LADCGAIN (R15) = MUTE, -127dB ~ 0dB. Code is 0x0, 0x1 ~ 0xFF.
         NAU8822 RADCGAIN (R16) = MUTE, -127dB ~ 0dB. Code is 0x0, 0x1 ~ 0xFF.
         Record volume mapping to code will be (Volume >> 8)+128
+
+        With UAC_SW_MIXER, play volume is -63 dB ~ 0 dB and is done by UAC_MixBlock().
+        NAU8822 keeps the HP gain at 0 dB.
     */
 
+#if (UAC_SW_MIXER)
+    /* The mixer takes the new gains at the next zero cross */
+    s_asMixCh[0].i32Next = g_usbd_PlayMute ? 0 : UAC_MixGain(g_usbd_PlayVolumeL);
+    s_asMixCh[1].i32Next = g_usbd_PlayMute ? 0 : UAC_MixGain(g_usbd_PlayVolumeR);
+#else
     u32R52 = 0;
     u32R53 = 0;
 
@@ -1141,6 +2023,7 @@ void VolumnControl(void)
         u32R53 |= (g_usbd_PlayVolumeR >> 10) + 32;
         IsChange |= 2;
     }
+#endif
 
     u32R15 = 0;
     u32R16 = 0;
@@ -1177,6 +2060,7 @@ void VolumnControl(void)
         IsChange |= 8;
     }
 
+#if (UAC_SW_MIXER == 0)
     /* Update R52, R53 when MUTE or volume changed */
     if((IsChange & 3) == 3)
     {
@@ -1197,6 +2081,7 @@ void VolumnControl(void)
         I2C_WriteNAU8822(53, u32R53 | 0x100);
         IsChange ^= 2;
     }
+#endif
 
     /* Update R15, R16 when MUTE or volume changed */
     if((IsChange & 0xc) == 0xc)
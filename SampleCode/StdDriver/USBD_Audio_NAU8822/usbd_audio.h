@@ -21,18 +21,66 @@
 #define UAC_SPEAKER     1
 
 /*!<Define Audio information */
-#define PLAY_RATE       48000       /* The audo play sampling rate. It could be 48000 */
 #define PLAY_CHANNELS   2           /* Number of channels. Don't Change */
-
-#define REC_RATE        PLAY_RATE   /* The record sampling rate. Must be the same with PLAY_RATE */
 #define REC_CHANNELS    2           /* Number of channels. Don't Change */
 
+/*!<Define the formats of alternate settings 1 ~ UAC_REC_ALT_NUM of record and 1 ~ UAC_PLAY_ALT_NUM of play.
+    The rate could be 48000, 44100, 32000, 16000 or 8000. The bits could be 16 or 24. The numbers could be 1 ~ 4.
+    Play and record share I2S, so UAC_SetInterface() rejects a rate different from the other active direction.
+    Only advertise the settings whose EP2 and EP3 buffers fit in USB SRAM together with every setting of the same
+    rate of the other direction. They don't fit when both directions are 24-bit, or when one direction is
+    48000 Hz 24-bit and the other is 48000 Hz 16-bit. So 24-bit is only for record and up to 44100 Hz. */
+#define UAC_REC_ALT_NUM     3
+#define UAC_REC_ALT1_RATE   48000
+#define UAC_REC_ALT1_BITS   16
+#define UAC_REC_ALT2_RATE   44100
+#define UAC_REC_ALT2_BITS   16
+#define UAC_REC_ALT3_RATE   44100
+#define UAC_REC_ALT3_BITS   24
+
+#define UAC_PLAY_ALT_NUM    2
+#define UAC_PLAY_ALT1_RATE  48000
+#define UAC_PLAY_ALT1_BITS  16
+#define UAC_PLAY_ALT2_RATE  44100
+#define UAC_PLAY_ALT2_BITS  16
+
+#define UAC_DEF_RATE        48000   /* I2S sampling rate before any alternate setting is selected */
+#define UAC_MAX_RATE        48000   /* The highest sampling rate of the settings. NAU8822 supports 48000 at most. */
+#define UAC_REC_MAX_BYTES   3       /* The largest sample size of the record settings in bytes */
+#define UAC_PLAY_MAX_BYTES  2       /* The largest sample size of the play settings in bytes */
+
+
+/*!<Define how the play data is kept in step with the I2S clock */
+#define UAC_SYNC_PLL        0   /* Adaptive. Trim the codec clock (FAUDIOCFG) when the play buffer is too full or too empty */
+#define UAC_SYNC_FEEDBACK   1   /* Asynchronous. Report the I2S rate to Host by the feedback endpoint */
+#define UAC_SYNC_RESAMPLE   2   /* Adaptive. Resample the play data to the I2S rate. For codecs without a trimmable clock. */
+#define UAC_PLAY_SYNC       UAC_SYNC_FEEDBACK
+
+#define UAC_FB_REFRESH      2   /* Host gets the feedback every 2^UAC_FB_REFRESH ms */
+#define UAC_FB_WINDOW_SHIFT 7   /* The I2S rate is measured over 2^UAC_FB_WINDOW_SHIFT frames */
+#define UAC_FB_LEVEL_SHIFT  4   /* Feedback correction (10.14) per sample of play buffer level error */
+#define UAC_RS_GAIN         16  /* Resampler step correction (Q24) per sample of play buffer level error */
+
+/*!<Define the software mixer between the play buffer and I2S. For codecs without volume control. */
+#define UAC_SW_MIXER        0           /* 1: Play volume, mute and sidetone by software. 0: Play volume and mute by NAU8822. */
+#define UAC_MIX_RAMP_STEP   64          /* Gain (Q15) change per sample. 0 dB to mute takes about 10 ms at 48 kHz. */
+#define UAC_MIX_ZC_TIMEOUT  480         /* Samples to wait for a zero cross before a new gain is ramped to anyway */
+#define UAC_MIX_SIDETONE    0x0800      /* Gain (Q15) of the record data mixed to play. 0x0800 is -24 dB. 0 to disable. */
+#define UAC_MIX_KNEE        0x600000    /* Soft clipper knee (24-bit). The part over the knee is compressed by 4:1. */
 
 #define REC_FEATURE_UNITID      0x05
 #define PLAY_FEATURE_UNITID     0x06
 
-#define BUF_LEN     48*64
-#define REC_LEN     REC_RATE / 1000
+/* Buffer sizes are in samples. A sample has a 32-bit word for each channel. */
+#define BUF_LEN     48*32
+
+/* I2S data are moved by PDMA in blocks of one USB frame, i.e. (sampling rate / 1000) samples */
+#define UAC_MAX_BLK_LEN     (UAC_MAX_RATE / 1000)
+#define REC_BLK_NUM         4
+#define REC_BUF_LEN         (UAC_MAX_BLK_LEN * REC_BLK_NUM)
+
+#define UAC_PLAY_PDMA_CH    1   /* PDMA channel for I2S TX */
+#define UAC_REC_PDMA_CH     2   /* PDMA channel for I2S RX */
 
 /* Define Descriptor information */
 #if(PLAY_CHANNELS == 1)
@@ -49,13 +97,9 @@
 #define REC_CH_CFG     3
 #endif
 
-#define PLAY_RATE_LO    (PLAY_RATE & 0xFF)
-#define PLAY_RATE_MD    ((PLAY_RATE >> 8) & 0xFF)
-#define PLAY_RATE_HI    ((PLAY_RATE >> 16) & 0xFF)
-
-#define REC_RATE_LO     (REC_RATE & 0xFF)
-#define REC_RATE_MD     ((REC_RATE >> 8) & 0xFF)
-#define REC_RATE_HI     ((REC_RATE >> 16) & 0xFF)
+#define UAC_RATE_LO(rate)   ((rate) & 0xFF)
+#define UAC_RATE_MD(rate)   (((rate) >> 8) & 0xFF)
+#define UAC_RATE_HI(rate)   (((rate) >> 16) & 0xFF)
 
 /********************************************/
 /* Audio Class Current State                */
@@ -90,8 +134,12 @@
 /* Define EP maximum packet size */
 #define EP0_MAX_PKT_SIZE    8
 #define EP1_MAX_PKT_SIZE    EP0_MAX_PKT_SIZE
-#define EP2_MAX_PKT_SIZE    256
-#define EP3_MAX_PKT_SIZE    PLAY_RATE*PLAY_CHANNELS*2/1000
+/* Maximum packet size of an alternate setting. There is room for one sample more than the rate rounded up,
+   so ISO OUT can follow the feedback and ISO IN can catch up with I2S. */
+#define UAC_PKT_SIZE(rate, bytes, ch)   ((((rate) + 999) / 1000 + 1) * (ch) * (bytes))
+#define EP2_MAX_PKT_SIZE    UAC_PKT_SIZE(UAC_MAX_RATE, UAC_REC_MAX_BYTES, REC_CHANNELS)
+#define EP3_MAX_PKT_SIZE    UAC_PKT_SIZE(UAC_MAX_RATE, UAC_PLAY_MAX_BYTES, PLAY_CHANNELS)
+#define EP4_MAX_PKT_SIZE    3
 
 #define SETUP_BUF_BASE      0
 #define SETUP_BUF_LEN       8
@@ -99,22 +147,32 @@
 #define EP0_BUF_LEN         EP0_MAX_PKT_SIZE
 #define EP1_BUF_BASE        (SETUP_BUF_BASE + SETUP_BUF_LEN)
 #define EP1_BUF_LEN         EP1_MAX_PKT_SIZE
-#define EP2_BUF_BASE        (EP1_BUF_BASE + EP1_BUF_LEN)
-#define EP2_BUF_LEN         EP2_MAX_PKT_SIZE
-#define EP3_BUF_BASE        (EP2_BUF_BASE + EP2_BUF_LEN)
-#define EP3_BUF_LEN         EP3_MAX_PKT_SIZE
+#define EP4_BUF_BASE        (EP1_BUF_BASE + EP1_BUF_LEN)
+#define EP4_BUF_LEN         8
+/* EP2 and EP3 buffer sizes depend on the alternate settings. EP2 buffer starts from EP2_BUF_BASE and
+   EP3 buffer ends at EP3_BUF_END. UAC_SetInterface() rejects the settings which don't fit in USB SRAM. */
+#define EP2_BUF_BASE        (EP4_BUF_BASE + EP4_BUF_LEN)
+#define EP3_BUF_END         USBD_BUF_SIZE
+#define EP3_BUF_BASE(len)   ((EP3_BUF_END - (len)) & ~0x7)
 
 /* Define the interrupt In EP number */
 #define ISO_IN_EP_NUM    0x01
 #define ISO_OUT_EP_NUM   0x02
+#define ISO_FB_EP_NUM    0x03   /* Feedback of ISO OUT */
 
 /*-------------------------------------------------------------*/
 extern volatile uint32_t g_usbd_UsbAudioState;
+extern volatile uint8_t g_u8UsbSof;
+extern volatile uint32_t g_u32I2sRate;
+extern volatile uint32_t g_u32PlayUnderrun;
+extern volatile uint32_t g_u32PlayOverrun;
+extern volatile uint32_t g_u32RecOverrun;
 
 void UAC_DeviceEnable(uint8_t u8Object);
 void UAC_DeviceDisable(uint8_t u8Object);
 void UAC_SendRecData(void);
 void UAC_GetPlayData(int16_t *pi16src, int16_t i16Samples);
+void UAC_RateControl(void);
 
 
 /*-------------------------------------------------------------*/
@@ -124,8 +182,11 @@ void UAC_SetInterface(void);
 
 void EP2_Handler(void);
 void EP3_Handler(void);
+void EP4_Handler(void);
 
 void NAU8822_Setup(void);
+void NAU8822_SetRate(uint32_t u32Rate);
+void I2S_SetRate(uint32_t u32Rate);
 void timer_init(void);
 void AdjFreq(void);
 void VolumnControl(void);
@@ -34,6 +34,16 @@ const uint8_t HID_DeviceReportDescriptor[] =
 };
 
 
+/* Interface, HID and endpoint descriptors of the interrupt endpoint pair n (n > 0) */
+#define HID_PAIR_IF_DESC(n) \
+    LEN_INTERFACE, DESC_INTERFACE, (n), 0x00, 0x02, 0x03, 0x00, 0x00, 0x00, \
+    LEN_HID, DESC_HID, 0x10, 0x01, 0x00, 0x01, DESC_HID_RPT, \
+    sizeof(HID_DeviceReportDescriptor) & 0x00FF, (sizeof(HID_DeviceReportDescriptor) & 0xFF00) >> 8, \
+    LEN_ENDPOINT, DESC_ENDPOINT, ((INT_IN_EP_NUM + 2 * (n)) | EP_INPUT), EP_INT, \
+    EP2_MAX_PKT_SIZE & 0x00FF, (EP2_MAX_PKT_SIZE & 0xFF00) >> 8, HID_DEFAULT_INT_IN_INTERVAL, \
+    LEN_ENDPOINT, DESC_ENDPOINT, ((INT_OUT_EP_NUM + 2 * (n)) | EP_OUTPUT), EP_INT, \
+    EP3_MAX_PKT_SIZE & 0x00FF, (EP3_MAX_PKT_SIZE & 0xFF00) >> 8, HID_DEFAULT_INT_IN_INTERVAL
+
 /*----------------------------------------------------------------------------*/
 /*!<USB Device Descriptor */
 const uint8_t gu8DeviceDescriptor[] =
@@ -64,9 +74,9 @@ const uint8_t gu8ConfigDescriptor[] =
     LEN_CONFIG,     /* bLength */
     DESC_CONFIG,    /* bDescriptorType */
     /* wTotalLength */
-    (LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2) & 0x00FF,
-    ((LEN_CONFIG + LEN_INTERFACE + LEN_HID + LEN_ENDPOINT * 2) & 0xFF00) >> 8,
-    0x01,           /* bNumInterfaces */
+    (LEN_CONFIG + LEN_HID_IF * HID_EP_PAIRS) & 0x00FF,
+    ((LEN_CONFIG + LEN_HID_IF * HID_EP_PAIRS) & 0xFF00) >> 8,
+    HID_EP_PAIRS,   /* bNumInterfaces */
     0x01,           /* bConfigurationValue */
     0x00,           /* iConfiguration */
     0x80 | (USBD_SELF_POWERED << 6) | (USBD_REMOTE_WAKEUP << 5),/* bmAttributes */
@@ -112,7 +122,14 @@ const uint8_t gu8ConfigDescriptor[] =
     /* wMaxPacketSize */
     EP3_MAX_PKT_SIZE & 0x00FF,
     (EP3_MAX_PKT_SIZE & 0xFF00) >> 8,
-    HID_DEFAULT_INT_IN_INTERVAL     /* bInterval */
+    HID_DEFAULT_INT_IN_INTERVAL,    /* bInterval */
+
+#if (HID_EP_PAIRS >= 2)
+    HID_PAIR_IF_DESC(1),
+#endif
+#if (HID_EP_PAIRS >= 3)
+    HID_PAIR_IF_DESC(2),
+#endif
 };
 
 /*!<USB Language String Descriptor */
@@ -156,21 +173,28 @@ const uint8_t *gpu8UsbString[4] =
     gu8StringSerial
 };
 
-const uint8_t *gpu8UsbHidReport[2] =
+/* All the interfaces have the same report descriptor */
+const uint8_t *gpu8UsbHidReport[4] =
 {
+    HID_DeviceReportDescriptor,
+    HID_DeviceReportDescriptor,
     HID_DeviceReportDescriptor,
     NULL
 };
 
-const uint32_t gu32UsbHidReportLen[2] =
+const uint32_t gu32UsbHidReportLen[4] =
 {
+    sizeof(HID_DeviceReportDescriptor),
+    sizeof(HID_DeviceReportDescriptor),
     sizeof(HID_DeviceReportDescriptor),
     0
 };
 
-const uint32_t gu32ConfigHidDescIdx[2] =
+const uint32_t gu32ConfigHidDescIdx[4] =
 {
     (LEN_CONFIG + LEN_INTERFACE),
+    (LEN_CONFIG + LEN_HID_IF + LEN_INTERFACE),
+    (LEN_CONFIG + LEN_HID_IF * 2 + LEN_INTERFACE),
     0
 };
 
@@ -58,6 +58,7 @@ void USBD_IRQHandler(void)
             /* Bus reset */
             USBD_ENABLE_USB();
             USBD_SwReset();
+            HID_StreamReset();
             g_u8Suspend = 0;
         }
         if(u32State & USBD_STATE_SUSPEND)
@@ -131,40 +132,67 @@ void USBD_IRQHandler(void)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP4);
+#if (HID_EP_PAIRS >= 2)
+            // Interrupt IN of pair 1
+            HID_StreamInDone(1);
+#endif
         }
 
         if(u32IntSts & USBD_INTSTS_EP5)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP5);
+#if (HID_EP_PAIRS >= 2)
+            // Interrupt OUT of pair 1
+            HID_StreamOutReady(1);
+#endif
         }
 
         if(u32IntSts & USBD_INTSTS_EP6)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP6);
+#if (HID_EP_PAIRS >= 3)
+            // Interrupt IN of pair 2
+            HID_StreamInDone(2);
+#endif
         }
 
         if(u32IntSts & USBD_INTSTS_EP7)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP7);
+#if (HID_EP_PAIRS >= 3)
+            // Interrupt OUT of pair 2
+            HID_StreamOutReady(2);
+#endif
         }
     }
 }
 
 void EP2_Handler(void)  /* Interrupt IN handler */
 {
+    /* A stream report is sent. Send the next one if there is. */
+    if(HID_StreamInDone(0))
+        return;
+
     HID_SetInReport();
 }
 
 void EP3_Handler(void)  /* Interrupt OUT handler */
 {
     uint8_t *ptr;
-    /* Interrupt OUT */
-    ptr = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
+
+    /* Data reports of stream write are taken in sequence from all pairs */
+    if(HID_StreamOutReady(0))
+        return;
+
+    /* Interrupt OUT. Parse the report in USB SRAM and then re-arm the endpoint */
+    ptr = USBD_AcquireEpBuf(EP3);
+    if(ptr == NULL)
+        return;     /* Still held by stream write, which re-arms it */
     HID_GetOutReport(ptr, USBD_GET_PAYLOAD_LEN(EP3));
-    USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+    USBD_ReleaseEpBuf(EP3, EP3_MAX_PKT_SIZE);
 }
 
 
@@ -176,6 +204,8 @@ void EP3_Handler(void)  /* Interrupt OUT handler */
   */
 void HID_Init(void)
 {
+    uint32_t i;
+
     /* Init setup packet buffer */
     /* Buffer range for setup packet -> [0 ~ 0x7] */
     USBD->STBUFSEG = SETUP_BUF_BASE;
@@ -204,6 +234,17 @@ void HID_Init(void)
     /* trigger to receive OUT data */
     USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
 
+    /*****************************************************/
+    /* Interrupt IN/OUT endpoints of the other pairs */
+    for(i = 1; i < HID_EP_PAIRS; i++)
+    {
+        USBD_CONFIG_EP(HID_PAIR_IN_EP(i), USBD_CFG_EPMODE_IN | (INT_IN_EP_NUM + 2 * i));
+        USBD_SET_EP_BUF_ADDR(HID_PAIR_IN_EP(i), HID_PAIR_BUF_BASE(HID_PAIR_IN_EP(i)));
+
+        USBD_CONFIG_EP(HID_PAIR_OUT_EP(i), USBD_CFG_EPMODE_OUT | (INT_OUT_EP_NUM + 2 * i));
+        USBD_SET_EP_BUF_ADDR(HID_PAIR_OUT_EP(i), HID_PAIR_BUF_BASE(HID_PAIR_OUT_EP(i)));
+        USBD_SET_PAYLOAD_LEN(HID_PAIR_OUT_EP(i), EP3_MAX_PKT_SIZE);
+    }
 }
 
 void HID_ClassRequest(void)
@@ -300,6 +341,9 @@ void HID_ClassRequest(void)
 #define HID_CMD_READ     0xD2
 #define HID_CMD_WRITE    0xC3
 #define HID_CMD_TEST     0xB4
+#define HID_CMD_STREAM_READ     0xD3    /* Read pages in a window of data reports */
+#define HID_CMD_STREAM_WRITE    0xC5    /* Write pages in data reports acknowledged by status reports */
+#define HID_CMD_STREAM_ACK      0xA5    /* Host acknowledges the reports of a stream read */
 
 #define PAGE_SIZE        2048
 #define TEST_PAGES       4
@@ -322,6 +366,66 @@ static uint8_t  g_u8PageBuff[PAGE_SIZE] = {0};    /* Page buffer to upload/downl
 static uint32_t g_u32BytesInPageBuf = 0;          /* The bytes of data in g_u8PageBuff */
 static uint8_t  g_u8TestPages[TEST_PAGES * PAGE_SIZE] = {0};    /* Test pages to upload/download through HID report */
 
+/*
+    Stream transfer
+
+    The data of a stream command goes in data reports without per-page handshakes.
+    Each data report has a sequence number (report count modulo 256) and up to HID_STREAM_DATA_SIZE bytes.
+    Data report k goes by the endpoint pair (k % HID_EP_PAIRS). Host puts the reports of all pairs in order
+    by the sequence numbers. Device takes the reports in order by holding the OUT endpoints of the later ones.
+    A status report is a data report with zero length. It carries the reports done in order and the CRC32
+    (IEEE 802.3, calculated by the CRC controller) of their data.
+
+    Stream read:  Device sends data reports while fewer than HID_STREAM_WINDOW reports are unacknowledged.
+                  Host acknowledges by HID_CMD_STREAM_ACK with Arg1 = reports received in order. Arg2 = 1 asks
+                  to resend from Arg1. A status report with the CRC32 of the pages follows the last data report.
+    Stream write: Host sends data reports with at most HID_STREAM_WINDOW reports unacknowledged.
+                  Device sends a status report every HID_STREAM_ACK_EVERY reports and after the last report.
+                  Reports out of sequence are dropped and reported by HID_STREAM_SEQ_ERR. Host resends from
+                  the reports done of the status report.
+*/
+#define HID_STREAM_DATA_SIZE    (EP2_MAX_PKT_SIZE - 2)
+#define HID_STREAM_WINDOW       16
+#define HID_STREAM_ACK_EVERY    8
+
+#define HID_STREAM_OK           0x00    /* Reports are received in order */
+#define HID_STREAM_SEQ_ERR      0x01    /* A report out of sequence is dropped */
+#define HID_STREAM_DONE         0x02    /* All data is transferred. u32Crc is the CRC32 of the data. */
+
+typedef struct
+{
+    uint8_t u8Seq;      /* Sequence number */
+    uint8_t u8Len;      /* Bytes in au8Data. 0 for a status report. */
+    uint8_t au8Data[HID_STREAM_DATA_SIZE];
+} __attribute__((packed)) HID_STREAM_DATA_T;
+
+typedef struct
+{
+    uint8_t u8Seq;          /* Sequence number of the next report */
+    uint8_t u8Len;          /* Always 0 */
+    uint8_t u8Status;       /* HID_STREAM_OK, HID_STREAM_SEQ_ERR or HID_STREAM_DONE */
+    uint8_t u8Rsvd;
+    uint32_t u32Reports;    /* Data reports done in order */
+    uint32_t u32Crc;        /* CRC32 of the data of the reports done */
+} __attribute__((packed)) HID_STREAM_STS_T;
+
+typedef struct
+{
+    uint8_t u8Cmd;          /* HID_CMD_STREAM_READ, HID_CMD_STREAM_WRITE or HID_CMD_NONE */
+    uint8_t u8Status;       /* Status of the next status report */
+    uint8_t u8StsPending;   /* A status report is waiting for EP2 */
+    uint8_t u8InBusy;       /* Bit n: IN endpoint of pair n has a stream report not taken by Host */
+    uint8_t u8Flag;         /* Read: The last status report is sent. Write: Dropping reports out of sequence. */
+    uint32_t u32Addr;       /* Offset of the stream in g_u8TestPages */
+    uint32_t u32Size;       /* Bytes of the stream */
+    uint32_t u32Reports;    /* Read: Reports sent. Write: Reports received in order. */
+    uint32_t u32Acked;      /* Read: Reports acknowledged by Host */
+    uint32_t u32CrcReports; /* Read: Reports whose data is in the CRC controller */
+    uint32_t u32Crc;        /* CRC32 of the status report */
+} HID_STREAM_T;
+
+static HID_STREAM_T s_sStream;
+
 int32_t HID_CmdEraseSectors(CMD_T *pCmd)
 {
     uint32_t u32StartSector;
@@ -416,6 +520,371 @@ int32_t HID_CmdTest(CMD_T *pCmd)
     return 0;
 }
 
+/**
+  * @brief  Check the pages of a stream command and start the stream.
+  * @param  pCmd: Stream command.
+  * @return 0 on success. -1 if the pages are out of the test pages.
+  */
+static int32_t HID_StreamStart(CMD_T *pCmd)
+{
+    uint32_t u32Pair;
+
+    if((pCmd->u32Arg2 == 0) || (pCmd->u32Arg1 >= TEST_PAGES) || (pCmd->u32Arg2 > TEST_PAGES - pCmd->u32Arg1))
+    {
+        s_sStream.u8Cmd = HID_CMD_NONE;
+        return -1;
+    }
+
+    s_sStream.u8Cmd = pCmd->u8Cmd;
+    s_sStream.u8Status = HID_STREAM_OK;
+    s_sStream.u8StsPending = 0;
+    s_sStream.u8Flag = 0;
+    s_sStream.u32Addr = pCmd->u32Arg1 * PAGE_SIZE;
+    s_sStream.u32Size = pCmd->u32Arg2 * PAGE_SIZE;
+    s_sStream.u32Reports = 0;
+    s_sStream.u32Acked = 0;
+    s_sStream.u32CrcReports = 0;
+
+    /* Drop the reports of an aborted stream which Host has not taken, so the new stream can use the endpoints */
+    for(u32Pair = 0; u32Pair < HID_EP_PAIRS; u32Pair++)
+    {
+        if(s_sStream.u8InBusy & (1 << u32Pair))
+            USBD_STOP_TRANSACTION(HID_PAIR_IN_EP(u32Pair));
+    }
+    s_sStream.u8InBusy = 0;
+
+    /* CRC32 of IEEE 802.3. The bytes of the stream are written one by one. */
+    CRC_Open(CRC_32, (CRC_WDATA_RVS | CRC_CHECKSUM_RVS | CRC_CHECKSUM_COM), 0xFFFFFFFF, CRC_CPU_WDATA_8);
+
+    /* The command is done by the stream */
+    pCmd->u8Cmd = HID_CMD_NONE;
+
+    return 0;
+}
+
+/**
+  * @brief  Send the next reports of a stream to the free IN endpoints.
+  * @param  None.
+  * @return None.
+  * @details A pending status report goes first by pair 0. In stream read, data reports are sent while the
+  *          window is not full and the IN endpoint of the next report is free. A status report follows
+  *          the last data report.
+  */
+static void HID_StreamSendIn(void)
+{
+    HID_STREAM_DATA_T *psData;
+    HID_STREAM_STS_T *psSts;
+    uint32_t i, u32Pos, u32Len, u32Pair;
+
+    while(s_sStream.u8StsPending || (s_sStream.u8Cmd == HID_CMD_STREAM_READ))
+    {
+        if(s_sStream.u8StsPending)
+        {
+            if(s_sStream.u8InBusy & 1)
+                return;
+
+            psSts = (HID_STREAM_STS_T *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP2));
+            psSts->u8Seq = (uint8_t)s_sStream.u32Reports;
+            psSts->u8Len = 0;
+            psSts->u8Status = s_sStream.u8Status;
+            psSts->u8Rsvd = 0;
+            psSts->u32Reports = s_sStream.u32Reports;
+            psSts->u32Crc = s_sStream.u32Crc;
+            USBD_SET_PAYLOAD_LEN(EP2, EP2_MAX_PKT_SIZE);
+            s_sStream.u8StsPending = 0;
+            s_sStream.u8InBusy |= 1;
+            continue;
+        }
+
+        u32Pos = s_sStream.u32Reports * HID_STREAM_DATA_SIZE;
+        if(u32Pos >= s_sStream.u32Size)
+        {
+            /* All data reports are sent. The status report is sent once until Host asks to resend. */
+            if(s_sStream.u8Flag)
+                return;
+
+            s_sStream.u8Flag = 1;
+            s_sStream.u8Status = HID_STREAM_DONE;
+            s_sStream.u32Crc = CRC_GetChecksum();
+            s_sStream.u8StsPending = 1;
+            continue;
+        }
+
+        /* Wait for Host to acknowledge when the window is full, or for the endpoint of the next report */
+        u32Pair = s_sStream.u32Reports % HID_EP_PAIRS;
+        if((s_sStream.u32Reports - s_sStream.u32Acked >= HID_STREAM_WINDOW) || (s_sStream.u8InBusy & (1 << u32Pair)))
+            return;
+
+        u32Len = s_sStream.u32Size - u32Pos;
+        if(u32Len > HID_STREAM_DATA_SIZE)
+            u32Len = HID_STREAM_DATA_SIZE;
+
+        /* The test pages stand for the storage to read */
+        psData = (HID_STREAM_DATA_T *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(HID_PAIR_IN_EP(u32Pair)));
+        psData->u8Seq = (uint8_t)s_sStream.u32Reports;
+        psData->u8Len = (uint8_t)u32Len;
+        USBD_MemCopy(psData->au8Data, &g_u8TestPages[s_sStream.u32Addr + u32Pos], u32Len);
+        USBD_SET_PAYLOAD_LEN(HID_PAIR_IN_EP(u32Pair), EP2_MAX_PKT_SIZE);
+
+        /* The CRC32 of the status report takes the data of a report when it is sent the first time.
+           Reports are sent in order before they are resent, so all the data goes in once and in order. */
+        if(s_sStream.u32Reports == s_sStream.u32CrcReports)
+        {
+            for(i = 0; i < u32Len; i++)
+                CRC_WRITE_DATA(g_u8TestPages[s_sStream.u32Addr + u32Pos + i]);
+            s_sStream.u32CrcReports++;
+        }
+
+        s_sStream.u32Reports++;
+        s_sStream.u8InBusy |= (1 << u32Pair);
+    }
+}
+
+/**
+  * @brief  Handle the IN transaction of a pair.
+  * @param  u32Pair: Endpoint pair. 0 ~ (HID_EP_PAIRS - 1).
+  * @return 1 if the IN endpoint of pair 0 is loaded with a stream report. Otherwise 0.
+  */
+int32_t HID_StreamInDone(uint32_t u32Pair)
+{
+    s_sStream.u8InBusy &= ~(1 << u32Pair);
+    HID_StreamSendIn();
+
+    return (s_sStream.u8InBusy & 1);
+}
+int32_t HID_CmdStreamRead(CMD_T *pCmd)
+{
+    printf("Stream read command - Start page: %d    Pages Numbers: %d\n", pCmd->u32Arg1, pCmd->u32Arg2);
+
+    if(HID_StreamStart(pCmd))
+        return -1;
+
+    /* Start the window */
+    HID_StreamSendIn();
+
+    return 0;
+}
+
+int32_t HID_CmdStreamWrite(CMD_T *pCmd)
+{
+    printf("Stream write command - Start page: %d    Pages Numbers: %d\n", pCmd->u32Arg1, pCmd->u32Arg2);
+
+    if(HID_StreamStart(pCmd))
+        return -1;
+
+    g_u32BytesInPageBuf = 0;
+
+    return 0;
+}
+
+int32_t HID_CmdStreamAck(CMD_T *pCmd)
+{
+    pCmd->u8Cmd = HID_CMD_NONE;
+
+    if(s_sStream.u8Cmd != HID_CMD_STREAM_READ)
+        return -1;
+
+    /* Host could only acknowledge the reports sent */
+    if(pCmd->u32Arg1 > s_sStream.u32Reports)
+        return -1;
+
+    s_sStream.u32Acked = pCmd->u32Arg1;
+
+    /* Go back to the first report Host missed */
+    if(pCmd->u32Arg2)
+    {
+        s_sStream.u32Reports = pCmd->u32Arg1;
+        s_sStream.u8Flag = 0;
+    }
+    else if(s_sStream.u8Flag && (s_sStream.u32Acked == s_sStream.u32Reports))
+    {
+        /* Host got all the reports */
+        s_sStream.u8Cmd = HID_CMD_NONE;
+        printf("Stream read complete.\n");
+        return 0;
+    }
+
+    /* The window has room again */
+    HID_StreamSendIn();
+
+    return 0;
+}
+
+/**
+  * @brief  Get a data report of stream write.
+  * @param  psData: Data report in USB SRAM.
+  * @return None.
+  * @details The data goes to the page buffer and the CRC controller. A full page is programmed.
+  */
+static void HID_StreamGetOut(HID_STREAM_DATA_T *psData)
+{
+    uint32_t i, u32Pos, u32Len;
+
+    u32Pos = s_sStream.u32Reports * HID_STREAM_DATA_SIZE;
+    u32Len = s_sStream.u32Size - u32Pos;
+    if(u32Len > HID_STREAM_DATA_SIZE)
+        u32Len = HID_STREAM_DATA_SIZE;
+
+    /* Drop the reports out of sequence until Host goes back to the expected one */
+    if((psData->u8Seq != (uint8_t)s_sStream.u32Reports) || (psData->u8Len != u32Len))
+    {
+        /* Report the first one only. The rest of the window is dropped silently. */
+        if(!s_sStream.u8Flag)
+        {
+            s_sStream.u8Flag = 1;
+            s_sStream.u8Status = HID_STREAM_SEQ_ERR;
+            s_sStream.u8StsPending = 1;
+        }
+    }
+    else
+    {
+        s_sStream.u8Flag = 0;
+
+        for(i = 0; i < u32Len; i++)
+        {
+            g_u8PageBuff[g_u32BytesInPageBuf] = psData->au8Data[i];
+            CRC_WRITE_DATA(psData->au8Data[i]);
+
+            if(++g_u32BytesInPageBuf >= PAGE_SIZE)
+            {
+                /* A full page goes to the test pages, which stand for the storage */
+                memcpy(&g_u8TestPages[s_sStream.u32Addr + u32Pos + i + 1 - PAGE_SIZE], g_u8PageBuff, PAGE_SIZE);
+                g_u32BytesInPageBuf = 0;
+            }
+        }
+
+        s_sStream.u32Reports++;
+
+        if(u32Pos + u32Len >= s_sStream.u32Size)
+        {
+            s_sStream.u8Status = HID_STREAM_DONE;
+            s_sStream.u8StsPending = 1;
+            s_sStream.u8Cmd = HID_CMD_NONE;
+            printf("Stream write complete.\n");
+        }
+        else if((s_sStream.u32Reports % HID_STREAM_ACK_EVERY) == 0)
+        {
+            s_sStream.u8Status = HID_STREAM_OK;
+            s_sStream.u8StsPending = 1;
+        }
+    }
+
+    s_sStream.u32Crc = CRC_GetChecksum();
+}
+
+/**
+  * @brief  Check whether a report is a command packet.
+  * @param  pu8Buf: Report in USB SRAM.
+  * @return 1 if the size, signature and checksum of the command are valid. Otherwise 0.
+  */
+static int32_t HID_IsCmdReport(uint8_t *pu8Buf)
+{
+    CMD_T sCmd;
+
+    USBD_MemCopy((uint8_t *)&sCmd, pu8Buf, sizeof(sCmd));
+
+    if((sCmd.u8Size > sizeof(sCmd)) || (sCmd.u32Signature != HID_CMD_SIGNATURE))
+        return 0;
+
+    return (CalCheckSum((uint8_t *)&sCmd, sCmd.u8Size) == sCmd.u32Checksum);
+}
+
+/**
+  * @brief  Stop the stream.
+  * @param  None.
+  * @return None.
+  * @details The reports held on pair 1 and over are dropped.
+  */
+static void HID_StreamAbort(void)
+{
+    uint32_t u32Pair;
+
+    s_sStream.u8Cmd = HID_CMD_NONE;
+
+    for(u32Pair = 1; u32Pair < HID_EP_PAIRS; u32Pair++)
+    {
+        if(USBD_IsEpBufAcquired(HID_PAIR_OUT_EP(u32Pair)))
+            USBD_ReleaseEpBuf(HID_PAIR_OUT_EP(u32Pair), EP3_MAX_PKT_SIZE);
+    }
+}
+
+/**
+  * @brief  Clear the stream state on bus reset and SET_CONFIGURATION.
+  * @param  None.
+  * @return None.
+  * @details The OUT endpoints of pair 1 and over are re-armed, since USBD_SwReset() forgets the held reports.
+  */
+void HID_StreamReset(void)
+{
+    uint32_t u32Pair;
+
+    memset(&s_sStream, 0, sizeof(s_sStream));
+
+    for(u32Pair = 1; u32Pair < HID_EP_PAIRS; u32Pair++)
+        USBD_SET_PAYLOAD_LEN(HID_PAIR_OUT_EP(u32Pair), EP3_MAX_PKT_SIZE);
+}
+
+/**
+  * @brief  Handle the OUT transaction of a pair.
+  * @param  u32Pair: Endpoint pair. 0 ~ (HID_EP_PAIRS - 1).
+  * @return 1 if the report is taken by stream write. 0 if it is not a stream report.
+  * @details The report is held in USB SRAM, and the endpoint NAKs, until the reports before it are taken.
+  *          Then the held reports of all pairs are taken in sequence and their endpoints are re-armed.
+  *          Reports on pair 1 and over are dropped when there is no stream write.
+  *          A command on pair 0, e.g. one to abort the stream, is left to HID_GetOutReport().
+  */
+int32_t HID_StreamOutReady(uint32_t u32Pair)
+{
+    uint32_t u32Ep, u32Seq;
+    uint8_t *pu8Buf;
+
+    if(s_sStream.u8Cmd != HID_CMD_STREAM_WRITE)
+    {
+        if(u32Pair == 0)
+            return 0;
+
+        USBD_SET_PAYLOAD_LEN(HID_PAIR_OUT_EP(u32Pair), EP3_MAX_PKT_SIZE);
+        return 1;
+    }
+
+    if((u32Pair == 0) && HID_IsCmdReport((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3))))
+        return 0;
+
+    /* Hold the report. The endpoint NAKs until it is released, so it cannot be held already. */
+    if(USBD_AcquireEpBuf(HID_PAIR_OUT_EP(u32Pair)) == NULL)
+        return 1;
+
+    /* Take the held reports in sequence */
+    while(s_sStream.u8Cmd == HID_CMD_STREAM_WRITE)
+    {
+        u32Ep = HID_PAIR_OUT_EP(s_sStream.u32Reports % HID_EP_PAIRS);
+        if(!USBD_IsEpBufAcquired(u32Ep))
+            break;
+
+        pu8Buf = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(u32Ep));
+        HID_StreamGetOut((HID_STREAM_DATA_T *)pu8Buf);
+        USBD_ReleaseEpBuf(u32Ep, EP3_MAX_PKT_SIZE);
+    }
+
+    /* Keep a held report only if it is the next one of its pair. The others are dropped, e.g. the rest of
+       the window after a report out of sequence, and Host resends them. */
+    for(u32Pair = 0; u32Pair < HID_EP_PAIRS; u32Pair++)
+    {
+        u32Ep = HID_PAIR_OUT_EP(u32Pair);
+        if(!USBD_IsEpBufAcquired(u32Ep))
+            continue;
+
+        u32Seq = s_sStream.u32Reports + (u32Pair + HID_EP_PAIRS - s_sStream.u32Reports % HID_EP_PAIRS) % HID_EP_PAIRS;
+        pu8Buf = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(u32Ep));
+        if((s_sStream.u8Cmd != HID_CMD_STREAM_WRITE) || (((HID_STREAM_DATA_T *)pu8Buf)->u8Seq != (uint8_t)u32Seq))
+            USBD_ReleaseEpBuf(u32Ep, EP3_MAX_PKT_SIZE);
+    }
+
+    HID_StreamSendIn();
+
+    return 1;
+}
+
 
 uint32_t CalCheckSum(uint8_t *buf, uint32_t size)
 {
@@ -454,6 +923,10 @@ int32_t ProcessCommand(uint8_t *pu8Buffer, uint32_t u32BufferLen)
     if(u32sum != gCmd.u32Checksum)
         return -1;
 
+    /* Any other command aborts the stream */
+    if(gCmd.u8Cmd != HID_CMD_STREAM_ACK)
+        HID_StreamAbort();
+
     switch(gCmd.u8Cmd)
     {
         case HID_CMD_ERASE:
@@ -476,6 +949,18 @@ int32_t ProcessCommand(uint8_t *pu8Buffer, uint32_t u32BufferLen)
             HID_CmdTest(&gCmd);
             break;
         }
+        case HID_CMD_STREAM_READ:
+        {
+            return HID_CmdStreamRead(&gCmd);
+        }
+        case HID_CMD_STREAM_WRITE:
+        {
+            return HID_CmdStreamWrite(&gCmd);
+        }
+        case HID_CMD_STREAM_ACK:
+        {
+            return HID_CmdStreamAck(&gCmd);
+        }
         default:
             return -1;
     }
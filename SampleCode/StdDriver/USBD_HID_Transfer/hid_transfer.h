@@ -31,12 +31,23 @@
 #define HID_RPT_TYPE_OUTPUT     0x02
 #define HID_RPT_TYPE_FEATURE    0x03
 
+/*!<Define the interrupt IN/OUT endpoint pairs. 1 ~ 3.
+    Pair n is HID interface n with EP(2+2n) for interrupt IN and EP(3+2n) for interrupt OUT.
+    The data reports of a stream are striped over the pairs, i.e. report k goes by pair (k % HID_EP_PAIRS),
+    so more than one report goes each way in a frame. Commands and status reports only use pair 0.
+    Keep 1 for the Windows tool, which opens the first interface of VID/PID and only knows pair 0. */
+#define HID_EP_PAIRS    1
+
 /*-------------------------------------------------------------*/
 /* Define EP maximum packet size */
 #define EP0_MAX_PKT_SIZE    8
 #define EP1_MAX_PKT_SIZE    EP0_MAX_PKT_SIZE
 #define EP2_MAX_PKT_SIZE    64
 #define EP3_MAX_PKT_SIZE    64
+#define EP4_MAX_PKT_SIZE    64
+#define EP5_MAX_PKT_SIZE    64
+#define EP6_MAX_PKT_SIZE    64
+#define EP7_MAX_PKT_SIZE    64
 
 #define SETUP_BUF_BASE  0
 #define SETUP_BUF_LEN   8
@@ -48,10 +59,27 @@
 #define EP2_BUF_LEN     EP2_MAX_PKT_SIZE
 #define EP3_BUF_BASE    (EP2_BUF_BASE + EP2_BUF_LEN)
 #define EP3_BUF_LEN     EP3_MAX_PKT_SIZE
+#define EP4_BUF_BASE    (EP3_BUF_BASE + EP3_BUF_LEN)
+#define EP4_BUF_LEN     EP4_MAX_PKT_SIZE
+#define EP5_BUF_BASE    (EP4_BUF_BASE + EP4_BUF_LEN)
+#define EP5_BUF_LEN     EP5_MAX_PKT_SIZE
+#define EP6_BUF_BASE    (EP5_BUF_BASE + EP5_BUF_LEN)
+#define EP6_BUF_LEN     EP6_MAX_PKT_SIZE
+#define EP7_BUF_BASE    (EP6_BUF_BASE + EP6_BUF_LEN)
+#define EP7_BUF_LEN     EP7_MAX_PKT_SIZE
+
+/* Hardware endpoints of a pair. The buffers of all pairs are the same size and follow each other. */
+#define HID_PAIR_IN_EP(n)       (EP2 + 2 * (n))
+#define HID_PAIR_OUT_EP(n)      (EP3 + 2 * (n))
+#define HID_PAIR_BUF_BASE(ep)   (EP2_BUF_BASE + ((ep) - EP2) * EP2_BUF_LEN)
 
 /* Define the EP number */
 #define INT_IN_EP_NUM       0x01
 #define INT_OUT_EP_NUM      0x02
+#define INT_IN2_EP_NUM      0x03
+#define INT_OUT2_EP_NUM     0x04
+#define INT_IN3_EP_NUM      0x05
+#define INT_OUT3_EP_NUM     0x06
 
 /* Define Descriptor information */
 #define HID_DEFAULT_INT_IN_INTERVAL     1
@@ -60,6 +88,7 @@
 #define USBD_MAX_POWER                  50  /* The unit is in 2mA. ex: 50 * 2mA = 100mA */
 
 #define LEN_CONFIG_AND_SUBORDINATE      (LEN_CONFIG+LEN_INTERFACE+LEN_HID+LEN_ENDPOINT)
+#define LEN_HID_IF                      (LEN_INTERFACE+LEN_HID+LEN_ENDPOINT*2)
 
 
 /*-------------------------------------------------------------*/
@@ -72,6 +101,10 @@ void EP2_Handler(void);
 void EP3_Handler(void);
 void HID_SetInReport(void);
 void HID_GetOutReport(uint8_t *pu8EpBuf, uint32_t u32Size);
+int32_t HID_StreamInDone(uint32_t u32Pair);
+int32_t HID_StreamOutReady(uint32_t u32Pair);
+void HID_StreamReset(void);
+uint32_t CalCheckSum(uint8_t *buf, uint32_t size);
 
 extern uint8_t volatile g_u8Suspend;
 
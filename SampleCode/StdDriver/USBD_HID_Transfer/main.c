@@ -77,6 +77,7 @@ void SYS_Init(void)
     /* Enable module clock */
     CLK_EnableModuleClock(UART0_MODULE);
     CLK_EnableModuleClock(USBD_MODULE);
+    CLK_EnableModuleClock(CRC_MODULE);
 
 
     /*---------------------------------------------------------------------------------------------------------*/
@@ -150,6 +151,7 @@ int32_t main(void)
 
     /* Open USB controller */
     USBD_Open(&gsInfo, HID_ClassRequest, NULL);
+    USBD_SetConfigCallback(HID_StreamReset);
 
     /*Init Endpoint configuration for HID */
     HID_Init();
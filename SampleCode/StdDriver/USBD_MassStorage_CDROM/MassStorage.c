@@ -35,6 +35,7 @@ uint32_t g_u32LbaAddress;
 uint32_t g_u32BytesInStorageBuf;
 
 uint32_t g_u32BulkBuf0, g_u32BulkBuf1;
+S_USBD_BULK_PP_T g_sBulkPP;
 
 /* CBW/CSW variables */
 struct CBW g_sCBW;
@@ -374,6 +375,23 @@ void EP3_Handler(void)
 }
 
 
+static void MSC_FillPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the next bulk IN packet from storage buffer to USB SRAM */
+    USBD_MemCopy(pu8Buf, (uint8_t *)g_u32Address, u32Size);
+    g_u32Address += u32Size;
+}
+
+static void MSC_DrainPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the received bulk OUT packet from USB SRAM to storage buffer */
+    if(u32Size > g_u32Length)
+        u32Size = g_u32Length;
+
+    USBD_MemCopy((uint8_t *)g_u32Address, pu8Buf, u32Size);
+    g_u32Address += u32Size;
+}
+
 void MSC_Init(void)
 {
     /* Init setup packet buffer */
@@ -408,6 +426,7 @@ void MSC_Init(void)
     /*****************************************************/
     g_u32BulkBuf0 = EP3_BUF_BASE;
     g_u32BulkBuf1 = EP2_BUF_BASE;
+    USBD_BulkPPInit(&g_sBulkPP, EP2, EP3, g_u32BulkBuf0, g_u32BulkBuf1, EP3_MAX_PKT_SIZE, MSC_FillPacket, MSC_DrainPacket);
 
     g_sCSW.dCSWSignature = CSW_SIGNATURE;
     g_TotalSectors = DATA_FLASH_STORAGE_SIZE / CDROM_BLOCK_SIZE;
@@ -715,13 +734,8 @@ void MSC_Read(void)
 {
     uint32_t u32Len;
 
-    if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
-    else
-        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-
-    /* Trigger to send out the data packet */
-    USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
+    /* Trigger to send out the data packet prepared in the idle buffer */
+    USBD_BulkPPTrigIn(&g_sBulkPP);
 
     g_u32Length -= g_u8Size;
     g_u32BytesInStorageBuf -= g_u8Size;
@@ -735,11 +749,7 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
         else
         {
@@ -757,11 +767,7 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
     }
 }
@@ -777,20 +783,10 @@ void MSC_ReadConfiguration(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
 
-        if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
-        else
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-
-        USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
+        USBD_BulkPPTrigIn(&g_sBulkPP);
 
         g_u32Length -= g_u8Size;
 
@@ -803,56 +799,36 @@ void MSC_ReadTrig(void)
 
     if(g_u32Length)
     {
-        if(g_u32BytesInStorageBuf)
-        {
-            /* Prepare next data packet */
-            g_u8Size = EP2_MAX_PKT_SIZE;
-            if(g_u8Size > g_u32Length)
-                g_u8Size = g_u32Length;
+        /* Trigger to send out the data packet prepared in the idle buffer */
+        USBD_BulkPPTrigIn(&g_sBulkPP);
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
-        }
-        else
+        g_u32Length -= g_u8Size;
+        g_u32BytesInStorageBuf -= g_u8Size;
+
+        if(g_u32Length)
         {
-            u32Len = g_u32Length;
-            if(g_u32LbaAddress <= (16 * CDROM_BLOCK_SIZE))   /* Logical Block Address > 32KB */
+            if(g_u32BytesInStorageBuf == 0)
             {
-                if(u32Len > STORAGE_BUFFER_SIZE)
-                    u32Len = STORAGE_BUFFER_SIZE;
-                g_u32Address = STORAGE_DATA_BUF;
-            }
+                u32Len = g_u32Length;
+                if(g_u32LbaAddress <= (16 * CDROM_BLOCK_SIZE))   /* Logical Block Address > 32KB */
+                {
+                    if(u32Len > STORAGE_BUFFER_SIZE)
+                        u32Len = STORAGE_BUFFER_SIZE;
+                    g_u32Address = STORAGE_DATA_BUF;
+                }
 
-            MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_DATA_BUF);
-            g_u32BytesInStorageBuf = u32Len;
-            g_u32LbaAddress += u32Len;
+                MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_DATA_BUF);
+                g_u32BytesInStorageBuf = u32Len;
+                g_u32LbaAddress += u32Len;
+            }
 
-            /* Prepare next data packet */
+            /* Prepare next data packet while the current one is on the bus */
             g_u8Size = EP2_MAX_PKT_SIZE;
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
-
-        /* DATA0/DATA1 Toggle */
-        if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
-        else
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-
-        /* Trigger to send out the data packet */
-        USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
-
-        g_u32Length -= g_u8Size;
-        g_u32BytesInStorageBuf -= g_u8Size;
     }
     else
         USBD_SET_PAYLOAD_LEN(EP2, 0);
@@ -1102,11 +1078,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     return;
@@ -1125,11 +1099,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     return;
@@ -1154,12 +1126,9 @@ void MSC_ProcessCmd(void)
                             g_u8Size = EP2_MAX_PKT_SIZE;
                         else
                             g_u8Size = g_u32Length;
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
-
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     else
@@ -1282,17 +1251,12 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32BytesInStorageBuf;
 
-                        /* Prepare the first data packet (DATA1) */
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first data packet (DATA1) in the idle buffer */
+                        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
 
-                        /* kick - start */
-                        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-                        /* Trigger to send out the data packet */
-                        USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
-                        g_u32Length -= g_u8Size;
-                        g_u32BytesInStorageBuf -= g_u8Size;
+                        /* kick - start. The next packet is prepared in the other buffer while this one is on the bus */
+                        MSC_ReadTrig();
                     }
                     return;
                 }
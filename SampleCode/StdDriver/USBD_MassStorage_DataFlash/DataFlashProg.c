@@ -27,168 +27,431 @@
 /* Macro, type and constant definitions                                                                    */
 /*---------------------------------------------------------------------------------------------------------*/
 
-uint32_t g_u32Tag = (uint32_t) - 1;
-uint32_t g_sectorBuf[FLASH_PAGE_SIZE / 4];
-
 #define WRITE_THROUGH       0   //0: write through off. Better performance. 1: write through on. Slower.
 
+/* Write-back page cache. Each way holds one flash page. */
+uint32_t g_au32CacheTag[FLASH_CACHE_WAYS];                      /* Page address of each way. -1 means free */
+uint32_t g_au32CacheAge[FLASH_CACHE_WAYS];                      /* LRU stamp. The way with the smallest one is evicted */
+uint8_t g_au8CacheDirty[FLASH_CACHE_WAYS];                      /* The way is modified and not programmed yet */
+uint32_t g_au32CacheBuf[FLASH_CACHE_WAYS][FLASH_PAGE_SIZE / 4];
+uint32_t g_u32CacheClock = 0;
 
-/* This is low level read function of USB Mass Storage */
-void DataFlashRead(uint32_t addr, uint32_t size, uint32_t buffer)
+/* Statistics */
+uint32_t volatile g_u32FlashEraseCnt = 0;                       /* Pages erased */
+uint32_t volatile g_u32CacheHitCnt = 0;
+uint32_t volatile g_u32CacheMissCnt = 0;
+
+
+#if FTL_ENABLE
+/*---------------------------------------------------------------------------------------------------------*/
+/* Flash translation layer                                                                                 */
+/*---------------------------------------------------------------------------------------------------------*/
+/*
+    The FTL area starts at MASS_STORAGE_OFFSET. It has FTL_PHY_PAGES data pages followed by two journal pages.
+    A logical page is written to the next free data page of a circular log, and then an entry of
+    (logical page, physical page) is appended to the journal. At power on the journal is replayed to rebuild
+    the map. If the power is lost before the entry is appended, the old copy is still mapped.
+    When the journal is full, the whole map is written to the other journal page and its header is
+    programmed last, so a torn compaction leaves the previous journal in use.
+*/
+#define FTL_MAGIC               0x46540000
+#define FTL_PAGE_ADDR(p)        (MASS_STORAGE_OFFSET + (p) * FLASH_PAGE_SIZE)
+#define FTL_JOURNAL_ADDR(j)     FTL_PAGE_ADDR(FTL_PHY_PAGES + (j))
+#define FTL_ENTRY(l, p)         ((l) | ((p) << 8) | ((~(l) & 0xFF) << 16) | ((~(p) & 0xFF) << 24))
+
+uint8_t g_au8FtlMap[FTL_LOG_PAGES];                             /* Physical page of each logical page */
+uint32_t g_u32FtlJournal;                                       /* Address of the active journal page */
+uint32_t g_u32FtlJournalPos;                                    /* Offset of the next free journal entry */
+uint32_t g_u32FtlCursor;                                        /* Next physical page of the circular log */
+uint32_t g_u32FtlWlCnt;
+
+/* Statistics since power on. Write amplification = g_u32FtlFlashWriteCnt / g_u32FtlHostWriteCnt */
+uint16_t g_au16FtlEraseCnt[FTL_PHY_PAGES];
+uint32_t volatile g_u32FtlHostWriteCnt = 0;
+uint32_t volatile g_u32FtlFlashWriteCnt = 0;
+
+
+static int32_t FtlOwner(uint32_t u32Phy)
 {
-    uint32_t alignAddr, offset, *pu32;
     int32_t i;
 
+    for(i = 0; i < FTL_LOG_PAGES; i++)
+    {
+        if(g_au8FtlMap[i] == u32Phy)
+            return i;
+    }
 
-    /* Modify the address to MASS_STORAGE_OFFSET */
-    addr += MASS_STORAGE_OFFSET;
+    return -1;
+}
 
-    /* Get address base on page size alignment */
-    alignAddr = addr & (~(FLASH_PAGE_SIZE - 1));
+static void FtlJournalCommit(uint32_t u32Journal, uint32_t u32Gen)
+{
+    int32_t i;
 
-    /* Get the sector offset*/
-    offset = (addr & (FLASH_PAGE_SIZE - 1));
+    FMC_Erase(u32Journal);
 
-    dbg("R[%08x] %x ALIGN[%08x] O %x\n", addr, size, alignAddr, offset);
+    for(i = 0; i < FTL_LOG_PAGES; i++)
+        FMC_Write(u32Journal + 4 + i * 4, FTL_ENTRY(i, g_au8FtlMap[i]));
 
-    pu32 = (uint32_t *)buffer;
+    /* The header is programmed last. The journal is valid only when the map is complete. */
+    FMC_Write(u32Journal, FTL_MAGIC | (u32Gen & 0xFFFF));
 
-#if WRITE_THROUGH
-    for(i = 0; i < size / 4; i++)
+    g_u32FtlJournal = u32Journal;
+    g_u32FtlJournalPos = 4 + FTL_LOG_PAGES * 4;
+}
+
+static void FtlJournalAppend(uint32_t u32Entry)
+{
+    if(g_u32FtlJournalPos >= FLASH_PAGE_SIZE)
     {
-        /* Read from flash */
-        pu32[i] = M32(addr + i * 4);
+        /* Journal full. Compact it into the other journal page. */
+        FtlJournalCommit((g_u32FtlJournal == FTL_JOURNAL_ADDR(0)) ? FTL_JOURNAL_ADDR(1) : FTL_JOURNAL_ADDR(0),
+                         M32(g_u32FtlJournal) + 1);
     }
-#else
-    for(i = 0; i < size / 4; i++)
+
+    FMC_Write(g_u32FtlJournal + g_u32FtlJournalPos, u32Entry);
+    g_u32FtlJournalPos += 4;
+}
+
+static void FtlProgram(uint32_t u32Log, uint32_t *pu32Buf)
+{
+    uint32_t u32Phy, u32Addr;
+    int32_t i;
+
+    /* Take the next free page of the circular log */
+    while(FtlOwner(g_u32FtlCursor) >= 0)
+        g_u32FtlCursor = (g_u32FtlCursor + 1) % FTL_PHY_PAGES;
+
+    u32Phy = g_u32FtlCursor;
+    g_u32FtlCursor = (g_u32FtlCursor + 1) % FTL_PHY_PAGES;
+    u32Addr = FTL_PAGE_ADDR(u32Phy);
+
+    dbg("FTL %d -> %d\n", u32Log, u32Phy);
+
+    /* Free pages are erased lazily. Skip the erase if the page is still blank. */
+    for(i = 0; i < FLASH_PAGE_SIZE / 4; i++)
     {
-        /* Read from cache */
-        if(((alignAddr + i * 4) >= g_u32Tag) && ((alignAddr + i * 4) < g_u32Tag + FLASH_PAGE_SIZE))
+        if(M32(u32Addr + i * 4) != 0xFFFFFFFF)
         {
-            offset = (addr + i * 4 - g_u32Tag) / 4;
-            pu32[i] = g_sectorBuf[offset];
+            FMC_Erase(u32Addr);
+            g_au16FtlEraseCnt[u32Phy]++;
+            g_u32FlashEraseCnt++;
+            break;
         }
-        else
+    }
+
+    for(i = 0; i < FLASH_PAGE_SIZE / 4; i++)
+    {
+        if(pu32Buf[i] != 0xFFFFFFFF)
+            FMC_Write(u32Addr + i * 4, pu32Buf[i]);
+    }
+
+    /* The new copy takes over only after its journal entry is programmed */
+    FtlJournalAppend(FTL_ENTRY(u32Log, u32Phy));
+    g_au8FtlMap[u32Log] = u32Phy;
+    g_u32FtlFlashWriteCnt++;
+}
+
+static void FtlInit(void)
+{
+    uint32_t u32H0, u32H1, u32Entry, u32Log, u32Phy;
+    int32_t i;
+
+    u32H0 = M32(FTL_JOURNAL_ADDR(0));
+    u32H1 = M32(FTL_JOURNAL_ADDR(1));
+
+    if(((u32H0 & 0xFFFF0000) != FTL_MAGIC) && ((u32H1 & 0xFFFF0000) != FTL_MAGIC))
+    {
+        /* No journal yet. Map the logical pages 1:1 so the data already in flash is kept. */
+        for(i = 0; i < FTL_LOG_PAGES; i++)
+            g_au8FtlMap[i] = i;
+
+        FtlJournalCommit(FTL_JOURNAL_ADDR(0), 0);
+        g_u32FtlCursor = FTL_LOG_PAGES % FTL_PHY_PAGES;
+        return;
+    }
+
+    /* Use the newer journal */
+    if((u32H1 & 0xFFFF0000) != FTL_MAGIC)
+        g_u32FtlJournal = FTL_JOURNAL_ADDR(0);
+    else if((u32H0 & 0xFFFF0000) != FTL_MAGIC)
+        g_u32FtlJournal = FTL_JOURNAL_ADDR(1);
+    else
+        g_u32FtlJournal = ((int16_t)(u32H1 - u32H0) > 0) ? FTL_JOURNAL_ADDR(1) : FTL_JOURNAL_ADDR(0);
+
+    /* Replay it. A torn entry is skipped. */
+    g_u32FtlCursor = 0;
+    for(g_u32FtlJournalPos = 4; g_u32FtlJournalPos < FLASH_PAGE_SIZE; g_u32FtlJournalPos += 4)
+    {
+        u32Entry = M32(g_u32FtlJournal + g_u32FtlJournalPos);
+        if(u32Entry == 0xFFFFFFFF)
+            break;
+
+        u32Log = u32Entry & 0xFF;
+        u32Phy = (u32Entry >> 8) & 0xFF;
+        if((((u32Entry ^ (u32Entry >> 16)) & 0xFFFF) != 0xFFFF) || (u32Log >= FTL_LOG_PAGES) || (u32Phy >= FTL_PHY_PAGES))
+            continue;
+
+        g_au8FtlMap[u32Log] = u32Phy;
+        g_u32FtlCursor = (u32Phy + 1) % FTL_PHY_PAGES;
+    }
+}
+
+static uint32_t FlashGetAddr(uint32_t u32Addr)
+{
+    return FTL_PAGE_ADDR(g_au8FtlMap[(u32Addr - MASS_STORAGE_OFFSET) / FLASH_PAGE_SIZE]) + (u32Addr & (FLASH_PAGE_SIZE - 1));
+}
+
+static void FlashPageProgram(uint32_t u32Addr, uint32_t *pu32Buf)
+{
+    int32_t i;
+
+    dbg("Flush %08x\n", u32Addr);
+
+    g_u32FtlHostWriteCnt++;
+    FtlProgram((u32Addr - MASS_STORAGE_OFFSET) / FLASH_PAGE_SIZE, pu32Buf);
+
+    /* Static wear leveling. Move the oldest data ahead of the cursor, so pages holding cold data get reused too. */
+    if(++g_u32FtlWlCnt >= FTL_WL_PERIOD)
+    {
+        g_u32FtlWlCnt = 0;
+
+        for(i = 0; i < FTL_PHY_PAGES; i++)
         {
-            /* Read from flash */
-            pu32[i] = M32(addr + i * 4);
+            int32_t i32Log = FtlOwner((g_u32FtlCursor + i) % FTL_PHY_PAGES);
+
+            if(i32Log >= 0)
+            {
+                FtlProgram(i32Log, (uint32_t *)FTL_PAGE_ADDR(g_au8FtlMap[i32Log]));
+                break;
+            }
         }
     }
-#endif
 }
 
+#else
+
+#define FlashGetAddr(u32Addr)   (u32Addr)
 
-void FlashCacheFlush(void)
+static void FlashPageProgram(uint32_t u32Addr, uint32_t *pu32Buf)
 {
     int32_t i;
 
-    if(g_u32Tag == (uint32_t) - 1)
-        return;
-
-    dbg("Flush %08x\n", g_u32Tag);
+    dbg("Flush %08x\n", u32Addr);
 
-    /* We need to flush out cache before update it */
-    FMC->ISPADDR = g_u32Tag;
-    FMC->ISPCMD = 0x22;
+    FMC->ISPADDR = u32Addr;
+    FMC->ISPCMD = FMC_ISPCMD_PAGE_ERASE;
     FMC->ISPTRG = 1;
     while(FMC->ISPTRG);
-    i = 0;
-    FMC->ISPCMD = 0x21;
-    FMC->ISPDAT = g_sectorBuf[i++];
-    do
+
+    FMC->ISPCMD = FMC_ISPCMD_PROGRAM;
+    for(i = 0; i < FLASH_PAGE_SIZE / 4; i++)
     {
+        FMC->ISPADDR = u32Addr + i * 4;
+        FMC->ISPDAT = pu32Buf[i];
         FMC->ISPTRG = 1;
         while(FMC->ISPTRG);
-        FMC->ISPADDR += 4;
-        FMC->ISPDAT = g_sectorBuf[i++];
     }
-    while(i <= FLASH_PAGE_SIZE / 4);
 
-    g_u32Tag = (uint32_t) - 1;
+    g_u32FlashEraseCnt++;
 }
 
-void DataFlashWrite(uint32_t addr, uint32_t size, uint32_t buffer)
+#endif
+
+static int32_t FlashCacheLookup(uint32_t u32Page)
 {
-    /* This is low level write function of USB Mass Storage */
-    int32_t len, i, offset;
-    uint32_t *pu32;
-    uint32_t alignAddr;
+    int32_t i;
+
+    for(i = 0; i < FLASH_CACHE_WAYS; i++)
+    {
+        if(g_au32CacheTag[i] == u32Page)
+        {
+            /* Most recently used */
+            g_au32CacheAge[i] = ++g_u32CacheClock;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void FlashCacheWriteBack(int32_t i32Way)
+{
+    if(g_au8CacheDirty[i32Way])
+    {
+        FlashPageProgram(g_au32CacheTag[i32Way], g_au32CacheBuf[i32Way]);
+        g_au8CacheDirty[i32Way] = 0;
+    }
+}
+
+static int32_t FlashCacheAlloc(uint32_t u32Page)
+{
+    int32_t i, i32Way;
+
+    /* Use a free way, or evict the least recently used one */
+    i32Way = 0;
+    for(i = 0; i < FLASH_CACHE_WAYS; i++)
+    {
+        if(g_au32CacheTag[i] == (uint32_t) - 1)
+        {
+            i32Way = i;
+            break;
+        }
+
+        if(g_au32CacheAge[i] < g_au32CacheAge[i32Way])
+            i32Way = i;
+    }
+
+    FlashCacheWriteBack(i32Way);
+
+    /* Load the page from flash. Data flash is memory mapped. */
+    for(i = 0; i < FLASH_PAGE_SIZE / 4; i++)
+        g_au32CacheBuf[i32Way][i] = M32(FlashGetAddr(u32Page) + i * 4);
+
+    g_au32CacheTag[i32Way] = u32Page;
+    g_au32CacheAge[i32Way] = ++g_u32CacheClock;
+
+    return i32Way;
+}
+
+
+void FlashCacheInit(void)
+{
+    int32_t i;
+
+    for(i = 0; i < FLASH_CACHE_WAYS; i++)
+    {
+        g_au32CacheTag[i] = (uint32_t) - 1;
+        g_au32CacheAge[i] = 0;
+        g_au8CacheDirty[i] = 0;
+    }
+
+#if FTL_ENABLE
+    FtlInit();
+#endif
+}
+
+uint32_t FlashCacheIsDirty(void)
+{
+    int32_t i;
+
+    for(i = 0; i < FLASH_CACHE_WAYS; i++)
+    {
+        if(g_au8CacheDirty[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+void FlashCacheFlush(void)
+{
+    int32_t i;
+
+    /* Program all modified pages. The clean copies stay in cache for later reads. */
+    for(i = 0; i < FLASH_CACHE_WAYS; i++)
+        FlashCacheWriteBack(i);
+}
+
+
+/* This is low level read function of USB Mass Storage */
+void DataFlashRead(uint32_t addr, uint32_t size, uint32_t buffer)
+{
+    uint32_t alignAddr, offset, len, i, *pu32;
+    int32_t i32Way;
+
 
     /* Modify the address to MASS_STORAGE_OFFSET */
     addr += MASS_STORAGE_OFFSET;
 
-    len = (int32_t)size;
+    pu32 = (uint32_t *)buffer;
 
-    do
+    while(size > 0)
     {
-
         /* Get address base on page size alignment */
         alignAddr = addr & (~(FLASH_PAGE_SIZE - 1));
 
         /* Get the sector offset*/
         offset = (addr & (FLASH_PAGE_SIZE - 1));
 
-        dbg("W[%08x] %x ALIGN[%08x] O %x\n", addr, size, alignAddr, offset);
+        dbg("R[%08x] %x ALIGN[%08x] O %x\n", addr, size, alignAddr, offset);
 
-        /* check cache buffer */
-        if(g_u32Tag != alignAddr)
+        len = FLASH_PAGE_SIZE - offset;
+        if(size < len)
+            len = size;
+
+        i32Way = FlashCacheLookup(alignAddr);
+
+        for(i = 0; i < len / 4; i++)
         {
-            if(g_u32Tag != (uint32_t) - 1)
+            if(i32Way >= 0)
             {
-                dbg("Flush: TAG %08x\n", g_u32Tag);
-
-                /* We need to flush out cache before update it */
-                FMC->ISPADDR = g_u32Tag;
-                FMC->ISPCMD = 0x22;
-                FMC->ISPTRG = 1;
-                while(FMC->ISPTRG);
-                i = 0;
-                FMC->ISPCMD = 0x21;
-                FMC->ISPDAT = g_sectorBuf[i++];
-                do
-                {
-                    FMC->ISPTRG = 1;
-                    while(FMC->ISPTRG);
-                    FMC->ISPADDR += 4;
-                    FMC->ISPDAT = g_sectorBuf[i++];
-                }
-                while(i <= FLASH_PAGE_SIZE / 4);
-
+                /* Read from cache */
+                pu32[i] = g_au32CacheBuf[i32Way][offset / 4 + i];
             }
-
-
-            /* load data to cache buffer */
-            i = 0;
-            FMC->ISPADDR = alignAddr;
-            FMC->ISPCMD = 0;
-            do
+            else
             {
-                FMC->ISPTRG = 1;
-                while(FMC->ISPTRG);
-                g_sectorBuf[i++] = FMC->ISPDAT;
-                FMC->ISPADDR += 4;
+                /* Read from flash */
+                pu32[i] = M32(FlashGetAddr(addr) + i * 4);
             }
-            while(i <= FLASH_PAGE_SIZE / 4);
-            g_u32Tag = alignAddr;
         }
 
-        /* Update the data */
-        pu32 = (uint32_t *)buffer;
+        size -= len;
+        addr += len;
+        pu32 += len / 4;
+    }
+}
+
+
+void DataFlashWrite(uint32_t addr, uint32_t size, uint32_t buffer)
+{
+    /* This is low level write function of USB Mass Storage */
+    uint32_t alignAddr, offset, len, i, *pu32;
+    int32_t i32Way;
+
+    /* Modify the address to MASS_STORAGE_OFFSET */
+    addr += MASS_STORAGE_OFFSET;
+
+    pu32 = (uint32_t *)buffer;
+
+    while(size > 0)
+    {
+        /* Get address base on page size alignment */
+        alignAddr = addr & (~(FLASH_PAGE_SIZE - 1));
+
+        /* Get the sector offset*/
+        offset = (addr & (FLASH_PAGE_SIZE - 1));
+
+        dbg("W[%08x] %x ALIGN[%08x] O %x\n", addr, size, alignAddr, offset);
+
+        /* check cache buffer */
+        i32Way = FlashCacheLookup(alignAddr);
+        if(i32Way < 0)
+        {
+            g_u32CacheMissCnt++;
+            i32Way = FlashCacheAlloc(alignAddr);
+        }
+        else
+            g_u32CacheHitCnt++;
+
+        /* Update the data. Rewriting the same content does not dirty the page. */
         len = FLASH_PAGE_SIZE - offset;
         if(size < len)
             len = size;
 
         for(i = 0; i < len / 4; i++)
         {
-            g_sectorBuf[offset / 4 + i] = pu32[i];
+            if(g_au32CacheBuf[i32Way][offset / 4 + i] != pu32[i])
+            {
+                g_au32CacheBuf[i32Way][offset / 4 + i] = pu32[i];
+                g_au8CacheDirty[i32Way] = 1;
+            }
         }
 
         size -= len;
         addr += len;
-        buffer += len;
-
+        pu32 += len / 4;
     }
-    while(size > 0);
 
 #if WRITE_THROUGH
     FlashCacheFlush();
@@ -13,6 +13,17 @@
 #define DATA_FLASH_STORAGE_SIZE   (64*1024)  /* Configure the DATA FLASH storage size. To pass USB-IF MSC Test, it needs > 64KB */
 #define FLASH_PAGE_SIZE           2048
 #define BUFFER_PAGE_SIZE          2048
+#define FLASH_CACHE_WAYS          4          /* Flash pages held by the write-back cache. Each one takes FLASH_PAGE_SIZE bytes of SRAM */
+
+#define FTL_ENABLE                1          /* 1: Wear-leveling flash translation layer. 0: Logical pages are mapped 1:1 to flash */
+#define FTL_AREA_SIZE             (96*1024)  /* Data flash from MASS_STORAGE_OFFSET, i.e. 0x8000 ~ 0x1FFFF. It must end within the 256KB flash. */
+#define FTL_LOG_PAGES             (DATA_FLASH_STORAGE_SIZE / FLASH_PAGE_SIZE)
+#define FTL_PHY_PAGES             (FTL_AREA_SIZE / FLASH_PAGE_SIZE - 2)    /* Data pages. The last two pages hold the journal */
+#define FTL_WL_PERIOD             16         /* Move one page of cold data every FTL_WL_PERIOD page writes */
+
+void FlashCacheInit(void);
+void FlashCacheFlush(void);
+uint32_t FlashCacheIsDirty(void);
 
 
 #endif  /* __DATA_FLASH_PROG_H__ */
@@ -65,6 +65,7 @@
 #define UFI_WRITE_10                            0x2A
 #define UFI_WRITE_12                            0xAA
 #define UFI_VERIFY_10                           0x2F
+#define UFI_SYNCHRONIZE_CACHE                   0x35
 #define UFI_MODE_SELECT_10                      0x55
 #define UFI_MODE_SENSE_10                       0x5A
 #define UFI_READ_CAPACITY_16                    0x9E
@@ -76,6 +77,11 @@
 #define BULK_CSW  0x04
 #define BULK_NORMAL 0xFF
 
+/* Read-ahead state of the storage buffer not streaming to host */
+#define RA_IDLE   0x00                        /* Nothing left to fetch */
+#define RA_BUSY   0x01                        /* Next chunk is requested and fetched by MSC_ReadAhead() */
+#define RA_READY  0x02                        /* Next chunk is in the storage buffer */
+
 static __INLINE uint32_t get_be32(uint8_t *buf)
 {
     return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
@@ -118,12 +124,15 @@ struct CSW
 #define MASS_BUFFER_SIZE    256               /* Mass Storage command buffer size */
 #define STORAGE_BUFFER_SIZE 512               /* Data transfer buffer size in 512 bytes alignment */
 #define UDC_SECTOR_SIZE   512                 /* logic sector size */
+#define STORAGE_BUFFER_NUM  2                 /* Storage buffers for media read-ahead and write-behind */
+#define MSC_IDLE_FLUSH_MS   500               /* Program the flash cache after host is idle for this time. It should be < 2048 */
 
 extern uint32_t MassBlock[];
 extern uint32_t Storage_Block[];
 
 #define MassCMD_BUF        ((uint32_t)&MassBlock[0])
 #define STORAGE_DATA_BUF   ((uint32_t)&Storage_Block[0])
+#define STORAGE_BUF(idx)        (STORAGE_DATA_BUF + (idx) * STORAGE_BUFFER_SIZE)
 
 /*-------------------------------------------------------------*/
 
@@ -138,6 +147,8 @@ void MSC_ReadCapacity(void);
 void MSC_Write(void);
 void MSC_ModeSense10(void);
 void MSC_ReadTrig(void);
+void MSC_ReadAhead(void);
+void MSC_MediaTask(void);
 void MSC_ClassRequest(void);
 void MSC_SetConfig(void);
 
@@ -147,6 +158,10 @@ void MSC_WriteMedia(uint32_t addr, uint32_t size, uint8_t *buffer);
 /*-------------------------------------------------------------*/
 void MSC_AckCmd(void);
 void MSC_ProcessCmd(void);
+
+/* Read-ahead statistics of the last READ(10)/READ(12) command */
+extern uint32_t volatile g_u32ReadStallCnt;
+extern uint32_t volatile g_u32ReadStallMs;
 void EP2_Handler(void);
 void EP3_Handler(void);
 
@@ -42,16 +42,41 @@ uint32_t g_u32LbaAddress;
 uint32_t g_u32BytesInStorageBuf;
 
 uint32_t g_u32BulkBuf0, g_u32BulkBuf1;
+S_USBD_BULK_PP_T g_sBulkPP;
 uint32_t volatile g_u32OutToggle = 0, g_u32OutSkip = 0;
 
 uint32_t volatile g_u32CbwStall = 0;
 
+/* Read-ahead variables */
+uint8_t volatile g_u8ReadAheadState = RA_IDLE;
+uint8_t volatile g_u8StorageIdx = 0;            /* Storage buffer streaming to host */
+uint8_t volatile g_u8InPrepared = 0;            /* Next bulk IN packet is in the idle packet buffer */
+uint8_t volatile g_u8InIdle = 0;                /* Bulk IN is acknowledged and nothing is sent yet */
+uint8_t volatile g_u8ReadStall = 0;             /* Bulk IN is waiting for read-ahead */
+uint32_t g_u32ReadAheadLen;                     /* Bytes left to fetch for current command */
+uint32_t g_u32ReadAheadSize;                    /* Size of the fetched chunk */
+uint32_t g_u32StallFrame;
+uint8_t volatile g_u8ReadErr = 0;               /* A chunk of current command could not be read */
+uint8_t volatile g_u8WriteErr = 0;              /* A chunk of current command could not be written */
+
+/* Write-behind variables */
+uint8_t volatile g_u8MediaPend = 0;             /* Storage buffers waiting to be written to media (bit mask) */
+uint8_t g_u8MediaHead;                          /* Storage buffer to be written next */
+uint8_t volatile g_u8MediaAck = 0;              /* CSW is deferred until the media writes complete */
+uint8_t volatile g_u8OutHeld = 0;               /* Bulk OUT is waiting for a free storage buffer */
+uint32_t g_au32MediaAddr[STORAGE_BUFFER_NUM];
+uint32_t g_au32MediaLen[STORAGE_BUFFER_NUM];
+
+/* Read-ahead statistics of the last READ(10)/READ(12) command */
+uint32_t volatile g_u32ReadStallCnt = 0;        /* Times bulk IN waited for the media */
+uint32_t volatile g_u32ReadStallMs = 0;         /* Total waiting time in USB frames */
+
 /* CBW/CSW variables */
 struct CBW g_sCBW;
 struct CSW g_sCSW;
 
 uint32_t MassBlock[MASS_BUFFER_SIZE / 4];
-uint32_t Storage_Block[STORAGE_BUFFER_SIZE / 4];
+uint32_t Storage_Block[STORAGE_BUFFER_SIZE / 4 * STORAGE_BUFFER_NUM];
 
 /*--------------------------------------------------------------------------*/
 uint8_t g_au8InquiryID[36] =
@@ -256,15 +281,37 @@ void EP3_Handler(void)
     }
     else
     {
-        g_u8EP3Ready = 1;
         g_u32OutToggle = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
         g_u32OutSkip = 0;
 
         g_u32CbwStall   = 0;
+
+        /* Data packets are drained right here. CBW is parsed by MSC_ProcessCmd() in main loop. */
+        if(g_u8BulkState == BULK_OUT)
+            MSC_Write();
+        else
+            g_u8EP3Ready = 1;
     }
 }
 
 
+static void MSC_FillPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the next bulk IN packet from storage buffer to USB SRAM */
+    USBD_MemCopy(pu8Buf, (uint8_t *)g_u32Address, u32Size);
+    g_u32Address += u32Size;
+}
+
+static void MSC_DrainPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the received bulk OUT packet from USB SRAM to storage buffer */
+    if(u32Size > g_u32Length)
+        u32Size = g_u32Length;
+
+    USBD_MemCopy((uint8_t *)g_u32Address, pu8Buf, u32Size);
+    g_u32Address += u32Size;
+}
+
 void MSC_Init(void)
 {
     /* Init setup packet buffer */
@@ -299,6 +346,7 @@ void MSC_Init(void)
     /*****************************************************/
     g_u32BulkBuf0 = EP3_BUF_BASE;
     g_u32BulkBuf1 = EP2_BUF_BASE;
+    USBD_BulkPPInit(&g_sBulkPP, EP2, EP3, g_u32BulkBuf0, g_u32BulkBuf1, EP3_MAX_PKT_SIZE, MSC_FillPacket, MSC_DrainPacket);
 
     g_sCSW.dCSWSignature = CSW_SIGNATURE;
     g_TotalSectors = GetLogicSector();
@@ -360,6 +408,8 @@ void MSC_ClassRequest(void)
                     USBD_SET_PAYLOAD_LEN(EP0, 0);
 
                     g_u32Length = 0; // Reset all read/write data transfer
+                    g_u8MediaAck = 0; /* Queued writes are still done, but no CSW is returned */
+                    g_u8OutHeld = 0;
                     USBD_LockEpStall(0);
 
                     /* Clear ready */
@@ -475,13 +525,8 @@ void MSC_Read(void)
 {
     uint32_t u32Len;
 
-    if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
-    else
-        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-
-    /* Trigger to send out the data packet */
-    USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
+    /* Trigger to send out the data packet prepared in the idle buffer */
+    USBD_BulkPPTrigIn(&g_sBulkPP);
 
     g_u32Length -= g_u8Size;
     g_u32BytesInStorageBuf -= g_u8Size;
@@ -495,11 +540,7 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
         else
         {
@@ -517,74 +558,111 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
     }
 }
 
-void MSC_ReadTrig(void)
+static uint32_t MSC_ReadAheadSwap(void)
 {
-    uint32_t u32Len;
+    if(g_u8ReadAheadState != RA_READY)
+        return 0;
 
-    if(g_u32Length)
-    {
-        if(g_u32BytesInStorageBuf)
-        {
-            /* Prepare next data packet */
-            g_u8Size = EP2_MAX_PKT_SIZE;
-            if(g_u8Size > g_u32Length)
-                g_u8Size = g_u32Length;
+    /* Stream the fetched chunk and fetch the following one into the drained buffer */
+    g_u8StorageIdx ^= 1;
+    g_u32Address = STORAGE_BUF(g_u8StorageIdx);
+    g_u32BytesInStorageBuf = g_u32ReadAheadSize;
+    g_u8ReadAheadState = (g_u32ReadAheadLen) ? RA_BUSY : RA_IDLE;
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
-        }
-        else
-        {
-            u32Len = g_u32Length;
-            if(u32Len > STORAGE_BUFFER_SIZE)
-                u32Len = STORAGE_BUFFER_SIZE;
+    return 1;
+}
 
-            MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_DATA_BUF);
-            g_u32BytesInStorageBuf = u32Len;
-            g_u32LbaAddress += u32Len / UDC_SECTOR_SIZE;
-            g_u32Address = STORAGE_DATA_BUF;
+static void MSC_ReadPrepare(void)
+{
+    /* Prepare next data packet while the current one is on the bus */
+    g_u8Size = EP2_MAX_PKT_SIZE;
+    if(g_u8Size > g_u32Length)
+        g_u8Size = g_u32Length;
 
-            /* Prepare next data packet */
-            g_u8Size = EP2_MAX_PKT_SIZE;
-            if(g_u8Size > g_u32Length)
-                g_u8Size = g_u32Length;
+    USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
+    g_u8InPrepared = 1;
+}
 
-            if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+void MSC_ReadTrig(void)
+{
+    if(g_u32Length)
+    {
+        if(!g_u8InPrepared)
+        {
+            /* Media is still being read. MSC_ReadAhead() sends the packet when it is ready. */
+            g_u8InIdle = 1;
+            return;
         }
 
-        /* DATA0/DATA1 Toggle */
-        if(USBD_GET_EP_BUF_ADDR(EP2) == g_u32BulkBuf1)
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
-        else
-            USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
+        g_u8InIdle = 0;
+        g_u8InPrepared = 0;
 
-        /* Trigger to send out the data packet */
-        USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
+        /* Trigger to send out the data packet prepared in the idle buffer */
+        USBD_BulkPPTrigIn(&g_sBulkPP);
 
         g_u32Length -= g_u8Size;
         g_u32BytesInStorageBuf -= g_u8Size;
 
+        if(g_u32Length)
+        {
+            if((g_u32BytesInStorageBuf == 0) && !MSC_ReadAheadSwap())
+            {
+                /* Read-ahead is late. Bulk IN is NAKed until it is done. */
+                g_u8ReadStall = 1;
+                g_u32StallFrame = USBD->FN;
+                g_u32ReadStallCnt++;
+                return;
+            }
+
+            MSC_ReadPrepare();
+        }
     }
     else
         USBD_SET_PAYLOAD_LEN(EP2, 0);
 }
 
+void MSC_ReadAhead(void)
+{
+    uint32_t u32Len;
+
+    if(g_u8ReadAheadState != RA_BUSY)
+        return;
+
+    /* Fetch the next chunk into the storage buffer not streaming to host */
+    u32Len = g_u32ReadAheadLen;
+    if(u32Len > STORAGE_BUFFER_SIZE)
+        u32Len = STORAGE_BUFFER_SIZE;
+
+    MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_BUF(g_u8StorageIdx ^ 1));
+
+    NVIC_DisableIRQ(USBD_IRQn);
+
+    g_u32LbaAddress += u32Len / UDC_SECTOR_SIZE;
+    g_u32ReadAheadLen -= u32Len;
+    g_u32ReadAheadSize = u32Len;
+    g_u8ReadAheadState = RA_READY;
+
+    /* Resume bulk IN if it is waiting for this chunk */
+    if(g_u8ReadStall && (g_u8BulkState == BULK_IN))
+    {
+        g_u8ReadStall = 0;
+        g_u32ReadStallMs += (USBD->FN - g_u32StallFrame) & USBD_FN_FN_Msk;
+
+        MSC_ReadAheadSwap();
+        MSC_ReadPrepare();
+
+        if(g_u8InIdle)
+            MSC_ReadTrig();
+    }
+
+    NVIC_EnableIRQ(USBD_IRQn);
+}
+
 
 void MSC_ReadCapacity(void)
 {
@@ -697,62 +775,68 @@ void MSC_ModeSense10(void)
     }
 }
 
+static void MSC_WriteSubmit(void)
+{
+    uint32_t u32Idx = g_u8StorageIdx;
+
+    /* Queue the filled storage buffer. MSC_MediaTask() writes it to media in main loop. */
+    g_au32MediaAddr[u32Idx] = g_u32DataFlashStartAddr;
+    g_au32MediaLen[u32Idx] = g_u32Address - STORAGE_BUF(u32Idx);
+    g_u32DataFlashStartAddr += g_au32MediaLen[u32Idx] / UDC_SECTOR_SIZE;
+
+    if(g_u8MediaPend == 0)
+        g_u8MediaHead = u32Idx;
+    g_u8MediaPend |= (1 << u32Idx);
+
+    /* Collect the following packets in the other buffer if it is free */
+    if(!(g_u8MediaPend & (1 << (u32Idx ^ 1))))
+    {
+        g_u8StorageIdx ^= 1;
+        g_u32Address = STORAGE_BUF(g_u8StorageIdx);
+    }
+}
+
 void MSC_Write(void)
 {
-    uint32_t lba, len;
+    uint32_t u32IsWrite, u32Full, u32Rearm;
 
     if(g_u32OutSkip == 0)
     {
+        u32IsWrite = (g_sCBW.u8OPCode == UFI_WRITE_10) || (g_sCBW.u8OPCode == UFI_WRITE_12);
+
         if(g_u32Length > EP3_MAX_PKT_SIZE)
         {
-            if(USBD_GET_EP_BUF_ADDR(EP3) == g_u32BulkBuf0)
-            {
-                USBD_SET_EP_BUF_ADDR(EP3, g_u32BulkBuf1);
-                USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), EP3_MAX_PKT_SIZE);
-            }
-            else
-            {
-                USBD_SET_EP_BUF_ADDR(EP3, g_u32BulkBuf0);
-                USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), EP3_MAX_PKT_SIZE);
-            }
+            /* Hold bulk OUT if this packet fills the storage buffer while the other one is still being written */
+            u32Full = u32IsWrite && (g_u32Address + EP3_MAX_PKT_SIZE >= STORAGE_BUF(g_u8StorageIdx) + STORAGE_BUFFER_SIZE);
+            u32Rearm = !(u32Full && (g_u8MediaPend & (1 << (g_u8StorageIdx ^ 1))));
 
-            g_u32Address += EP3_MAX_PKT_SIZE;
+            /* Arm the other buffer for the next packet, then drain this one */
+            USBD_BulkPPRecvOut(&g_sBulkPP, u32Rearm);
             g_u32Length -= EP3_MAX_PKT_SIZE;
 
-            /* Buffer full. Writer it to storage first. */
-            if(g_u32Address >= (STORAGE_DATA_BUF + STORAGE_BUFFER_SIZE))
+            /* Buffer full. Write it to storage in background. */
+            if(u32Full)
             {
-                //DataFlashWrite(g_u32DataFlashStartAddr, STORAGE_BUFFER_SIZE, (uint32_t)STORAGE_DATA_BUF);
-                MSC_WriteMedia(g_u32DataFlashStartAddr, STORAGE_BUFFER_SIZE, (uint8_t *)STORAGE_DATA_BUF);
-                g_u32Address = STORAGE_DATA_BUF;
-                //g_u32DataFlashStartAddr += STORAGE_BUFFER_SIZE;
-                g_u32DataFlashStartAddr += STORAGE_BUFFER_SIZE / UDC_SECTOR_SIZE;
+                MSC_WriteSubmit();
+
+                if(!u32Rearm)
+                    g_u8OutHeld = 1;
             }
         }
         else
         {
-            if(USBD_GET_EP_BUF_ADDR(EP3) == g_u32BulkBuf0)
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), g_u32Length);
-            else
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), g_u32Length);
-            g_u32Address += g_u32Length;
+            /* Last packet. Bulk OUT stays idle until the CSW is sent */
+            USBD_BulkPPRecvOut(&g_sBulkPP, 0);
             g_u32Length = 0;
 
+            if(u32IsWrite && (g_u32Address != STORAGE_BUF(g_u8StorageIdx)))
+                MSC_WriteSubmit();
 
-            if((g_sCBW.u8OPCode == UFI_WRITE_10) || (g_sCBW.u8OPCode == UFI_WRITE_12))
+            /* Return the CSW once all data is written to media */
+            if(g_u8MediaPend)
             {
-                lba = get_be32(&g_sCBW.au8Data[0]);
-                len = g_sCBW.dCBWDataTransferLength;
-
-                //len = lba * UDC_SECTOR_SIZE + g_sCBW.dCBWDataTransferLength - g_u32DataFlashStartAddr;
-                len = (lba - g_u32DataFlashStartAddr) * UDC_SECTOR_SIZE + g_sCBW.dCBWDataTransferLength;
-                if(len)
-                {
-                    //DataFlashWrite(g_u32DataFlashStartAddr , len, (uint32_t)STORAGE_DATA_BUF);
-                    MSC_WriteMedia(g_u32DataFlashStartAddr, len, (uint8_t *)STORAGE_DATA_BUF);
-                }
+                g_u8MediaAck = 1;
+                return;
             }
 
             g_u8BulkState = BULK_IN;
@@ -761,13 +845,53 @@ void MSC_Write(void)
     }
 }
 
+void MSC_MediaTask(void)
+{
+    uint32_t u32Idx;
+
+    if(g_u8MediaPend == 0)
+        return;
+
+    /* Write the oldest queued storage buffer. Bulk OUT keeps filling the other one meanwhile. */
+    u32Idx = g_u8MediaHead;
+    MSC_WriteMedia(g_au32MediaAddr[u32Idx], g_au32MediaLen[u32Idx], (uint8_t *)STORAGE_BUF(u32Idx));
+
+    NVIC_DisableIRQ(USBD_IRQn);
+
+    g_u8MediaPend &= ~(1 << u32Idx);
+    g_u8MediaHead = u32Idx ^ 1;
+
+    /* Resume bulk OUT if it is waiting for this buffer */
+    if(g_u8OutHeld)
+    {
+        g_u8OutHeld = 0;
+        g_u8StorageIdx = u32Idx;
+        g_u32Address = STORAGE_BUF(u32Idx);
+        USBD_BulkPPArmOut(&g_sBulkPP);
+    }
+
+    /* Deferred CSW of the write command */
+    if(g_u8MediaAck && (g_u8MediaPend == 0))
+    {
+        g_u8MediaAck = 0;
+        g_u8BulkState = BULK_IN;
+        MSC_AckCmd();
+    }
+
+    NVIC_EnableIRQ(USBD_IRQn);
+}
+
 void MSC_ProcessCmd(void)
 {
     uint8_t u8Len;
     int32_t i;
     uint32_t Hcount, Dcount;
 
-    if(g_u8EP3Ready)
+    MSC_ReadAhead();
+    MSC_MediaTask();
+
+    /* Queued writes of an aborted command must be done before the next command */
+    if(g_u8EP3Ready && (g_u8MediaPend == 0))
     {
         g_u8EP3Ready = 0;
 
@@ -916,11 +1040,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
 
@@ -945,11 +1067,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
 
@@ -964,8 +1084,8 @@ void MSC_ProcessCmd(void)
 
                     if(g_u32Length > 0)
                     {
-                        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
                         g_u8BulkState = BULK_OUT;
+                        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
                     }
 
                     else
@@ -1010,12 +1130,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
-
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
 
@@ -1104,6 +1221,7 @@ void MSC_ProcessCmd(void)
                     g_u32LbaAddress = g_u32Address;
                     g_u32Length = g_sCBW.dCBWDataTransferLength;
                     g_u32BytesInStorageBuf = g_u32Length;
+                    g_u8ReadErr = 0;
 
                     i = g_u32Length;
 
@@ -1116,6 +1234,16 @@ void MSC_ProcessCmd(void)
 
                     g_u32Address = STORAGE_DATA_BUF;
 
+                    /* Fetch the next chunk into the other storage buffer while this one streams out */
+                    g_u8StorageIdx = 0;
+                    g_u32ReadAheadLen = g_u32Length - i;
+                    g_u8ReadAheadState = (g_u32ReadAheadLen) ? RA_BUSY : RA_IDLE;
+                    g_u8InPrepared = 0;
+                    g_u8InIdle = 0;
+                    g_u8ReadStall = 0;
+                    g_u32ReadStallCnt = 0;
+                    g_u32ReadStallMs = 0;
+
                     /* Indicate the next packet should be Bulk IN Data packet */
                     g_u8BulkState = BULK_IN;
 
@@ -1127,17 +1255,13 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32BytesInStorageBuf;
 
-                        /* Prepare the first data packet (DATA1) */
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-                        g_u32Address += g_u8Size;
-
-                        /* kick - start */
-                        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf1);
-                        /* Trigger to send out the data packet */
-                        USBD_SET_PAYLOAD_LEN(EP2, g_u8Size);
-                        g_u32Length -= g_u8Size;
-                        g_u32BytesInStorageBuf -= g_u8Size;
+                        /* Prepare the first data packet (DATA1) in the idle buffer */
+                        USBD_SET_EP_BUF_ADDR(EP2, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
+                        g_u8InPrepared = 1;
+
+                        /* kick - start. The next packet is prepared in the other buffer while this one is on the bus */
+                        MSC_ReadTrig();
                     }
 
                     return;
@@ -1178,7 +1302,9 @@ void MSC_ProcessCmd(void)
                             }
 
                             g_u32Length = g_sCBW.dCBWDataTransferLength;
-                            g_u32Address = STORAGE_DATA_BUF;
+                            g_u8StorageIdx = 0;
+                            g_u32Address = STORAGE_BUF(0);
+                            g_u8WriteErr = 0;
                             //g_u32DataFlashStartAddr = get_be32(&g_sCBW.au8Data[0]) * UDC_SECTOR_SIZE;
                             g_u32DataFlashStartAddr = get_be32(&g_sCBW.au8Data[0]);
                         }
@@ -1196,8 +1322,9 @@ void MSC_ProcessCmd(void)
 
                     if((g_u32Length > 0))
                     {
-                        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+                        /* Data packets are drained in EP3_Handler() from now on */
                         g_u8BulkState = BULK_OUT;
+                        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
                     }
 
                     return;
@@ -1243,20 +1370,6 @@ void MSC_ProcessCmd(void)
                 }
             }
         }
-        else if(g_u8BulkState == BULK_OUT)
-        {
-            switch(g_sCBW.u8OPCode)
-            {
-                case UFI_WRITE_12:
-                case UFI_WRITE_10:
-                case UFI_MODE_SELECT_6:
-                case UFI_MODE_SELECT_10:
-                {
-                    MSC_Write();
-                    return;
-                }
-            }
-        }
     }
 }
 
@@ -1306,6 +1419,15 @@ void MSC_AckCmd(void)
                     MSC_ReadTrig();
                     return;
                 }
+
+                if(g_u8ReadErr)
+                {
+                    g_u8ReadErr = 0;
+                    g_sCSW.bCSWStatus = 1;
+                    g_au8SenseKey[0] = 0x03;    /* Medium error */
+                    g_au8SenseKey[1] = 0x11;    /* Unrecovered read error */
+                    g_au8SenseKey[2] = 0x00;
+                }
                 break;
             }
             case UFI_REQUEST_SENSE:
@@ -1343,6 +1465,15 @@ void MSC_AckCmd(void)
 
                 g_sCSW.dCSWDataResidue = tmp;
                 g_sCSW.bCSWStatus = 0;
+
+                if(g_u8WriteErr)
+                {
+                    g_u8WriteErr = 0;
+                    g_sCSW.bCSWStatus = 1;
+                    g_au8SenseKey[0] = 0x03;    /* Medium error */
+                    g_au8SenseKey[1] = 0x0C;    /* Write error */
+                    g_au8SenseKey[2] = 0x00;
+                }
                 break;
             }
             case UFI_TEST_UNIT_READY:
@@ -1393,12 +1524,16 @@ void MSC_AckCmd(void)
 
 void MSC_ReadMedia(uint32_t addr, uint32_t size, uint8_t *buffer)
 {
-    SpiRead(addr, size, buffer);
+    /* The data is still sent. The command fails in its CSW. */
+    if(!SpiRead(addr, size, buffer))
+        g_u8ReadErr = 1;
 }
 
 void MSC_WriteMedia(uint32_t addr, uint32_t size, uint8_t *buffer)
 {
-    SpiWrite(addr, size, buffer);
+    /* The command fails in its CSW */
+    if(!SpiWrite(addr, size, buffer))
+        g_u8WriteErr = 1;
 }
 
 void MSC_SetConfig(void)
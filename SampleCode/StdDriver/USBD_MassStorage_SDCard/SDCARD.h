@@ -38,6 +38,15 @@ extern "C"
 
 #define PHYSICAL_BLOCK_SIZE 512    /*!< 512 Erase group size = 16 MMC FLASH sectors */
 
+#define SD_USE_PDMA     1          /*!< 1: Move the data phase of block transfers with PDMA. 0: CPU byte loop */
+#define SD_PDMA_TX_CH   0          /*!< PDMA channel for SPI TX */
+#define SD_PDMA_RX_CH   1          /*!< PDMA channel for SPI RX */
+
+#define SD_CRC_TABLE_BYTE   1      /*!< 1: 256-entry CRC tables. 0: 16-entry nibble tables for smaller code size */
+#define SD_CRC_HW           1      /*!< 1: Calculate data CRC16 with the CRC controller */
+#define SD_DATA_CRC_CHECK   1      /*!< 1: Turn on card CRC checking and verify the CRC16 of read data blocks */
+#define SD_CRC_RETRY        3      /*!< Retry count of a read with CRC error */
+
 // Command table value definitions
 // Used in the MMC_Command_Exec function to
 // decode and execute MMC command requests
@@ -49,6 +58,8 @@ extern "C"
 #define     WR    2     /*!< Command value definitions: WR */
 #define     RDB   3     /*!< Command value definitions: RDB */
 #define     WDB   4     /*!< Command value definitions: WDB */
+#define     RDM   5     /*!< Command value definitions: RDM. Multi-block read, data blocks follow with CS kept low */
+#define     WRM   6     /*!< Command value definitions: WRM. Multi-block write, data blocks follow with CS kept low */
 #define     R1    0     /*!< Command value definitions: R1 */
 #define     R1b   1     /*!< Command value definitions: R1b */
 #define     R2    2     /*!< Command value definitions: R2 */
@@ -152,9 +163,10 @@ void SDCARD_Close(void);
 uint32_t SDCARD_GetVersion(void);
 uint32_t MMC_Command_Exec(uint8_t cmd_loc, uint32_t argument, uint8_t *pchar, uint32_t* response);
 uint32_t GetLogicSector(void);
+extern uint32_t g_u32SdCrcErrCnt;
 uint32_t SDCARD_GetCardSize(uint32_t* pu32TotSecCnt);
-void SpiRead(uint32_t addr, uint32_t size, uint8_t* buffer);
-void SpiWrite(uint32_t addr, uint32_t size, uint8_t* buffer);
+uint32_t SpiRead(uint32_t addr, uint32_t size, uint8_t* buffer);
+uint32_t SpiWrite(uint32_t addr, uint32_t size, uint8_t* buffer);
 
 /*@}*/ /* end of group NUC1261_SDCARD_EXPORTED_FUNCTIONS */
 
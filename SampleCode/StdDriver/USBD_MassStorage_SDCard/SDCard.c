@@ -30,6 +30,7 @@ static SPI_T    *g_pSPI = SPI1;
 /// @cond HIDDEN_SYMBOLS
 int8_t Is_Initialized = 0, SDtype = 0;
 uint32_t LogicSector = 0;
+uint32_t g_u32SdCrcErrCnt = 0;  /* Count of data blocks read with CRC error */
 
 // Command table for MMC.  This table contains all commands available in SPI
 // mode;  Format of command entries is described above in command structure
@@ -45,10 +46,10 @@ COMMAND __I command_list[] =
     {13, NO , 0xFF, CMD, R2 , NO }, // CMD13; SEND_STATUS: read card status;
     {16, YES, 0xFF, CMD, R1 , NO }, // CMD16; SET_BLOCKLEN: set block size;
     {17, YES, 0xFF, RDB , R1 , NO }, // CMD17; READ_SINGLE_BLOCK: read 1 block;
-    {18, YES, 0xFF, RD , R1 , YES}, // CMD18; READ_MULTIPLE_BLOCK: read > 1;
+    {18, YES, 0xFF, RDM, R1 , YES}, // CMD18; READ_MULTIPLE_BLOCK: read > 1;
     {23, NO , 0xFF, CMD, R1 , NO }, // CMD23; SET_BLOCK_COUNT
     {24, YES, 0xFF, WR , R1 , NO }, // CMD24; WRITE_BLOCK: write 1 block;
-    {25, YES, 0xFF, WR , R1 , YES}, // CMD25; WRITE_MULTIPLE_BLOCK: write > 1;
+    {25, YES, 0xFF, WRM, R1 , YES}, // CMD25; WRITE_MULTIPLE_BLOCK: write > 1;
     {27, NO , 0xFF, CMD, R1 , NO }, // CMD27; PROGRAM_CSD: program CSD;
     {28, YES, 0xFF, CMD, R1b, NO }, // CMD28; SET_WRITE_PROT: set wp for group;
     {29, YES, 0xFF, CMD, R1b, NO }, // CMD29; CLR_WRITE_PROT: clear group wp;
@@ -98,27 +99,128 @@ void SD_Delay(uint32_t count)
 
 */
 
+#if SD_CRC_TABLE_BYTE
+/* CRC7 (x^7 + x^3 + 1) of one byte. The CRC is kept in bit 7~1. */
+static const uint8_t s_au8Crc7Table[256] =
+{
+    0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE,
+    0x32, 0x20, 0x16, 0x04, 0x7A, 0x68, 0x5E, 0x4C, 0xA2, 0xB0, 0x86, 0x94, 0xEA, 0xF8, 0xCE, 0xDC,
+    0x64, 0x76, 0x40, 0x52, 0x2C, 0x3E, 0x08, 0x1A, 0xF4, 0xE6, 0xD0, 0xC2, 0xBC, 0xAE, 0x98, 0x8A,
+    0x56, 0x44, 0x72, 0x60, 0x1E, 0x0C, 0x3A, 0x28, 0xC6, 0xD4, 0xE2, 0xF0, 0x8E, 0x9C, 0xAA, 0xB8,
+    0xC8, 0xDA, 0xEC, 0xFE, 0x80, 0x92, 0xA4, 0xB6, 0x58, 0x4A, 0x7C, 0x6E, 0x10, 0x02, 0x34, 0x26,
+    0xFA, 0xE8, 0xDE, 0xCC, 0xB2, 0xA0, 0x96, 0x84, 0x6A, 0x78, 0x4E, 0x5C, 0x22, 0x30, 0x06, 0x14,
+    0xAC, 0xBE, 0x88, 0x9A, 0xE4, 0xF6, 0xC0, 0xD2, 0x3C, 0x2E, 0x18, 0x0A, 0x74, 0x66, 0x50, 0x42,
+    0x9E, 0x8C, 0xBA, 0xA8, 0xD6, 0xC4, 0xF2, 0xE0, 0x0E, 0x1C, 0x2A, 0x38, 0x46, 0x54, 0x62, 0x70,
+    0x82, 0x90, 0xA6, 0xB4, 0xCA, 0xD8, 0xEE, 0xFC, 0x12, 0x00, 0x36, 0x24, 0x5A, 0x48, 0x7E, 0x6C,
+    0xB0, 0xA2, 0x94, 0x86, 0xF8, 0xEA, 0xDC, 0xCE, 0x20, 0x32, 0x04, 0x16, 0x68, 0x7A, 0x4C, 0x5E,
+    0xE6, 0xF4, 0xC2, 0xD0, 0xAE, 0xBC, 0x8A, 0x98, 0x76, 0x64, 0x52, 0x40, 0x3E, 0x2C, 0x1A, 0x08,
+    0xD4, 0xC6, 0xF0, 0xE2, 0x9C, 0x8E, 0xB8, 0xAA, 0x44, 0x56, 0x60, 0x72, 0x0C, 0x1E, 0x28, 0x3A,
+    0x4A, 0x58, 0x6E, 0x7C, 0x02, 0x10, 0x26, 0x34, 0xDA, 0xC8, 0xFE, 0xEC, 0x92, 0x80, 0xB6, 0xA4,
+    0x78, 0x6A, 0x5C, 0x4E, 0x30, 0x22, 0x14, 0x06, 0xE8, 0xFA, 0xCC, 0xDE, 0xA0, 0xB2, 0x84, 0x96,
+    0x2E, 0x3C, 0x0A, 0x18, 0x66, 0x74, 0x42, 0x50, 0xBE, 0xAC, 0x9A, 0x88, 0xF6, 0xE4, 0xD2, 0xC0,
+    0x1C, 0x0E, 0x38, 0x2A, 0x54, 0x46, 0x70, 0x62, 0x8C, 0x9E, 0xA8, 0xBA, 0xC4, 0xD6, 0xE0, 0xF2
+};
+
+/* CRC16-CCITT (x^16 + x^12 + x^5 + 1) of one byte */
+static const uint16_t s_au16Crc16Table[256] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+#else
+/* CRC7 (x^7 + x^3 + 1) of one nibble. The CRC is kept in bit 7~1. */
+static const uint8_t s_au8Crc7Table[16] =
+{
+    0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE
+};
+
+/* CRC16-CCITT (x^16 + x^12 + x^5 + 1) of one nibble */
+static const uint16_t s_au16Crc16Table[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+#endif
+
 /**
-  * @brief This function is used to generate CRC value
-  * @param[in] u32Data Input Data
-  * @param[in] u32GenPoly CRC7:0x1200, CRC16:0x1021
-  * @param[in] u32Accum CRC value
-  * @return CRC value
+  * @brief This function is used to generate CRC7 of a command
+  * @param[in] pu8Buf Command index and argument
+  * @param[in] u32Len Data length (byte)
+  * @return CRC7 in bit 7~1 and end bit in bit 0
   */
-static uint32_t GenerateCRC(uint32_t u32Data, uint32_t u32GenPoly, uint32_t u32Accum)
+static uint32_t SD_Crc7(uint8_t *pu8Buf, uint32_t u32Len)
 {
-    volatile uint8_t i;
+    uint32_t u32Crc = 0;
 
-    u32Data <<= 8;
-    for(i = 8; i > 0; i--)
+    while(u32Len--)
     {
-        if((u32Data ^ u32Accum) & 0x8000)
-            u32Accum = (u32Accum << 1) ^ u32GenPoly;
-        else
-            u32Accum <<= 1;
-        u32Data <<= 1;
+#if SD_CRC_TABLE_BYTE
+        u32Crc = s_au8Crc7Table[u32Crc ^ *pu8Buf++];
+#else
+        u32Crc = ((u32Crc << 4) & 0xFF) ^ s_au8Crc7Table[(u32Crc ^ *pu8Buf) >> 4];
+        u32Crc = ((u32Crc << 4) & 0xFF) ^ s_au8Crc7Table[(u32Crc >> 4) ^ (*pu8Buf++ & 0xF)];
+#endif
     }
-    return u32Accum;
+    return u32Crc | 0x01;
+}
+
+/**
+  * @brief This function is used to generate CRC16 of a data block
+  * @param[in] pu8Buf Data buffer
+  * @param[in] u32Len Data length (byte)
+  * @return CRC16 value
+  */
+static uint32_t SD_Crc16(uint8_t *pu8Buf, uint32_t u32Len)
+{
+#if SD_CRC_HW
+    CRC_Open(CRC_CCITT, 0, 0, CRC_CPU_WDATA_8);
+    while(u32Len--)
+        CRC_WRITE_DATA(*pu8Buf++);
+    return CRC_GetChecksum();
+#else
+    uint32_t u32Crc = 0;
+
+    while(u32Len--)
+    {
+#if SD_CRC_TABLE_BYTE
+        u32Crc = ((u32Crc << 8) & 0xFFFF) ^ s_au16Crc16Table[(u32Crc >> 8) ^ *pu8Buf++];
+#else
+        u32Crc = ((u32Crc << 4) & 0xFFFF) ^ s_au16Crc16Table[(u32Crc >> 12) ^ (*pu8Buf >> 4)];
+        u32Crc = ((u32Crc << 4) & 0xFFFF) ^ s_au16Crc16Table[(u32Crc >> 12) ^ (*pu8Buf++ & 0xF)];
+#endif
+    }
+    return u32Crc;
+#endif
 }
 
 /**
@@ -134,6 +236,69 @@ static uint32_t SingleWrite(uint32_t u32Data)
     return SPI_READ_RX(g_pSPI);
 }
 
+/**
+  * @brief This function is used to start the data phase of a block transfer
+  * @param[in] pu8Tx Data to send. NULL to send 0xFF
+  * @param[out] pu8Rx Buffer to receive data. NULL to drop received data
+  * @param[in] u32Len Data length (byte)
+  * @return none
+  * @details With PDMA the transfer runs in background. Call SD_DataWait() before accessing SPI again.
+  */
+static void SD_DataStart(uint8_t *pu8Tx, uint8_t *pu8Rx, uint32_t u32Len)
+{
+#if SD_USE_PDMA
+    static const uint8_t s_u8TxFill = 0xFF;    /* Sent when there is no data to send */
+    static uint8_t s_u8RxSink;                  /* Takes the received data to drop */
+
+    while(SPI_IS_BUSY(g_pSPI));
+    SPI_ClearRxFIFO(g_pSPI);
+
+    /* SPI RX to buffer */
+    PDMA_SetTransferCnt(SD_PDMA_RX_CH, PDMA_WIDTH_8, u32Len);
+    if(pu8Rx)
+        PDMA_SetTransferAddr(SD_PDMA_RX_CH, (uint32_t)&g_pSPI->RX, PDMA_SAR_FIX, (uint32_t)pu8Rx, PDMA_DAR_INC);
+    else
+        PDMA_SetTransferAddr(SD_PDMA_RX_CH, (uint32_t)&g_pSPI->RX, PDMA_SAR_FIX, (uint32_t)&s_u8RxSink, PDMA_DAR_FIX);
+    PDMA_SetTransferMode(SD_PDMA_RX_CH, PDMA_SPI1_RX, FALSE, 0);
+
+    /* Buffer, or dummy 0xFF, to SPI TX */
+    PDMA_SetTransferCnt(SD_PDMA_TX_CH, PDMA_WIDTH_8, u32Len);
+    if(pu8Tx)
+        PDMA_SetTransferAddr(SD_PDMA_TX_CH, (uint32_t)pu8Tx, PDMA_SAR_INC, (uint32_t)&g_pSPI->TX, PDMA_DAR_FIX);
+    else
+        PDMA_SetTransferAddr(SD_PDMA_TX_CH, (uint32_t)&s_u8TxFill, PDMA_SAR_FIX, (uint32_t)&g_pSPI->TX, PDMA_DAR_FIX);
+    PDMA_SetTransferMode(SD_PDMA_TX_CH, PDMA_SPI1_TX, FALSE, 0);
+
+    SPI_TRIGGER_TX_RX_PDMA(g_pSPI);
+#else
+    uint32_t i;
+    uint8_t u8Data;
+
+    for(i = 0; i < u32Len; i++)
+    {
+        SPI_WRITE_TX(g_pSPI, (pu8Tx) ? pu8Tx[i] : 0xFF);
+        while(SPI_IS_BUSY(g_pSPI));
+        u8Data = SPI_READ_RX(g_pSPI);
+        if(pu8Rx)
+            pu8Rx[i] = u8Data;
+    }
+#endif
+}
+
+/**
+  * @brief This function is used to wait for the data phase started by SD_DataStart()
+  * @return none
+  */
+static void SD_DataWait(void)
+{
+#if SD_USE_PDMA
+    /* The RX channel finishes last */
+    while((PDMA_GET_TD_STS() & (1 << SD_PDMA_RX_CH)) == 0);
+    PDMA_CLR_TD_FLAG((1 << SD_PDMA_TX_CH) | (1 << SD_PDMA_RX_CH));
+    SPI_DISABLE_TX_RX_PDMA(g_pSPI);
+#endif
+}
+
 /**
   * @brief This function is used to Send SDCARD CMD and Receive Response
   * @param[in] nCmd Set command register
@@ -154,6 +319,7 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
     UINT16 card_response;                       // Variable for storing card response;
     uint8_t data_resp;                      // Variable for storing data response;
     UINT16 dummy_CRC;                       // Dummy variable for storing CRC field;
+    uint8_t cmd_buf[5];                     // Command bytes for CRC7;
 
     card_response.i = 0;
 
@@ -199,28 +365,19 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
     // If an argument is required, transmit
     // one, otherwise transmit 4 bytes of
     // 0x00;
-    if(current_command.arg_required == YES)
+    // A valid CRC7 is always sent, so the
+    // card can have CRC checking on;
+    if(current_command.arg_required == NO)
     {
-        dummy_CRC.i = GenerateCRC((current_command.command_byte | 0x40), 0x1200, 0);
-        for(counter = 3; counter >= 0; counter--)
-        {
-            SingleWrite(long_arg.b[counter]);
-            dummy_CRC.i = GenerateCRC(long_arg.b[counter], 0x1200, dummy_CRC.i);
-
-        }
-        dummy_CRC.i = (dummy_CRC.i >> 8) | 0x01;
-        SingleWrite(dummy_CRC.b[0]);
+        long_arg.l = 0;
     }
-    else
+    cmd_buf[0] = (current_command.command_byte | 0x40) & 0x7f;
+    for(counter = 3; counter >= 0; counter--)
     {
-        counter = 0;
-        while(counter <= 3)
-        {
-            SingleWrite(0x00);
-            counter++;
-        }
-        SingleWrite(/*current_command.CRC*/current_command.CRC_SD);
+        cmd_buf[4 - counter] = long_arg.b[counter];
+        SingleWrite(long_arg.b[counter]);
     }
+    SingleWrite(SD_Crc7(cmd_buf, 5));
 
     // The command table entry will indicate
     // what type of response to expect for
@@ -340,29 +497,18 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
                 }
                 SD_Delay(119);
             }
-            counter = 0;                    // Reset byte counter;
             // Read <current_blklen> bytes;
-            if(pchar)
-            {
-                for(counter = 0; counter < current_blklen; counter++)
-                {
-                    SPI_WRITE_TX(g_pSPI, 0xFF);
-                    while(SPI_IS_BUSY(g_pSPI));
-                    *(pchar + counter) = SPI_READ_RX(g_pSPI);
-                }
-            }
-            else
+            SD_DataStart(NULL, pchar, current_blklen);
+            SD_DataWait();
+            dummy_CRC.b[1] = SingleWrite(0xFF); // After all data is read, read the two
+            dummy_CRC.b[0] = SingleWrite(0xFF); // CRC bytes;
+#if SD_DATA_CRC_CHECK
+            if(pchar && (SD_Crc16(pchar, current_blklen) != dummy_CRC.i))
             {
-                for(; counter < current_blklen; counter++)
-                {
-                    SPI_WRITE_TX(g_pSPI, 0xFF);
-                    while(SPI_IS_BUSY(g_pSPI));
-                }
+                g_u32SdCrcErrCnt++;
+                BACK_FROM_ERROR;
             }
-            dummy_CRC.b[1] = SingleWrite(0xFF); // After all data is read, read the two
-            dummy_CRC.b[0] = SingleWrite(0xFF); // CRC bytes;  These bytes are not used
-            // in this mode, but the place holders
-            // must be read anyway;
+#endif
             break;
         case RD:                         // Read data from the MMC;
             loopguard = 0;
@@ -374,25 +520,9 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
                     BACK_FROM_ERROR;
                 }
             }
-            counter = 0;                    // Reset byte counter;
             // Read <current_blklen> bytes;
-            if(pchar)
-            {
-                for(counter = 0; counter < current_blklen; counter++)
-                {
-                    SPI_WRITE_TX(g_pSPI, 0xFF);
-                    while(SPI_IS_BUSY(g_pSPI));
-                    *(pchar + counter) = SPI_READ_RX(g_pSPI);
-                }
-            }
-            else
-            {
-                for(counter = 0; counter < current_blklen; counter++)
-                {
-                    SPI_WRITE_TX(g_pSPI, 0xFF);
-                    while(SPI_IS_BUSY(g_pSPI));
-                }
-            }
+            SD_DataStart(NULL, pchar, current_blklen);
+            SD_DataWait();
             dummy_CRC.b[1] = SingleWrite(0xFF); // After all data is read, read the two
             dummy_CRC.b[0] = SingleWrite(0xFF); // CRC bytes;  These bytes are not used
             // in this mode, but the place holders
@@ -403,12 +533,11 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
             SingleWrite(0xFF);
             SingleWrite(START_SBW);
 
-            for(counter = 0; counter < current_blklen; counter++)
-            {
-                SPI_WRITE_TX(g_pSPI, *(pchar + counter));
-                dummy_CRC.i = GenerateCRC(*(pchar + counter), 0x1021, dummy_CRC.i);
-                while(SPI_IS_BUSY(g_pSPI));
-            }
+            // Calculate CRC while the data is
+            // being sent;
+            SD_DataStart(pchar, NULL, current_blklen);
+            dummy_CRC.i = SD_Crc16(pchar, current_blklen);
+            SD_DataWait();
             SingleWrite(dummy_CRC.b[1]);
             SingleWrite(dummy_CRC.b[0]);
 
@@ -428,8 +557,25 @@ uint32_t MMC_Command_Exec(uint8_t nCmd, uint32_t nArg, uint8_t *pchar, uint32_t
             }
 
             while((SingleWrite(0xFF) & 0xFF) != 0xFF); //Wait for Busy
+
+            // Data accepted is 0x05. 0x0B is a CRC
+            // error and 0x0D is a write error;
+            if((data_resp & 0x1F) != 0x05)
+            {
+                BACK_FROM_ERROR;
+            }
             SingleWrite(0xFF);
             break;
+        case RDM:
+        case WRM:
+            // Multi-block transfer. Keep the card
+            // selected. The data blocks and the
+            // stop are handled by the caller;
+            if(*response != 0)
+            {
+                BACK_FROM_ERROR;
+            }
+            return TRUE;
         default:
             break;
     }
@@ -535,6 +681,10 @@ void MMC_FLASH_Init(void)
         }
         MMC_Command_Exec(SET_BLOCKLEN, (uint32_t)PHYSICAL_BLOCK_SIZE, EMPTY, &response);
     }
+#if SD_DATA_CRC_CHECK
+    /* Let the card check the CRC of commands and written data */
+    MMC_Command_Exec(CRC_ON_OFF, 1, EMPTY, &response);
+#endif
     if(MMC_Command_Exec(SEND_CSD, EMPTY, pchar, &response) == FALSE)
         return;
 
@@ -593,6 +743,15 @@ uint32_t SDCARD_Open(void)
     PC5 = 0;//Enable SD Card power
     SD_Delay(100000);
 
+#if SD_USE_PDMA
+    /* PDMA channels for the data phase of block transfers */
+    PDMA_Open((1 << SD_PDMA_TX_CH) | (1 << SD_PDMA_RX_CH));
+    PDMA_SetBurstType(SD_PDMA_TX_CH, PDMA_REQ_SINGLE, 0);
+    PDMA_SetBurstType(SD_PDMA_RX_CH, PDMA_REQ_SINGLE, 0);
+    PDMA->DSCT[SD_PDMA_TX_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+    PDMA->DSCT[SD_PDMA_RX_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+#endif
+
     SPI_ENABLE(g_pSPI);
     /* Configure g_pSPI as a master, 8-bit transaction*/
     SPI_Open(g_pSPI, SPI_MASTER, SPI_MODE_0, 8, 300000);//300Khz for SD initial flow
@@ -652,71 +811,253 @@ uint32_t GetLogicSector(void)
 }
 
 /**
-  * @brief This function is used to Get data from SD card
-  * @param[in] addr Set start address for LBA
+  * @brief This function is used to start reading one data block of a multi-block read
+  * @param[out] buffer Set buffer pointer
+  * @retval TRUE Success
+  * @retval FALSE Timeout
+  * @details Call SD_ReadBlockEnd() to finish the block.
+  */
+static uint32_t SD_ReadBlockStart(uint8_t *buffer)
+{
+    uint16_t loopguard = 0;
+
+    while((SingleWrite(0xFF) & 0xFF) != START_MBR)
+    {
+        if(!++loopguard)
+            return FALSE;
+    }
+
+    SD_DataStart(NULL, buffer, PHYSICAL_BLOCK_SIZE);
+
+    return TRUE;
+}
+
+/**
+  * @brief This function is used to finish reading one data block of a multi-block read
+  * @return CRC16 sent by the card
+  */
+static uint32_t SD_ReadBlockEnd(void)
+{
+    UINT16 crc;
+
+    SD_DataWait();
+    crc.b[1] = SingleWrite(0xFF);
+    crc.b[0] = SingleWrite(0xFF);
+
+    return crc.i;
+}
+
+/**
+  * @brief This function is used to read data blocks with READ_MULTIPLE_BLOCK
+  * @param[in] addr Set start address
   * @param[in] size Set data size (byte)
-  * @param[in] buffer Set buffer pointer
-  * @return none
+  * @param[out] buffer Set buffer pointer
+  * @retval TRUE Success
+  * @retval FALSE Timeout or CRC error
+  * @details The CRC of a block is checked while the next block is being received.
   */
-void SpiRead(uint32_t addr, uint32_t size, uint8_t* buffer)
+static uint32_t SD_ReadMulti(uint32_t addr, uint32_t size, uint8_t *buffer)
 {
-    /* This is low level read function of USB Mass Storage */
     uint32_t response;
-    if(SDtype & SDBlock)
+    uint32_t u32Ret = TRUE;
+    uint8_t *pu8Prev = NULL;
+    uint32_t u32PrevCrc = 0;
+
+    if(MMC_Command_Exec(READ_MULTIPLE_BLOCK, addr, buffer, &response) == FALSE)
+        return FALSE;
+
+    while(size >= PHYSICAL_BLOCK_SIZE)
     {
-        while(size >= PHYSICAL_BLOCK_SIZE)
+        if(SD_ReadBlockStart(buffer) == FALSE)
+        {
+            u32Ret = FALSE;
+            break;
+        }
+#if SD_DATA_CRC_CHECK
+        if(pu8Prev && (SD_Crc16(pu8Prev, PHYSICAL_BLOCK_SIZE) != u32PrevCrc))
         {
-            MMC_Command_Exec(READ_SINGLE_BLOCK, addr, buffer, &response);
-            addr   ++;
-            buffer += PHYSICAL_BLOCK_SIZE;
-            size  -= PHYSICAL_BLOCK_SIZE;
+            SD_ReadBlockEnd();
+            g_u32SdCrcErrCnt++;
+            u32Ret = FALSE;
+            break;
         }
+#endif
+        u32PrevCrc = SD_ReadBlockEnd();
+        pu8Prev = buffer;
 
+        buffer += PHYSICAL_BLOCK_SIZE;
+        size  -= PHYSICAL_BLOCK_SIZE;
     }
-    else
+
+    MMC_Command_Exec(STOP_TRANSMISSION, EMPTY, EMPTY, &response);
+
+#if SD_DATA_CRC_CHECK
+    if(u32Ret && pu8Prev && (SD_Crc16(pu8Prev, PHYSICAL_BLOCK_SIZE) != u32PrevCrc))
     {
-        addr *= PHYSICAL_BLOCK_SIZE;
-        while(size >= PHYSICAL_BLOCK_SIZE)
+        g_u32SdCrcErrCnt++;
+        u32Ret = FALSE;
+    }
+#endif
+
+    return u32Ret;
+}
+
+/**
+  * @brief This function is used to write one data block of a multi-block write
+  * @param[in] buffer Set buffer pointer
+  * @retval TRUE Success
+  * @retval FALSE Data rejected or timeout
+  */
+static uint32_t SD_WriteBlock(uint8_t *buffer)
+{
+    uint8_t loopguard = 0;
+    uint8_t data_resp;
+    UINT16 crc;
+
+    SingleWrite(0xFF);
+    SingleWrite(START_MBW);
+
+    /* Calculate CRC while the data is being sent */
+    SD_DataStart(buffer, NULL, PHYSICAL_BLOCK_SIZE);
+    crc.i = SD_Crc16(buffer, PHYSICAL_BLOCK_SIZE);
+    SD_DataWait();
+    SingleWrite(crc.b[1]);
+    SingleWrite(crc.b[0]);
+
+    do
+    {
+        data_resp = SingleWrite(0xFF);
+        if(!++loopguard)
+            return FALSE;
+    }
+    while((data_resp & DATA_RESP_MASK) != 0x01);
+
+    /* Wait for the card to program the block */
+    while((SingleWrite(0xFF) & 0xFF) != 0xFF);
+
+    return ((data_resp & 0x1F) == 0x05) ? TRUE : FALSE;
+}
+
+/**
+  * @brief This function is used to write blocks with WRITE_MULTIPLE_BLOCK
+  * @param[in] addr Start address. Byte address for standard capacity card.
+  * @param[in] count Number of blocks
+  * @param[in] buffer Set buffer pointer
+  * @retval TRUE All blocks are accepted
+  * @retval FALSE A block is rejected, or timeout
+  */
+static uint32_t SD_WriteMulti(uint32_t addr, uint32_t count, uint8_t *buffer)
+{
+    uint32_t response;
+    uint32_t u32Ret = TRUE;
+
+    /* Let SD card pre-erase the blocks to be written. MMC does not support ACMD23. */
+    if(SDtype & (SDv1 | SDv2))
+        MMC_Command_Exec(SD_SET_WR_BLK_ERASE_COUNT, count, EMPTY, &response);
+
+    /* Stream all blocks with one WRITE_MULTIPLE_BLOCK and end it with the stop token */
+    if(MMC_Command_Exec(WRITE_MULTIPLE_BLOCK, addr, buffer, &response) == FALSE)
+        return FALSE;
+
+    while(count--)
+    {
+        if(SD_WriteBlock(buffer) == FALSE)
         {
-            MMC_Command_Exec(READ_SINGLE_BLOCK, addr, buffer, &response);
-            addr   += PHYSICAL_BLOCK_SIZE;
-            buffer += PHYSICAL_BLOCK_SIZE;
-            size  -= PHYSICAL_BLOCK_SIZE;
+            u32Ret = FALSE;
+            break;
         }
+
+        buffer += PHYSICAL_BLOCK_SIZE;
     }
+
+    SingleWrite(STOP_MBW);
+    SingleWrite(0xFF);
+    while((SingleWrite(0xFF) & 0xFF) != 0xFF); //Wait for Busy
+
+    PC4 = 1;//SPI_SET_SS_HIGH(g_pSPI);// CS = 1
+
+    return u32Ret;
 }
 
 /**
-  * @brief This function is used to store data into SD card
+  * @brief This function is used to Get data from SD card
   * @param[in] addr Set start address for LBA
   * @param[in] size Set data size (byte)
   * @param[in] buffer Set buffer pointer
-  * @return none
+  * @retval TRUE The data is read
+  * @retval FALSE The data still has CRC error, or the card does not respond, after SD_CRC_RETRY retries
   */
-void SpiWrite(uint32_t addr, uint32_t size, uint8_t* buffer)
+uint32_t SpiRead(uint32_t addr, uint32_t size, uint8_t* buffer)
 {
+    /* This is low level read function of USB Mass Storage */
     uint32_t response;
-    if(SDtype & SDBlock)
+    uint32_t u32Retry;
+
+    /* Byte address for standard capacity card. Block address for SDHC/SDXC. */
+    if(!(SDtype & SDBlock))
+        addr *= PHYSICAL_BLOCK_SIZE;
+
+    if(size < PHYSICAL_BLOCK_SIZE)
+        return FALSE;
+
+    /* Read again when the data CRC does not match */
+    for(u32Retry = 0; u32Retry <= SD_CRC_RETRY; u32Retry++)
     {
-        while(size >= PHYSICAL_BLOCK_SIZE)
+        if(size == PHYSICAL_BLOCK_SIZE)
+        {
+            if(MMC_Command_Exec(READ_SINGLE_BLOCK, addr, buffer, &response))
+                return TRUE;
+        }
+        else
         {
-            MMC_Command_Exec(WRITE_BLOCK, addr, buffer, &response);
-            addr   ++;
-            buffer += PHYSICAL_BLOCK_SIZE;
-            size  -= PHYSICAL_BLOCK_SIZE;
+            /* Stream all blocks with one READ_MULTIPLE_BLOCK and stop it with STOP_TRANSMISSION */
+            if(SD_ReadMulti(addr, size, buffer))
+                return TRUE;
         }
     }
-    else
-    {
+
+    return FALSE;
+}
+
+/**
+  * @brief This function is used to store data into SD card
+  * @param[in] addr Set start address for LBA
+  * @param[in] size Set data size (byte)
+  * @param[in] buffer Set buffer pointer
+  * @retval TRUE The data is written
+  * @retval FALSE The card still rejects the data, or does not respond, after SD_CRC_RETRY retries
+  */
+uint32_t SpiWrite(uint32_t addr, uint32_t size, uint8_t* buffer)
+{
+    uint32_t response;
+    uint32_t count;
+    uint32_t u32Retry;
+
+    /* Byte address for standard capacity card. Block address for SDHC/SDXC. */
+    if(!(SDtype & SDBlock))
         addr *= PHYSICAL_BLOCK_SIZE;
-        while(size >= PHYSICAL_BLOCK_SIZE)
+
+    count = size / PHYSICAL_BLOCK_SIZE;
+
+    if(count == 0)
+        return FALSE;
+
+    /* Write again when the card rejects the data, e.g. for a CRC error on the bus */
+    for(u32Retry = 0; u32Retry <= SD_CRC_RETRY; u32Retry++)
+    {
+        if(count == 1)
         {
-            MMC_Command_Exec(WRITE_BLOCK, addr, buffer, &response);
-            addr   += (PHYSICAL_BLOCK_SIZE);
-            buffer += PHYSICAL_BLOCK_SIZE;
-            size  -= PHYSICAL_BLOCK_SIZE;
+            if(MMC_Command_Exec(WRITE_BLOCK, addr, buffer, &response))
+                return TRUE;
+        }
+        else
+        {
+            if(SD_WriteMulti(addr, count, buffer))
+                return TRUE;
         }
     }
+
+    return FALSE;
 }
 /*@}*/ /* end of group NUC1261_SDCARD_EXPORTED_FUNCTIONS */
 
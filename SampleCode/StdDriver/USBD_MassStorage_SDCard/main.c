@@ -83,6 +83,10 @@ void SYS_Init(void)
     CLK_EnableModuleClock(UART0_MODULE);
     CLK_EnableModuleClock(USBD_MODULE);
     CLK_EnableModuleClock(SPI1_MODULE);
+    CLK_EnableModuleClock(PDMA_MODULE);
+#if SD_CRC_HW
+    CLK_EnableModuleClock(CRC_MODULE);
+#endif
 
     /* Select module clock source */
     CLK_SetModuleClock(SPI1_MODULE, CLK_CLKSEL2_SPI1SEL_PCLK0, MODULE_NoMsk);
@@ -75,6 +75,11 @@
 #define BULK_CSW  0x04
 #define BULK_NORMAL 0xFF
 
+/* Read-ahead state of the storage buffer not streaming to host */
+#define RA_IDLE   0x00                        /* Nothing left to fetch */
+#define RA_BUSY   0x01                        /* Next chunk is requested and fetched by MSC_ReadAhead() */
+#define RA_READY  0x02                        /* Next chunk is in the storage buffer */
+
 static __INLINE uint32_t get_be32(uint8_t *buf)
 {
     return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
@@ -115,14 +120,16 @@ struct CSW
 
 /*-------------------------------------------------------------*/
 #define MASS_BUFFER_SIZE    256               /* Mass Storage command buffer size */
-#define STORAGE_BUFFER_SIZE 512               /* Data transfer buffer size in 512 bytes alignment */
+#define STORAGE_BUFFER_SIZE 4096              /* Data transfer buffer size in 512 bytes alignment. Each one is a multi-block SD transfer */
 #define UDC_SECTOR_SIZE   512                 /* logic sector size */
+#define STORAGE_BUFFER_NUM  2                 /* Storage buffers for media read-ahead and write-behind */
 
 extern uint32_t MassBlock[];
 extern uint32_t Storage_Block[];
 
 #define MassCMD_BUF        ((uint32_t)&MassBlock[0])
 #define STORAGE_DATA_BUF   ((uint32_t)&Storage_Block[0])
+#define STORAGE_BUF(idx)        (STORAGE_DATA_BUF + (idx) * STORAGE_BUFFER_SIZE)
 
 /*-------------------------------------------------------------*/
 
@@ -137,6 +144,8 @@ void MSC_ReadCapacity(void);
 void MSC_Write(void);
 void MSC_ModeSense10(void);
 void MSC_ReadTrig(void);
+void MSC_ReadAhead(void);
+void MSC_MediaTask(void);
 void MSC_ClassRequest(void);
 void MSC_SetConfig(void);
 
@@ -146,6 +155,10 @@ void MSC_WriteMedia(uint32_t addr, uint32_t size, uint8_t *buffer);
 /*-------------------------------------------------------------*/
 void MSC_AckCmd(void);
 void MSC_ProcessCmd(void);
+
+/* Read-ahead statistics of the last READ(10)/READ(12) command */
+extern uint32_t volatile g_u32ReadStallCnt;
+extern uint32_t volatile g_u32ReadStallMs;
 void EP2_Handler(void);
 void EP3_Handler(void);
 
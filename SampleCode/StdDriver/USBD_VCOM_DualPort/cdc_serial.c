@@ -168,6 +168,8 @@ void EP2_Handler(void)
 
 void EP3_Handler(void)
 {
+    uint8_t *pu8Buf;
+
     /* Bulk OUT */
     if(g_u32OutToggle0 == (USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk))
     {
@@ -175,10 +177,16 @@ void EP3_Handler(void)
     }
     else
     {
+        g_u32OutToggle0 = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
+
+        /* The main loop still holds the last packet. Drop this one; its release re-arms EP3. */
+        pu8Buf = USBD_AcquireEpBuf(EP3);
+        if(pu8Buf == NULL)
+            return;
+
         gu32RxSize0 = USBD_GET_PAYLOAD_LEN(EP3);
-        gpu8RxBuf0 = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
+        gpu8RxBuf0 = pu8Buf;
 
-        g_u32OutToggle0 = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
         /* Set a flag to indicate bulk out ready */
         gi8BulkOutReady0 = 1;
     }
@@ -186,17 +194,25 @@ void EP3_Handler(void)
 
 void EP6_Handler(void)
 {
+    uint8_t *pu8Buf;
+
     /* Bulk OUT */
     if(g_u32OutToggle1 == (USBD->EPSTS & USBD_EPSTS_EPSTS6_Msk))
     {
-        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+        USBD_SET_PAYLOAD_LEN(EP6, EP6_MAX_PKT_SIZE);
     }
     else
     {
+        g_u32OutToggle1 = USBD->EPSTS & USBD_EPSTS_EPSTS6_Msk;
+
+        /* The main loop still holds the last packet. Drop this one; its release re-arms EP6. */
+        pu8Buf = USBD_AcquireEpBuf(EP6);
+        if(pu8Buf == NULL)
+            return;
+
         gu32RxSize1 = USBD_GET_PAYLOAD_LEN(EP6);
-        gpu8RxBuf1 = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP6));
+        gpu8RxBuf1 = pu8Buf;
 
-        g_u32OutToggle1 = USBD->EPSTS & USBD_EPSTS_EPSTS6_Msk;
         /* Set a flag to indicate bulk out ready */
         gi8BulkOutReady1 = 1;
     }
@@ -385,13 +401,9 @@ void VCOM_LineCoding(uint8_t port)
         u32SysTmp = __HIRC / (u32Div + 1);
 
         // Reset software fifo
-        comRbytes0 = 0;
-        comRhead0 = 0;
-        comRtail0 = 0;
+        RINGBUF_Init(&g_sComRx0, comRbuf0, RXBUFSIZE);
 
-        comTbytes0 = 0;
-        comThead0 = 0;
-        comTtail0 = 0;
+        VCOM_TxDmaReset0();
 
         // Reset hardware fifo
         UART0->FIFO = UART_FIFO_TXRST_Msk | UART_FIFO_RXRST_Msk;
@@ -454,13 +466,9 @@ void VCOM_LineCoding(uint8_t port)
         u32SysTmp = __HIRC / (u32Div + 1);
 
         // Reset software fifo
-        comRbytes1 = 0;
-        comRhead1 = 0;
-        comRtail1 = 0;
+        RINGBUF_Init(&g_sComRx1, comRbuf1, RXBUFSIZE);
 
-        comTbytes1 = 0;
-        comThead1 = 0;
-        comTtail1 = 0;
+        VCOM_TxDmaReset1();
 
         // Reset hardware fifo
         UART1->FIFO = UART_FIFO_TXRST_Msk | UART_FIFO_RXRST_Msk;
@@ -77,16 +77,16 @@ typedef struct
     uint8_t   u8DataBits;     /* data bits    */
 } STR_VCOM_LINE_CODING;
 
+/*-------------------------------------------------------------*/
+#define RXBUFSIZE           512 /* RX buffer size. Must be a power of 2. */
+#define TXBUFSIZE           512 /* TX buffer size. Must be a power of 2. */
+
 /*-------------------------------------------------------------*/
 extern volatile int8_t gi8BulkOutReady0;
 extern STR_VCOM_LINE_CODING gLineCoding0;
 extern uint16_t gCtrlSignal0;
-extern volatile uint16_t comRbytes0;
-extern volatile uint16_t comRhead0;
-extern volatile uint16_t comRtail0;
-extern volatile uint16_t comTbytes0;
-extern volatile uint16_t comThead0;
-extern volatile uint16_t comTtail0;
+extern uint8_t comRbuf0[];
+extern S_RINGBUF_T g_sComRx0;
 extern volatile uint8_t *gpu8RxBuf0;
 extern volatile uint32_t gu32RxSize0;
 extern volatile uint32_t gu32TxSize0;
@@ -94,12 +94,8 @@ extern volatile uint32_t gu32TxSize0;
 extern volatile int8_t gi8BulkOutReady1;
 extern STR_VCOM_LINE_CODING gLineCoding1;
 extern uint16_t gCtrlSignal1;
-extern volatile uint16_t comRbytes1;
-extern volatile uint16_t comRhead1;
-extern volatile uint16_t comRtail1;
-extern volatile uint16_t comTbytes1;
-extern volatile uint16_t comThead1;
-extern volatile uint16_t comTtail1;
+extern uint8_t comRbuf1[];
+extern S_RINGBUF_T g_sComRx1;
 extern volatile uint8_t *gpu8RxBuf1;
 extern volatile uint32_t gu32RxSize1;
 extern volatile uint32_t gu32TxSize1;
@@ -115,6 +111,8 @@ void EP7_Handler(void);
 void EP6_Handler(void);
 void VCOM_LineCoding(uint8_t port);
 void VCOM_TransferData(void);
+void VCOM_TxDmaReset0(void);
+void VCOM_TxDmaReset1(void);
 
 #endif  /* __USBD_CDC_H_ */
 
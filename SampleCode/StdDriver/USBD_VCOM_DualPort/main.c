@@ -34,48 +34,56 @@ uint16_t gCtrlSignal1 = 0;     /* BIT0: DTR(Data Terminal Ready) , BIT1: RTS(Req
 static volatile uint32_t s_u32DefaultTrim, s_u32LastTrim;
 #endif
 /*--------------------------------------------------------------------------*/
-#define RXBUFSIZE           512 /* RX buffer size */
-#define TXBUFSIZE           512 /* RX buffer size */
+#define VCOM0_TX_PDMA_CH    0   /* PDMA channel for UART0 TX */
+#define VCOM1_TX_PDMA_CH    1   /* PDMA channel for UART1 TX */
 
 /*---------------------------------------------------------------------------------------------------------*/
 /* Global variables                                                                                        */
 /*---------------------------------------------------------------------------------------------------------*/
 /* UART0 */
-volatile uint8_t comRbuf0[RXBUFSIZE];
-volatile uint16_t comRbytes0 = 0;
-volatile uint16_t comRhead0 = 0;
-volatile uint16_t comRtail0 = 0;
+uint8_t comRbuf0[RXBUFSIZE];
+S_RINGBUF_T g_sComRx0;          /* Filled by the UART interrupt and sent to USB by the main loop */
 
-volatile uint8_t comTbuf0[TXBUFSIZE];
-volatile uint16_t comTbytes0 = 0;
-volatile uint16_t comThead0 = 0;
-volatile uint16_t comTtail0 = 0;
-
-uint8_t gRxBuf0[64] = {0};
+uint8_t comTbuf0[TXBUFSIZE];
+S_RINGBUF_T g_sComTx0;          /* Filled by the main loop and sent by PDMA_IRQHandler() */
 volatile uint8_t *gpu8RxBuf0 = 0;
 volatile uint32_t gu32RxSize0 = 0;
 volatile uint32_t gu32TxSize0 = 0;
 
 volatile int8_t gi8BulkOutReady0 = 0;
 
-/* UART1 */
-volatile uint8_t comRbuf1[RXBUFSIZE];
-volatile uint16_t comRbytes1 = 0;
-volatile uint16_t comRhead1 = 0;
-volatile uint16_t comRtail1 = 0;
+/* UART0 TX PDMA. The second descriptor table is chained when the data wraps around comTbuf0. */
+typedef struct dma_desc_t
+{
+    uint32_t ctl;
+    uint32_t src;
+    uint32_t dest;
+    uint32_t offset;
+} DMA_DESC_T;
 
-volatile uint8_t comTbuf1[TXBUFSIZE];
-volatile uint16_t comTbytes1 = 0;
-volatile uint16_t comThead1 = 0;
-volatile uint16_t comTtail1 = 0;
+DMA_DESC_T g_asTxDesc0[2];
+static volatile uint32_t s_u32TxDmaLen0 = 0; /* Bytes being sent by PDMA. 0 means UART TX is idle. */
+volatile uint32_t g_u32ComTxIntCnt0 = 0;     /* PDMA interrupts of UART0 TX */
+volatile uint32_t g_u32ComTxBytes0 = 0;      /* Bytes sent to UART0 TX */
 
-uint8_t gRxBuf1[64] = {0};
+/* UART1 */
+uint8_t comRbuf1[RXBUFSIZE];
+S_RINGBUF_T g_sComRx1;          /* Filled by the UART interrupt and sent to USB by the main loop */
+
+uint8_t comTbuf1[TXBUFSIZE];
+S_RINGBUF_T g_sComTx1;          /* Filled by the main loop and sent by PDMA_IRQHandler() */
 volatile uint8_t *gpu8RxBuf1 = 0;
 volatile uint32_t gu32RxSize1 = 0;
 volatile uint32_t gu32TxSize1 = 0;
 
 volatile int8_t gi8BulkOutReady1 = 0;
 
+/* UART1 TX PDMA */
+DMA_DESC_T g_asTxDesc1[2];
+static volatile uint32_t s_u32TxDmaLen1 = 0;
+volatile uint32_t g_u32ComTxIntCnt1 = 0;
+volatile uint32_t g_u32ComTxBytes1 = 0;
+
 /*--------------------------------------------------------------------------*/
 void SYS_Init(void)
 {
@@ -133,6 +141,7 @@ void SYS_Init(void)
     CLK_EnableModuleClock(UART0_MODULE);
     CLK_EnableModuleClock(UART1_MODULE);
     CLK_EnableModuleClock(USBD_MODULE);
+    CLK_EnableModuleClock(PDMA_MODULE);
 
 
     /*---------------------------------------------------------------------------------------------------------*/
@@ -193,7 +202,6 @@ void UART02_IRQHandler(void)
 {
     uint32_t u32IntStatus;
     uint8_t bInChar;
-    int32_t size;
 
     u32IntStatus = UART0->INTSTS;
 
@@ -207,58 +215,18 @@ void UART02_IRQHandler(void)
             /* Get the character from UART Buffer */
             bInChar = UART0->DAT;
 
-            /* Check if buffer full */
-            if(comRbytes0 < RXBUFSIZE)
-            {
-                /* Enqueue the character */
-                comRbuf0[comRtail0++] = bInChar;
-                if(comRtail0 >= RXBUFSIZE)
-                    comRtail0 = 0;
-                comRbytes0++;
-            }
-            else
-            {
-                /* FIFO over run */
-            }
-        }
-    }
-
-    if(u32IntStatus & UART_INTSTS_THREIF_Msk)
-    {
-
-        if(comTbytes0 && (UART0->INTEN & UART_INTEN_THREIEN_Msk))
-        {
-            /* Fill the Tx FIFO */
-            size = comTbytes0;
-            if(size >= UART0_FIFO_SIZE)
-            {
-                size = UART0_FIFO_SIZE;
-            }
-
-            while(size)
-            {
-                bInChar = comTbuf0[comThead0++];
-                UART0->DAT = bInChar;
-                if(comThead0 >= TXBUFSIZE)
-                    comThead0 = 0;
-                comTbytes0--;
-                size--;
-            }
-        }
-        else
-        {
-            /* No more data, just stop Tx (Stop work) */
-            UART0->INTEN &= (~UART_INTEN_THREIEN_Msk);
+            /* Enqueue the character. It is dropped if the buffer is full (FIFO over run). */
+            RINGBUF_Put(&g_sComRx0, bInChar);
         }
     }
 
+    /* TX data is moved by PDMA. See PDMA_IRQHandler(). */
 }
 
 void UART1_IRQHandler(void)
 {
     uint32_t u32IntStatus;
     uint8_t bInChar;
-    int32_t size;
 
     u32IntStatus = UART1->INTSTS;
 
@@ -272,81 +240,162 @@ void UART1_IRQHandler(void)
             /* Get the character from UART Buffer */
             bInChar = UART1->DAT;
 
-            /* Check if buffer full */
-            if(comRbytes1 < RXBUFSIZE)
-            {
-                /* Enqueue the character */
-                comRbuf1[comRtail1++] = bInChar;
-                if(comRtail1 >= RXBUFSIZE)
-                    comRtail1 = 0;
-                comRbytes1++;
-            }
-            else
-            {
-                /* FIFO over run */
-            }
+            /* Enqueue the character. It is dropped if the buffer is full (FIFO over run). */
+            RINGBUF_Put(&g_sComRx1, bInChar);
         }
     }
 
-    if(u32IntStatus & UART_INTSTS_THREIF_Msk)
+    /* TX data is moved by PDMA. See PDMA_IRQHandler(). */
+}
+
+/*---------------------------------------------------------------------------------------------------------*/
+/* UART TX PDMA                                                                                            */
+/*---------------------------------------------------------------------------------------------------------*/
+static void VCOM_TxDmaStop(uint32_t u32Ch, UART_T *uart)
+{
+    /* Stop TX and drop the data not sent yet */
+    uart->INTEN &= ~UART_INTEN_TXPDMAEN_Msk;
+    PDMA->RESET = (1 << u32Ch);
+    PDMA_CLR_TD_FLAG(1 << u32Ch);
+
+    PDMA_Open(1 << u32Ch);
+    PDMA_EnableInt(u32Ch, PDMA_INT_TRANS_DONE);
+}
+
+static uint32_t VCOM_TxDmaStart(uint32_t u32Ch, UART_T *uart, uint32_t u32Peripheral, DMA_DESC_T *psDesc, S_RINGBUF_T *psRing)
+{
+    uint32_t u32Len, u32Span, u32Ctl;
+    uint8_t *pu8Span;
+
+    /* Send all data in the software TX FIFO with one PDMA transfer */
+    u32Len = RINGBUF_GET_COUNT(psRing);
+    u32Span = RINGBUF_GetReadSpan(psRing, &pu8Span);
+    u32Ctl = PDMA_WIDTH_8 | PDMA_SAR_INC | PDMA_DAR_FIX | PDMA_REQ_SINGLE;
+
+    psDesc[0].src = (uint32_t)pu8Span;
+    psDesc[0].dest = (uint32_t)&uart->DAT;
+
+    if(u32Len <= u32Span)
     {
+        psDesc[0].ctl = u32Ctl | ((u32Len - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_OP_BASIC;
+    }
+    else
+    {
+        /* Data wraps around. Chain the part at the beginning of the buffer. */
+        psDesc[0].ctl = u32Ctl | ((u32Span - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_TBINTDIS_DISABLE | PDMA_OP_SCATTER;
+        psDesc[0].offset = (uint32_t)&psDesc[1] - (PDMA->SCATBA);
 
-        if(comTbytes1 && (UART1->INTEN & UART_INTEN_THREIEN_Msk))
-        {
-            /* Fill the Tx FIFO */
-            size = comTbytes1;
-            if(size >= UART1_FIFO_SIZE)
-            {
-                size = UART1_FIFO_SIZE;
-            }
+        psDesc[1].ctl = u32Ctl | ((u32Len - u32Span - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_OP_BASIC;
+        psDesc[1].src = (uint32_t)psRing->pu8Buf;
+        psDesc[1].dest = (uint32_t)&uart->DAT;
+    }
 
-            while(size)
-            {
-                bInChar = comTbuf1[comThead1++];
-                UART1->DAT = bInChar;
-                if(comThead1 >= TXBUFSIZE)
-                    comThead1 = 0;
-                comTbytes1--;
-                size--;
-            }
-        }
+    PDMA_SetTransferMode(u32Ch, u32Peripheral, TRUE, (uint32_t)&psDesc[0]);
+    uart->INTEN |= UART_INTEN_TXPDMAEN_Msk;
+
+    return u32Len;
+}
+
+void VCOM_TxDmaReset0(void)
+{
+    VCOM_TxDmaStop(VCOM0_TX_PDMA_CH, UART0);
+
+    s_u32TxDmaLen0 = 0;
+    RINGBUF_Init(&g_sComTx0, comTbuf0, TXBUFSIZE);
+}
+
+void VCOM_TxDmaReset1(void)
+{
+    VCOM_TxDmaStop(VCOM1_TX_PDMA_CH, UART1);
+
+    s_u32TxDmaLen1 = 0;
+    RINGBUF_Init(&g_sComTx1, comTbuf1, TXBUFSIZE);
+}
+
+static void VCOM_TxDmaStart0(void)
+{
+    s_u32TxDmaLen0 = VCOM_TxDmaStart(VCOM0_TX_PDMA_CH, UART0, PDMA_UART0_TX, g_asTxDesc0, &g_sComTx0);
+}
+
+static void VCOM_TxDmaStart1(void)
+{
+    s_u32TxDmaLen1 = VCOM_TxDmaStart(VCOM1_TX_PDMA_CH, UART1, PDMA_UART1_TX, g_asTxDesc1, &g_sComTx1);
+}
+
+void PDMA_IRQHandler(void)
+{
+    uint32_t u32Status = PDMA_GET_INT_STATUS();
+
+    if(u32Status & PDMA_INTSTS_ABTIF_Msk)
+    {
+        /* Target abort. Should not happen. */
+        PDMA->ABTSTS = PDMA->ABTSTS;
+    }
+
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << VCOM0_TX_PDMA_CH)))
+    {
+        /* All data of the transfer is in UART0 TX FIFO */
+        PDMA_CLR_TD_FLAG(1 << VCOM0_TX_PDMA_CH);
+
+        RINGBUF_CommitRead(&g_sComTx0, s_u32TxDmaLen0);
+        g_u32ComTxBytes0 += s_u32TxDmaLen0;
+        g_u32ComTxIntCnt0++;
+        s_u32TxDmaLen0 = 0;
+
+        /* Send the data queued meanwhile */
+        if(!RINGBUF_IS_EMPTY(&g_sComTx0))
+            VCOM_TxDmaStart0();
         else
-        {
-            /* No more data, just stop Tx (Stop work) */
-            UART1->INTEN &= (~UART_INTEN_THREIEN_Msk);
-        }
+            UART0->INTEN &= ~UART_INTEN_TXPDMAEN_Msk;
     }
 
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << VCOM1_TX_PDMA_CH)))
+    {
+        /* All data of the transfer is in UART1 TX FIFO */
+        PDMA_CLR_TD_FLAG(1 << VCOM1_TX_PDMA_CH);
+
+        RINGBUF_CommitRead(&g_sComTx1, s_u32TxDmaLen1);
+        g_u32ComTxBytes1 += s_u32TxDmaLen1;
+        g_u32ComTxIntCnt1++;
+        s_u32TxDmaLen1 = 0;
+
+        if(!RINGBUF_IS_EMPTY(&g_sComTx1))
+            VCOM_TxDmaStart1();
+        else
+            UART1->INTEN &= ~UART_INTEN_TXPDMAEN_Msk;
+    }
 }
 
 void VCOM_TransferData(void)
 {
     int32_t i, i32Len;
+    uint32_t u32Done;
+    uint8_t *pu8EpBuf, *pu8Span;
 
     /* Check whether USB is ready for next packet or not */
     if(gu32TxSize0 == 0)
     {
         /* Check whether we have new COM Rx data to send to USB or not */
-        if(comRbytes0)
+        if(!RINGBUF_IS_EMPTY(&g_sComRx0))
         {
-            i32Len = comRbytes0;
-            if(i32Len > EP2_MAX_PKT_SIZE)
-                i32Len = EP2_MAX_PKT_SIZE;
-
-            for(i = 0; i < i32Len; i++)
+            /* Copy the span up to the end of the ring first, then the wrapped part */
+            pu8EpBuf = USBD_AcquireEpBuf(EP2);
+            if(pu8EpBuf != NULL)
             {
-                gRxBuf0[i] = comRbuf0[comRhead0++];
-                if(comRhead0 >= RXBUFSIZE)
-                    comRhead0 = 0;
+                for(i32Len = 0; i32Len < EP2_MAX_PKT_SIZE; i32Len += i)
+                {
+                    i = RINGBUF_GetReadSpan(&g_sComRx0, &pu8Span);
+                    if(i == 0)
+                        break;
+                    if(i > EP2_MAX_PKT_SIZE - i32Len)
+                        i = EP2_MAX_PKT_SIZE - i32Len;
+                    USBD_MemCopy(pu8EpBuf + i32Len, pu8Span, i);
+                    RINGBUF_CommitRead(&g_sComRx0, i);
+                }
+
+                gu32TxSize0 = i32Len;
+                USBD_ReleaseEpBuf(EP2, i32Len);
             }
-
-            __set_PRIMASK(1);
-            comRbytes0 -= i32Len;
-            __set_PRIMASK(0);
-
-            gu32TxSize0 = i32Len;
-            USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP2)), (uint8_t *)gRxBuf0, i32Len);
-            USBD_SET_PAYLOAD_LEN(EP2, i32Len);
         }
         else
         {
@@ -361,26 +410,26 @@ void VCOM_TransferData(void)
     if(gu32TxSize1 == 0)
     {
         /* Check whether we have new COM Rx data to send to USB or not */
-        if(comRbytes1)
+        if(!RINGBUF_IS_EMPTY(&g_sComRx1))
         {
-            i32Len = comRbytes1;
-            if(i32Len > EP7_MAX_PKT_SIZE)
-                i32Len = EP7_MAX_PKT_SIZE;
-
-            for(i = 0; i < i32Len; i++)
+            /* Copy the span up to the end of the ring first, then the wrapped part */
+            pu8EpBuf = USBD_AcquireEpBuf(EP7);
+            if(pu8EpBuf != NULL)
             {
-                gRxBuf1[i] = comRbuf1[comRhead1++];
-                if(comRhead1 >= RXBUFSIZE)
-                    comRhead1 = 0;
+                for(i32Len = 0; i32Len < EP7_MAX_PKT_SIZE; i32Len += i)
+                {
+                    i = RINGBUF_GetReadSpan(&g_sComRx1, &pu8Span);
+                    if(i == 0)
+                        break;
+                    if(i > EP7_MAX_PKT_SIZE - i32Len)
+                        i = EP7_MAX_PKT_SIZE - i32Len;
+                    USBD_MemCopy(pu8EpBuf + i32Len, pu8Span, i);
+                    RINGBUF_CommitRead(&g_sComRx1, i);
+                }
+
+                gu32TxSize1 = i32Len;
+                USBD_ReleaseEpBuf(EP7, i32Len);
             }
-
-            __set_PRIMASK(1);
-            comRbytes1 -= i32Len;
-            __set_PRIMASK(0);
-
-            gu32TxSize1 = i32Len;
-            USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP7)), (uint8_t *)gRxBuf1, i32Len);
-            USBD_SET_PAYLOAD_LEN(EP7, i32Len);
         }
         else
         {
@@ -393,79 +442,53 @@ void VCOM_TransferData(void)
     }
 
     /* Process the Bulk out data when bulk out data is ready. */
-    if(gi8BulkOutReady0 && (gu32RxSize0 <= TXBUFSIZE - comTbytes0))
+    if(gi8BulkOutReady0 && (gu32RxSize0 <= RINGBUF_GET_FREE(&g_sComTx0)))
     {
-        for(i = 0; i < gu32RxSize0; i++)
+        /* Copy the packet to comTbuf0. Copy the span up to the end of the ring first, then the wrapped part. */
+        for(u32Done = 0; u32Done < gu32RxSize0; u32Done += i)
         {
-            comTbuf0[comTtail0++] = gpu8RxBuf0[i];
-            if(comTtail0 >= TXBUFSIZE)
-                comTtail0 = 0;
+            i = RINGBUF_GetWriteSpan(&g_sComTx0, &pu8Span);
+            if(i > gu32RxSize0 - u32Done)
+                i = gu32RxSize0 - u32Done;
+            USBD_MemCopy(pu8Span, (uint8_t *)gpu8RxBuf0 + u32Done, i);
+            RINGBUF_CommitWrite(&g_sComTx0, i);
         }
 
-        __set_PRIMASK(1);
-        comTbytes0 += gu32RxSize0;
-        __set_PRIMASK(0);
-
         gu32RxSize0 = 0;
         gi8BulkOutReady0 = 0; /* Clear bulk out ready flag */
 
         /* Ready to get next BULK out */
-        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+        USBD_ReleaseEpBuf(EP3, EP3_MAX_PKT_SIZE);
     }
 
-    if(gi8BulkOutReady1 && (gu32RxSize1 <= TXBUFSIZE - comTbytes1))
+    if(gi8BulkOutReady1 && (gu32RxSize1 <= RINGBUF_GET_FREE(&g_sComTx1)))
     {
-        for(i = 0; i < gu32RxSize1; i++)
+        /* Copy the packet to comTbuf1. Copy the span up to the end of the ring first, then the wrapped part. */
+        for(u32Done = 0; u32Done < gu32RxSize1; u32Done += i)
         {
-            comTbuf1[comTtail1++] = gpu8RxBuf1[i];
-            if(comTtail1 >= TXBUFSIZE)
-                comTtail1 = 0;
+            i = RINGBUF_GetWriteSpan(&g_sComTx1, &pu8Span);
+            if(i > gu32RxSize1 - u32Done)
+                i = gu32RxSize1 - u32Done;
+            USBD_MemCopy(pu8Span, (uint8_t *)gpu8RxBuf1 + u32Done, i);
+            RINGBUF_CommitWrite(&g_sComTx1, i);
         }
 
-        __set_PRIMASK(1);
-        comTbytes1 += gu32RxSize1;
-        __set_PRIMASK(0);
-
         gu32RxSize1 = 0;
         gi8BulkOutReady1 = 0; /* Clear bulk out ready flag */
 
         /* Ready to get next BULK out */
-        USBD_SET_PAYLOAD_LEN(EP6, EP6_MAX_PKT_SIZE);
+        USBD_ReleaseEpBuf(EP6, EP6_MAX_PKT_SIZE);
     }
 
-    /* Process the software Tx FIFO */
-    if(comTbytes0)
+    /* Process the software Tx FIFO. PDMA_IRQHandler() goes on with the data queued during a transfer. */
+    if(!RINGBUF_IS_EMPTY(&g_sComTx0) && (s_u32TxDmaLen0 == 0))
     {
-        /* Check if Tx is working */
-        if((UART0->INTEN & UART_INTEN_THREIEN_Msk) == 0)
-        {
-            /* Send one bytes out */
-            UART0->DAT = comTbuf0[comThead0++];
-            if(comThead0 >= TXBUFSIZE)
-                comThead0 = 0;
-
-            comTbytes0--;
-
-            /* Enable Tx Empty Interrupt. (Trigger first one) */
-            UART0->INTEN |= UART_INTEN_THREIEN_Msk;
-        }
+        VCOM_TxDmaStart0();
     }
 
-    if(comTbytes1)
+    if(!RINGBUF_IS_EMPTY(&g_sComTx1) && (s_u32TxDmaLen1 == 0))
     {
-        /* Check if Tx is working */
-        if((UART1->INTEN & UART_INTEN_THREIEN_Msk) == 0)
-        {
-            /* Send one bytes out */
-            UART1->DAT = comTbuf1[comThead1++];
-            if(comThead1 >= TXBUFSIZE)
-                comThead1 = 0;
-
-            comTbytes1--;
-
-            /* Enable Tx Empty Interrupt. (Trigger first one) */
-            UART1->INTEN |= UART_INTEN_THREIEN_Msk;
-        }
+        VCOM_TxDmaStart1();
     }
 }
 
@@ -528,6 +551,13 @@ int32_t main(void)
     NVIC_EnableIRQ(UART02_IRQn);
     NVIC_EnableIRQ(UART1_IRQn);
 
+    /* Start to receive UART data by interrupt and transmit UART data by PDMA */
+    RINGBUF_Init(&g_sComRx0, comRbuf0, RXBUFSIZE);
+    RINGBUF_Init(&g_sComRx1, comRbuf1, RXBUFSIZE);
+    VCOM_TxDmaReset0();
+    VCOM_TxDmaReset1();
+    NVIC_EnableIRQ(PDMA_IRQn);
+
     while(1)
     {
 #if CRYSTAL_LESS
@@ -173,6 +173,8 @@ void EP2_Handler(void)
 
 void EP3_Handler(void)
 {
+    uint8_t *pu8Buf;
+
     /* Bulk OUT */
     if(g_u32OutToggle == (USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk))
     {
@@ -180,10 +182,16 @@ void EP3_Handler(void)
     }
     else
     {
+        g_u32OutToggle = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
+
+        /* The main loop still holds the last packet. Drop this one; its release re-arms EP3. */
+        pu8Buf = USBD_AcquireEpBuf(EP3);
+        if(pu8Buf == NULL)
+            return;
+
         gu32RxSize = USBD_GET_PAYLOAD_LEN(EP3);
-        gpu8RxBuf = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
+        gpu8RxBuf = pu8Buf;
 
-        g_u32OutToggle = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
         /* Set a flag to indicate bulk out ready */
         gi8BulkOutReady = 1;
     }
@@ -314,6 +322,10 @@ void VCOM_LineCoding(uint8_t port)
 
     if(port == 0)
     {
+        /* A rate of 0 is not valid. Keep the UART as it is. */
+        if(gLineCoding.u32DTERate == 0)
+            return;
+
         u32Baudrate = gLineCoding.u32DTERate;
         u32Tmp = 65 * u32Baudrate;
         u32SysTmp = __HIRC / 1000;
@@ -326,14 +338,8 @@ void VCOM_LineCoding(uint8_t port)
         /* Update UART peripheral clock frequency. */
         u32SysTmp = __HIRC / (u32Div + 1);
 
-        // Reset software fifo
-        comRbytes = 0;
-        comRhead = 0;
-        comRtail = 0;
-
-        comTbytes = 0;
-        comThead = 0;
-        comTtail = 0;
+        // Stop TX PDMA and reset TX software fifo
+        VCOM_TxDmaReset();
 
         // Reset hardware fifo
         UART0->FIFO = UART_FIFO_TXRST_Msk | UART_FIFO_RXRST_Msk;
@@ -342,6 +348,9 @@ void VCOM_LineCoding(uint8_t port)
         UART0->BAUD = 0x30000000 + ((u32SysTmp + gLineCoding.u32DTERate / 2) / gLineCoding.u32DTERate - 2);
         CLK_SetModuleClock(UART0_MODULE, CLK_CLKSEL1_UARTSEL_HIRC, CLK_CLKDIV0_UART(u32Div + 1));
 
+        // Restart RX PDMA ring. It also resets the RX software fifo.
+        VCOM_RxDmaStart();
+
 
         // Set parity
         if(gLineCoding.u8ParityType == 0)
@@ -73,9 +73,6 @@ extern uint16_t gCtrlSignal;
 extern volatile uint16_t comRbytes;
 extern volatile uint16_t comRhead;
 extern volatile uint16_t comRtail;
-extern volatile uint16_t comTbytes;
-extern volatile uint16_t comThead;
-extern volatile uint16_t comTtail;
 extern volatile uint8_t *gpu8RxBuf;
 extern volatile uint32_t gu32RxSize;
 extern volatile uint32_t gu32TxSize;
@@ -89,6 +86,8 @@ void EP2_Handler(void);
 void EP3_Handler(void);
 void VCOM_LineCoding(uint8_t port);
 void VCOM_TransferData(void);
+void VCOM_RxDmaStart(void);
+void VCOM_TxDmaReset(void);
 
 #endif  /* __USBD_CDC_H_ */
 
@@ -34,6 +34,16 @@ static volatile uint32_t s_u32DefaultTrim, s_u32LastTrim;
 /*--------------------------------------------------------------------------*/
 #define RXBUFSIZE           512 /* RX buffer size */
 #define TXBUFSIZE           512 /* RX buffer size */
+#define RXHALFSIZE          (RXBUFSIZE / 2)
+
+#define VCOM_RX_PDMA_CH     0   /* PDMA channel for UART0 RX. Time-out is only supported by channel 0 and 1 */
+#define VCOM_RX_IDLE_BITS   40  /* PDMA time-out after UART RX is idle for 4 characters */
+#define VCOM_TX_PDMA_CH     1   /* PDMA channel for UART0 TX */
+
+/* Bulk IN batching. A short packet is held until a full packet is collected or the flush time-out expires.
+   The time-out is the time to receive a full packet at the current baud rate, limited to VCOM_IN_FLUSH_MAX_US. */
+#define VCOM_IN_BATCH       1
+#define VCOM_IN_FLUSH_MAX_US 1000
 
 
 /*---------------------------------------------------------------------------------------------------------*/
@@ -45,18 +55,45 @@ volatile uint16_t comRbytes = 0;
 volatile uint16_t comRhead = 0;
 volatile uint16_t comRtail = 0;
 
-volatile uint8_t comTbuf[TXBUFSIZE];
-volatile uint16_t comTbytes = 0;
-volatile uint16_t comThead = 0;
-volatile uint16_t comTtail = 0;
+uint8_t comTbuf[TXBUFSIZE];
+S_RINGBUF_T g_sComTx;           /* Filled by the main loop and sent by PDMA_IRQHandler(). TXBUFSIZE must be a power of 2. */
 
-uint8_t gRxBuf[64] = {0};
 volatile uint8_t *gpu8RxBuf = 0;
 volatile uint32_t gu32RxSize = 0;
 volatile uint32_t gu32TxSize = 0;
 
 volatile int8_t gi8BulkOutReady = 0;
 
+/* UART0 RX PDMA. Two descriptor tables fill the two halves of comRbuf in turn. */
+typedef struct dma_desc_t
+{
+    uint32_t ctl;
+    uint32_t src;
+    uint32_t dest;
+    uint32_t offset;
+} DMA_DESC_T;
+
+DMA_DESC_T g_asRxDesc[2];
+static uint32_t s_u32RxDescCtl;
+static volatile uint32_t s_u32RxHalf;       /* Half of comRbuf being filled by PDMA */
+static volatile uint32_t s_u32RxPartial;    /* Bytes of that half already put in comRbytes */
+volatile uint32_t g_u32ComRxOverrun = 0;    /* Times UART RX data overwrote the unsent data */
+
+/* UART0 TX PDMA. The second descriptor table is chained when the data wraps around comTbuf. */
+DMA_DESC_T g_asTxDesc[2];
+static volatile uint32_t s_u32TxDmaLen = 0;  /* Bytes being sent by PDMA. 0 means UART TX is idle. */
+volatile uint32_t g_u32ComTxIntCnt = 0;      /* PDMA interrupts of UART TX */
+volatile uint32_t g_u32ComTxBytes = 0;       /* Bytes sent to UART TX */
+
+/* Bulk IN statistics */
+volatile uint32_t g_u32ComInPkts = 0;        /* Bulk IN packets sent, including zero length packets */
+volatile uint32_t g_u32ComInBytes = 0;       /* Bytes sent by bulk IN */
+
+#if VCOM_IN_BATCH
+static uint8_t s_u8InFlushArmed = 0;         /* TIMER0 is counting the flush time-out */
+static volatile uint8_t s_u8InFlush = 0;     /* The flush time-out expired */
+#endif
+
 /*--------------------------------------------------------------------------*/
 void SYS_Init(void)
 {
@@ -110,7 +147,11 @@ void SYS_Init(void)
     /* Enable module clock */
     CLK_EnableModuleClock(UART0_MODULE);
     CLK_EnableModuleClock(USBD_MODULE);
-
+    CLK_EnableModuleClock(PDMA_MODULE);
+#if VCOM_IN_BATCH
+    CLK_EnableModuleClock(TMR0_MODULE);
+    CLK_SetModuleClock(TMR0_MODULE, CLK_CLKSEL1_TMR0SEL_HIRC, 0);
+#endif
 
     /*---------------------------------------------------------------------------------------------------------*/
     /* Init I/O Multi-function                                                                                 */
@@ -134,107 +175,265 @@ void UART0_Init(void)
     UART0->BAUD = UART_BAUD_MODE2 | UART_BAUD_MODE2_DIVIDER(__HIRC, 115200);
     UART0->LINE = UART_WORD_LEN_8 | UART_PARITY_NONE | UART_STOP_BIT_1;
 
-    UART0->INTEN = UART_INTEN_TOCNTEN_Msk | UART_INTEN_RDAIEN_Msk;
+    /* RX and TX data are moved by PDMA */
+    UART0->INTEN = 0;
 }
 
+/*---------------------------------------------------------------------------------------------------------*/
+/* UART RX PDMA                                                                                            */
+/*---------------------------------------------------------------------------------------------------------*/
+void VCOM_RxDmaStart(void)
+{
+    uint32_t i, u32TimeOut, u32Rate;
+#if VCOM_IN_BATCH
+    uint32_t u32FlushUs;
+#endif
 
+    /* Stop the ring */
+    UART0->INTEN &= ~UART_INTEN_RXPDMAEN_Msk;
+    PDMA->RESET = (1 << VCOM_RX_PDMA_CH);
+
+    /* Descriptor tables link to each other, so PDMA keeps filling comRbuf as a ring */
+    s_u32RxDescCtl = ((RXHALFSIZE - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_WIDTH_8 | PDMA_SAR_FIX | PDMA_DAR_INC |
+                     PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+    for(i = 0; i < 2; i++)
+    {
+        g_asRxDesc[i].ctl = s_u32RxDescCtl;
+        g_asRxDesc[i].src = (uint32_t)&UART0->DAT;
+        g_asRxDesc[i].dest = (uint32_t)&comRbuf[i * RXHALFSIZE];
+        g_asRxDesc[i].offset = (uint32_t)&g_asRxDesc[i ^ 1] - (PDMA->SCATBA);
+    }
+
+    comRbytes = 0;
+    comRhead = 0;
+    comRtail = 0;
+    s_u32RxHalf = 0;
+    s_u32RxPartial = 0;
+
+    /* Host may set a baud rate of 0. Keep the divisions below valid. */
+    u32Rate = gLineCoding.u32DTERate;
+    if(u32Rate == 0)
+        u32Rate = 1;
+
+    /* Time-out clock is HCLK/256 */
+    u32TimeOut = (SystemCoreClock >> 8) * VCOM_RX_IDLE_BITS / u32Rate + 1;
+    if(u32TimeOut > 0xFFFF)
+        u32TimeOut = 0xFFFF;
+
+    PDMA_Open(1 << VCOM_RX_PDMA_CH);
+    PDMA_SetTransferMode(VCOM_RX_PDMA_CH, PDMA_UART0_RX, TRUE, (uint32_t)&g_asRxDesc[0]);
+    PDMA_SetTimeOut(VCOM_RX_PDMA_CH, 1, u32TimeOut);
+    PDMA_EnableInt(VCOM_RX_PDMA_CH, PDMA_INT_TRANS_DONE);
+    PDMA_EnableInt(VCOM_RX_PDMA_CH, PDMA_INT_TIMEOUT);
+
+    UART0->INTEN |= UART_INTEN_RXPDMAEN_Msk;
+
+#if VCOM_IN_BATCH
+    /* A character is 10 bits */
+    u32FlushUs = 10 * EP2_MAX_PKT_SIZE * 1000000 / u32Rate;
+    if(u32FlushUs > VCOM_IN_FLUSH_MAX_US)
+        u32FlushUs = VCOM_IN_FLUSH_MAX_US;
+    if(u32FlushUs == 0)
+        u32FlushUs = 1;
+
+    TIMER_Open(TIMER0, TIMER_ONESHOT_MODE, 1000000 / u32FlushUs);
+    TIMER_EnableInt(TIMER0);
+    s_u8InFlushArmed = 0;
+    s_u8InFlush = 0;
+#endif
+}
+
+static void VCOM_RxDmaUpdate(uint32_t u32Bytes)
+{
+    /* u32Bytes is the number of bytes PDMA has put in the current half */
+    comRbytes += u32Bytes - s_u32RxPartial;
+    s_u32RxPartial = u32Bytes;
+    comRtail = (s_u32RxHalf * RXHALFSIZE + u32Bytes) % RXBUFSIZE;
+
+    if(comRbytes > RXBUFSIZE)
+    {
+        /* USB is too slow. The unsent data is overwritten, so the oldest data left starts at the tail. */
+        comRbytes = RXBUFSIZE;
+        comRhead = comRtail;
+        g_u32ComRxOverrun++;
+    }
+}
 
 /*---------------------------------------------------------------------------------------------------------*/
-/* UART Callback function                                                                                  */
+/* UART TX PDMA                                                                                            */
 /*---------------------------------------------------------------------------------------------------------*/
-void UART02_IRQHandler(void)
+void VCOM_TxDmaReset(void)
 {
-    uint32_t u32IntStatus;
-    uint8_t bInChar;
-    int32_t size;
+    /* Stop TX and drop the data not sent yet */
+    UART0->INTEN &= ~UART_INTEN_TXPDMAEN_Msk;
+    PDMA->RESET = (1 << VCOM_TX_PDMA_CH);
+    PDMA_CLR_TD_FLAG(1 << VCOM_TX_PDMA_CH);
+
+    s_u32TxDmaLen = 0;
+    RINGBUF_Init(&g_sComTx, comTbuf, TXBUFSIZE);
 
-    u32IntStatus = UART0->INTSTS;
+    PDMA_Open(1 << VCOM_TX_PDMA_CH);
+    PDMA_EnableInt(VCOM_TX_PDMA_CH, PDMA_INT_TRANS_DONE);
+}
+
+static void VCOM_TxDmaStart(void)
+{
+    uint32_t u32Len, u32Span, u32Ctl;
+    uint8_t *pu8Span;
 
-    if((u32IntStatus & 0x1 /* RDAIF */) || (u32IntStatus & 0x10 /* TOUT_IF */))
+    /* Send all data in comTbuf with one PDMA transfer */
+    u32Len = RINGBUF_GET_COUNT(&g_sComTx);
+    u32Span = RINGBUF_GetReadSpan(&g_sComTx, &pu8Span);
+    u32Ctl = PDMA_WIDTH_8 | PDMA_SAR_INC | PDMA_DAR_FIX | PDMA_REQ_SINGLE;
+
+    g_asTxDesc[0].src = (uint32_t)pu8Span;
+    g_asTxDesc[0].dest = (uint32_t)&UART0->DAT;
+
+    if(u32Len <= u32Span)
     {
-        /* Receiver FIFO threshold level is reached or RX time out */
+        g_asTxDesc[0].ctl = u32Ctl | ((u32Len - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_OP_BASIC;
+    }
+    else
+    {
+        /* Data wraps around. Chain the part at the beginning of comTbuf. */
+        g_asTxDesc[0].ctl = u32Ctl | ((u32Span - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_TBINTDIS_DISABLE | PDMA_OP_SCATTER;
+        g_asTxDesc[0].offset = (uint32_t)&g_asTxDesc[1] - (PDMA->SCATBA);
 
-        /* Get all the input characters */
-        while((UART0->FIFOSTS & UART_FIFOSTS_RXEMPTY_Msk) == 0)
-        {
-            /* Get the character from UART Buffer */
-            bInChar = UART0->DAT;
+        g_asTxDesc[1].ctl = u32Ctl | ((u32Len - u32Span - 1) << PDMA_DSCT_CTL_TXCNT_Pos) | PDMA_OP_BASIC;
+        g_asTxDesc[1].src = (uint32_t)&comTbuf[0];
+        g_asTxDesc[1].dest = (uint32_t)&UART0->DAT;
+    }
 
-            /* Check if buffer full */
-            if(comRbytes < RXBUFSIZE)
-            {
-                /* Enqueue the character */
-                comRbuf[comRtail++] = bInChar;
-                if(comRtail >= RXBUFSIZE)
-                    comRtail = 0;
-                comRbytes++;
-            }
-            else
-            {
-                /* FIFO over run */
-            }
-        }
+    s_u32TxDmaLen = u32Len;
+    PDMA_SetTransferMode(VCOM_TX_PDMA_CH, PDMA_UART0_TX, TRUE, (uint32_t)&g_asTxDesc[0]);
+    UART0->INTEN |= UART_INTEN_TXPDMAEN_Msk;
+}
+
+void PDMA_IRQHandler(void)
+{
+    uint32_t u32Status = PDMA_GET_INT_STATUS();
+    uint32_t u32Ctl;
+
+    if(u32Status & PDMA_INTSTS_ABTIF_Msk)
+    {
+        PDMA->ABTSTS = PDMA->ABTSTS;
     }
 
-    if(u32IntStatus & 0x2 /* THRE_IF */)
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << VCOM_TX_PDMA_CH)))
     {
+        /* All data of the transfer is in UART TX FIFO */
+        PDMA_CLR_TD_FLAG(1 << VCOM_TX_PDMA_CH);
 
-        if(comTbytes && (UART0->INTEN & UART_INTEN_THREIEN_Msk))
-        {
-            /* Fill the TX FIFO */
-            size = comTbytes;
-            if(size >= UART0_FIFO_SIZE)
-            {
-                size = UART0_FIFO_SIZE;
-            }
+        RINGBUF_CommitRead(&g_sComTx, s_u32TxDmaLen);
+        g_u32ComTxBytes += s_u32TxDmaLen;
+        g_u32ComTxIntCnt++;
+        s_u32TxDmaLen = 0;
 
-            while(size)
-            {
-                bInChar = comTbuf[comThead++];
-                UART0->DAT = bInChar;
-                if(comThead >= TXBUFSIZE)
-                    comThead = 0;
-                comTbytes--;
-                size--;
-            }
-        }
+        /* Send the data queued meanwhile */
+        if(!RINGBUF_IS_EMPTY(&g_sComTx))
+            VCOM_TxDmaStart();
         else
-        {
-            /* No more data, just stop TX (Stop work) */
-            UART0->INTEN &= (~UART_INTEN_THREIEN_Msk);
-        }
+            UART0->INTEN &= ~UART_INTEN_TXPDMAEN_Msk;
     }
 
+    if((u32Status & PDMA_INTSTS_TDIF_Msk) && (PDMA_GET_TD_STS() & (1 << VCOM_RX_PDMA_CH)))
+    {
+        /* A half is full. Reload its descriptor table and go on with the other half. */
+        PDMA_CLR_TD_FLAG(1 << VCOM_RX_PDMA_CH);
+
+        VCOM_RxDmaUpdate(RXHALFSIZE);
+        g_asRxDesc[s_u32RxHalf].ctl = s_u32RxDescCtl;
+        s_u32RxHalf ^= 1;
+        s_u32RxPartial = 0;
+    }
+
+    if(u32Status & (PDMA_INTSTS_REQTOF0_Msk << VCOM_RX_PDMA_CH))
+    {
+        /* UART RX is idle. Hand the bytes received so far in current half to USB. */
+        PDMA_CLR_TMOUT_FLAG(VCOM_RX_PDMA_CH);
+
+        u32Ctl = PDMA->DSCT[VCOM_RX_PDMA_CH].CTL;
+        if(u32Ctl & PDMA_DSCT_CTL_OPMODE_Msk)
+            VCOM_RxDmaUpdate(RXHALFSIZE - 1 - ((u32Ctl & PDMA_DSCT_CTL_TXCNT_Msk) >> PDMA_DSCT_CTL_TXCNT_Pos));
+
+        /* Restart time-out counter */
+        PDMA->TOUTEN &= ~(1 << VCOM_RX_PDMA_CH);
+        PDMA->TOUTEN |= (1 << VCOM_RX_PDMA_CH);
+    }
 }
 
+
+
+#if VCOM_IN_BATCH
+void TMR0_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(TIMER0);
+
+    /* Send the short packet held in comRbuf */
+    s_u8InFlush = 1;
+}
+#endif
+
 void VCOM_TransferData(void)
 {
     int32_t i, i32Len;
+    uint32_t u32Done;
+    uint8_t *pu8EpBuf, *pu8Span;
 
     /* Check whether USB is ready for next packet or not */
     if(gu32TxSize == 0)
     {
+#if VCOM_IN_BATCH
+        /* Hold a short packet until the flush time-out expires */
+        if(comRbytes && (comRbytes < EP2_MAX_PKT_SIZE) && !s_u8InFlush)
+        {
+            if(!s_u8InFlushArmed)
+            {
+                s_u8InFlushArmed = 1;
+                TIMER0->CNT = 0;
+                TIMER_Start(TIMER0);
+            }
+        }
+        else
+#endif
         /* Check whether we have new COM Rx data to send to USB or not */
         if(comRbytes)
         {
+#if VCOM_IN_BATCH
+            /* The packet is sent now. Restart the time-out for the data after it. */
+            TIMER_Stop(TIMER0);
+            TIMER_ClearIntFlag(TIMER0);
+            s_u8InFlushArmed = 0;
+            s_u8InFlush = 0;
+#endif
             i32Len = comRbytes;
             if(i32Len > EP2_MAX_PKT_SIZE)
                 i32Len = EP2_MAX_PKT_SIZE;
 
-            for(i = 0; i < i32Len; i++)
+            /* Fill the bulk IN buffer in USB SRAM directly from the UART ring. Copy the span up to the
+               end of the ring first, then the wrapped part. */
+            pu8EpBuf = USBD_AcquireEpBuf(EP2);
+            if(pu8EpBuf != NULL)
             {
-                gRxBuf[i] = comRbuf[comRhead++];
+                i = RXBUFSIZE - comRhead;
+                if(i > i32Len)
+                    i = i32Len;
+                USBD_MemCopy(pu8EpBuf, (uint8_t *)&comRbuf[comRhead], i);
+                if(i < i32Len)
+                    USBD_MemCopy(pu8EpBuf + i, (uint8_t *)&comRbuf[0], i32Len - i);
+
+                __set_PRIMASK(1);
+                comRhead += i32Len;
                 if(comRhead >= RXBUFSIZE)
-                    comRhead = 0;
+                    comRhead -= RXBUFSIZE;
+                comRbytes -= i32Len;
+                __set_PRIMASK(0);
+
+                gu32TxSize = i32Len;
+                USBD_ReleaseEpBuf(EP2, i32Len);
+                g_u32ComInPkts++;
+                g_u32ComInBytes += i32Len;
             }
-
-            __set_PRIMASK(1);
-            comRbytes -= i32Len;
-            __set_PRIMASK(0);
-
-            gu32TxSize = i32Len;
-            USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP2)), (uint8_t *)gRxBuf, i32Len);
-            USBD_SET_PAYLOAD_LEN(EP2, i32Len);
         }
         else
         {
@@ -242,47 +441,37 @@ void VCOM_TransferData(void)
                no more data to send at this moment to note Host the transfer has been done */
             i32Len = USBD_GET_PAYLOAD_LEN(EP2);
             if(i32Len == EP2_MAX_PKT_SIZE)
+            {
                 USBD_SET_PAYLOAD_LEN(EP2, 0);
+                g_u32ComInPkts++;
+            }
         }
     }
 
     /* Process the Bulk out data when bulk out data is ready. */
-    if(gi8BulkOutReady && (gu32RxSize <= TXBUFSIZE - comTbytes))
+    if(gi8BulkOutReady && (gu32RxSize <= RINGBUF_GET_FREE(&g_sComTx)))
     {
-        for(i = 0; i < gu32RxSize; i++)
+        /* Copy the packet to comTbuf. Copy the span up to the end of the ring first, then the wrapped part. */
+        for(u32Done = 0; u32Done < gu32RxSize; u32Done += i)
         {
-            comTbuf[comTtail++] = gpu8RxBuf[i];
-            if(comTtail >= TXBUFSIZE)
-                comTtail = 0;
+            i = RINGBUF_GetWriteSpan(&g_sComTx, &pu8Span);
+            if(i > gu32RxSize - u32Done)
+                i = gu32RxSize - u32Done;
+            USBD_MemCopy(pu8Span, (uint8_t *)gpu8RxBuf + u32Done, i);
+            RINGBUF_CommitWrite(&g_sComTx, i);
         }
 
-        __set_PRIMASK(1);
-        comTbytes += gu32RxSize;
-        __set_PRIMASK(0);
-
         gu32RxSize = 0;
         gi8BulkOutReady = 0; /* Clear bulk out ready flag */
 
         /* Ready to get next BULK out */
-        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+        USBD_ReleaseEpBuf(EP3, EP3_MAX_PKT_SIZE);
     }
 
-    /* Process the software TX FIFO */
-    if(comTbytes)
+    /* Process the software TX FIFO. PDMA_IRQHandler() goes on with the data queued during a transfer. */
+    if(!RINGBUF_IS_EMPTY(&g_sComTx) && (s_u32TxDmaLen == 0))
     {
-        /* Check if TX is working */
-        if((UART0->INTEN & UART_INTEN_THREIEN_Msk) == 0)
-        {
-            /* Send one bytes out */
-            UART0->DAT = comTbuf[comThead++];
-            if(comThead >= TXBUFSIZE)
-                comThead = 0;
-
-            comTbytes--;
-
-            /* Enable TX Empty Interrupt. (Trigger first one) */
-            UART0->INTEN |= UART_INTEN_THREIEN_Msk;
-        }
+        VCOM_TxDmaStart();
     }
 }
 
@@ -341,7 +530,13 @@ int32_t main(void)
     /* Clear SOF */
     USBD->INTSTS = USBD_INTSTS_SOFIF_Msk;
 
-    NVIC_EnableIRQ(UART02_IRQn);
+    /* Start to receive and transmit UART data by PDMA */
+    VCOM_RxDmaStart();
+    VCOM_TxDmaReset();
+    NVIC_EnableIRQ(PDMA_IRQn);
+#if VCOM_IN_BATCH
+    NVIC_EnableIRQ(TMR0_IRQn);
+#endif
 
     while(1)
     {
@@ -167,6 +167,8 @@ void EP2_Handler(void)
 
 void EP3_Handler(void)
 {
+    uint8_t *pu8Buf;
+
     /* Bulk OUT */
     if(g_u32OutToggle == (USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk))
     {
@@ -174,10 +176,16 @@ void EP3_Handler(void)
     }
     else
     {
+        g_u32OutToggle = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
+
+        /* The main loop still holds the last packet. Drop this one; its release re-arms EP3. */
+        pu8Buf = USBD_AcquireEpBuf(EP3);
+        if(pu8Buf == NULL)
+            return;
+
         gu32RxSize = USBD_GET_PAYLOAD_LEN(EP3);
-        gpu8RxBuf = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
+        gpu8RxBuf = pu8Buf;
 
-        g_u32OutToggle = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
         /* Set a flag to indicate bulk out ready */
         gi8BulkOutReady = 1;
     }
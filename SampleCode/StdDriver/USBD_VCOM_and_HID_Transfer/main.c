@@ -57,7 +57,6 @@ volatile uint16_t comTbytes = 0;
 volatile uint16_t comThead = 0;
 volatile uint16_t comTtail = 0;
 
-uint8_t gRxBuf[64] = {0};
 volatile uint8_t *gpu8RxBuf = 0;
 volatile uint32_t gu32RxSize = 0;
 volatile uint32_t gu32TxSize = 0;
@@ -220,6 +219,7 @@ void UART02_IRQHandler(void)
 void VCOM_TransferData(void)
 {
     int32_t i, i32Len;
+    uint8_t *pu8EpBuf;
 
     /* Check whether USB is ready for next packet or not */
     if(gu32TxSize == 0)
@@ -231,20 +231,24 @@ void VCOM_TransferData(void)
             if(i32Len > EP2_MAX_PKT_SIZE)
                 i32Len = EP2_MAX_PKT_SIZE;
 
-            for(i = 0; i < i32Len; i++)
+            /* Fill the bulk IN buffer in USB SRAM directly from the UART ring */
+            pu8EpBuf = USBD_AcquireEpBuf(EP2);
+            if(pu8EpBuf != NULL)
             {
-                gRxBuf[i] = comRbuf[comRhead++];
-                if(comRhead >= RXBUFSIZE)
-                    comRhead = 0;
+                for(i = 0; i < i32Len; i++)
+                {
+                    pu8EpBuf[i] = comRbuf[comRhead++];
+                    if(comRhead >= RXBUFSIZE)
+                        comRhead = 0;
+                }
+
+                __set_PRIMASK(1);
+                comRbytes -= i32Len;
+                __set_PRIMASK(0);
+
+                gu32TxSize = i32Len;
+                USBD_ReleaseEpBuf(EP2, i32Len);
             }
-
-            __set_PRIMASK(1);
-            comRbytes -= i32Len;
-            __set_PRIMASK(0);
-
-            gu32TxSize = i32Len;
-            USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP2)), (uint8_t *)gRxBuf, i32Len);
-            USBD_SET_PAYLOAD_LEN(EP2, i32Len);
         }
         else
         {
@@ -274,7 +278,7 @@ void VCOM_TransferData(void)
         gi8BulkOutReady = 0; /* Clear bulk out ready flag */
 
         /* Ready to get next BULK out */
-        USBD_SET_PAYLOAD_LEN(EP3, EP3_MAX_PKT_SIZE);
+        USBD_ReleaseEpBuf(EP3, EP3_MAX_PKT_SIZE);
     }
 
     /* Process the software Tx FIFO */
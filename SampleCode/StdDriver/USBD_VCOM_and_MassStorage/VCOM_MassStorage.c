@@ -44,6 +44,7 @@ uint32_t g_u32LbaAddress;
 uint32_t g_u32BytesInStorageBuf;
 
 uint32_t g_u32BulkBuf0, g_u32BulkBuf1;
+S_USBD_BULK_PP_T g_sBulkPP;
 
 uint32_t volatile g_u32CbwStall = 1;
 
@@ -259,6 +260,8 @@ void EP2_Handler(void)
 
 void EP3_Handler(void)
 {
+    uint8_t *pu8Buf;
+
     /* Bulk OUT */
     if(g_u32OutToggle0 == (USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk))
     {
@@ -266,10 +269,16 @@ void EP3_Handler(void)
     }
     else
     {
+        g_u32OutToggle0 = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
+
+        /* The main loop still holds the last packet. Drop this one; its release re-arms EP3. */
+        pu8Buf = USBD_AcquireEpBuf(EP3);
+        if(pu8Buf == NULL)
+            return;
+
         gu32RxSize = USBD_GET_PAYLOAD_LEN(EP3);
-        gpu8RxBuf = (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3));
+        gpu8RxBuf = pu8Buf;
 
-        g_u32OutToggle0 = USBD->EPSTS & USBD_EPSTS_EPSTS3_Msk;
         /* Set a flag to indicate bulk out ready */
         gi8BulkOutReady = 1;
     }
@@ -301,6 +310,23 @@ void EP6_Handler(void)
 }
 
 
+static void MSC_FillPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the next bulk IN packet from storage buffer to USB SRAM */
+    USBD_MemCopy(pu8Buf, (uint8_t *)g_u32Address, u32Size);
+    g_u32Address += u32Size;
+}
+
+static void MSC_DrainPacket(uint8_t *pu8Buf, uint32_t u32Size)
+{
+    /* Copy the received bulk OUT packet from USB SRAM to storage buffer */
+    if(u32Size > g_u32Length)
+        u32Size = g_u32Length;
+
+    USBD_MemCopy((uint8_t *)g_u32Address, pu8Buf, u32Size);
+    g_u32Address += u32Size;
+}
+
 void VCOM_MSC_Init(void)
 {
     /* Init setup packet buffer */
@@ -352,6 +378,7 @@ void VCOM_MSC_Init(void)
     /*****************************************************/
     g_u32BulkBuf0 = EP6_BUF_BASE;
     g_u32BulkBuf1 = EP7_BUF_BASE;
+    USBD_BulkPPInit(&g_sBulkPP, EP7, EP6, g_u32BulkBuf0, g_u32BulkBuf1, EP6_MAX_PKT_SIZE, MSC_FillPacket, MSC_DrainPacket);
 
     g_sCSW.dCSWSignature = CSW_SIGNATURE;
     g_TotalSectors = DATA_FLASH_STORAGE_SIZE / UDC_SECTOR_SIZE;
@@ -639,13 +666,8 @@ void MSC_Read(void)
 {
     uint32_t u32Len;
 
-    if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-        USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
-    else
-        USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf1);
-
-    /* Trigger to send out the data packet */
-    USBD_SET_PAYLOAD_LEN(EP7, g_u8Size);
+    /* Trigger to send out the data packet prepared in the idle buffer */
+    USBD_BulkPPTrigIn(&g_sBulkPP);
 
     g_u32Length -= g_u8Size;
     g_u32BytesInStorageBuf -= g_u8Size;
@@ -659,11 +681,7 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
         else
         {
@@ -681,11 +699,7 @@ void MSC_Read(void)
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
     }
 }
@@ -696,54 +710,33 @@ void MSC_ReadTrig(void)
 
     if(g_u32Length)
     {
-        if(g_u32BytesInStorageBuf)
-        {
-            /* Prepare next data packet */
-            g_u8Size = EP7_MAX_PKT_SIZE;
-            if(g_u8Size > g_u32Length)
-                g_u8Size = g_u32Length;
+        /* Trigger to send out the data packet prepared in the idle buffer */
+        USBD_BulkPPTrigIn(&g_sBulkPP);
 
-            if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
-        }
-        else
+        g_u32Length -= g_u8Size;
+        g_u32BytesInStorageBuf -= g_u8Size;
+
+        if(g_u32Length)
         {
-            u32Len = g_u32Length;
-            if(u32Len > STORAGE_BUFFER_SIZE)
-                u32Len = STORAGE_BUFFER_SIZE;
+            if(g_u32BytesInStorageBuf == 0)
+            {
+                u32Len = g_u32Length;
+                if(u32Len > STORAGE_BUFFER_SIZE)
+                    u32Len = STORAGE_BUFFER_SIZE;
 
-            MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_DATA_BUF);
-            g_u32BytesInStorageBuf = u32Len;
-            g_u32LbaAddress += u32Len;
-            g_u32Address = STORAGE_DATA_BUF;
+                MSC_ReadMedia(g_u32LbaAddress, u32Len, (uint8_t *)STORAGE_DATA_BUF);
+                g_u32BytesInStorageBuf = u32Len;
+                g_u32LbaAddress += u32Len;
+                g_u32Address = STORAGE_DATA_BUF;
+            }
 
-            /* Prepare next data packet */
+            /* Prepare next data packet while the current one is on the bus */
             g_u8Size = EP7_MAX_PKT_SIZE;
             if(g_u8Size > g_u32Length)
                 g_u8Size = g_u32Length;
 
-            if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), (uint8_t *)g_u32Address, g_u8Size);
-            else
-                USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-            g_u32Address += g_u8Size;
+            USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
         }
-
-        /* DATA0/DATA1 Toggle */
-        if(USBD_GET_EP_BUF_ADDR(EP7) == g_u32BulkBuf1)
-            USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
-        else
-            USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf1);
-
-        /* Trigger to send out the data packet */
-        USBD_SET_PAYLOAD_LEN(EP7, g_u8Size);
-
-        g_u32Length -= g_u8Size;
-        g_u32BytesInStorageBuf -= g_u8Size;
-
     }
     else
         USBD_SET_PAYLOAD_LEN(EP7, 0);
@@ -869,20 +862,8 @@ void MSC_Write(void)
     {
         if(g_u32Length > EP6_MAX_PKT_SIZE)
         {
-            if(USBD_GET_EP_BUF_ADDR(EP6) == g_u32BulkBuf0)
-            {
-                USBD_SET_EP_BUF_ADDR(EP6, g_u32BulkBuf1);
-                USBD_SET_PAYLOAD_LEN(EP6, EP6_MAX_PKT_SIZE);
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), EP6_MAX_PKT_SIZE);
-            }
-            else
-            {
-                USBD_SET_EP_BUF_ADDR(EP6, g_u32BulkBuf0);
-                USBD_SET_PAYLOAD_LEN(EP6, EP6_MAX_PKT_SIZE);
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), EP6_MAX_PKT_SIZE);
-            }
-
-            g_u32Address += EP6_MAX_PKT_SIZE;
+            /* Arm the other buffer for the next packet, then drain this one */
+            USBD_BulkPPRecvOut(&g_sBulkPP, 1);
             g_u32Length -= EP6_MAX_PKT_SIZE;
 
             /* Buffer full. Writer it to storage first. */
@@ -896,11 +877,8 @@ void MSC_Write(void)
         }
         else
         {
-            if(USBD_GET_EP_BUF_ADDR(EP6) == g_u32BulkBuf0)
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf0), g_u32Length);
-            else
-                USBD_MemCopy((uint8_t *)g_u32Address, (uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), g_u32Length);
-            g_u32Address += g_u32Length;
+            /* Last packet. Bulk OUT stays idle until the CSW is sent */
+            USBD_BulkPPRecvOut(&g_sBulkPP, 0);
             g_u32Length = 0;
 
 
@@ -1066,11 +1044,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     return;
@@ -1092,11 +1068,9 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32Length;
 
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     return;
@@ -1149,12 +1123,9 @@ void MSC_ProcessCmd(void)
                             g_u8Size = EP7_MAX_PKT_SIZE;
                         else
                             g_u8Size = g_u32Length;
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-
-                        g_u32Address += g_u8Size;
-
+                        /* Prepare the first packet in the idle buffer, so MSC_Read() sends it with its size */
                         USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
                         MSC_Read();
                     }
                     return;
@@ -1259,17 +1230,12 @@ void MSC_ProcessCmd(void)
                         else
                             g_u8Size = g_u32BytesInStorageBuf;
 
-                        /* Prepare the first data packet (DATA1) */
-                        /* Bulk IN buffer */
-                        USBD_MemCopy((uint8_t *)((uint32_t)USBD_BUF_BASE + g_u32BulkBuf1), (uint8_t *)g_u32Address, g_u8Size);
-                        g_u32Address += g_u8Size;
-
-                        /* kick - start */
-                        USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf1);
-                        /* Trigger to send out the data packet */
-                        USBD_SET_PAYLOAD_LEN(EP7, g_u8Size);
-                        g_u32Length -= g_u8Size;
-                        g_u32BytesInStorageBuf -= g_u8Size;
+                        /* Prepare the first data packet (DATA1) in the idle buffer */
+                        USBD_SET_EP_BUF_ADDR(EP7, g_u32BulkBuf0);
+                        USBD_BulkPPPrepareIn(&g_sBulkPP, g_u8Size);
+
+                        /* kick - start. The next packet is prepared in the other buffer while this one is on the bus */
+                        MSC_ReadTrig();
                     }
                     return;
                 }
@@ -0,0 +1,49 @@
+/**************************************************************************//**
+ * @file     host.h
+ * @version  V3.00
+ * @brief    Common header of the host checks
+ *
+ * @note     The checks build target sources with the host compiler. Functions of a source that
+ *           touch the peripherals are not called, and are dropped by the linker.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The CMSIS barrier and interrupt mask are Cortex-M instructions. Rename them and use host ones instead.
+   ringbuf.h is held back until then, because its inline functions use the barrier. */
+#define __DMB           __DMB_Target
+#define __set_PRIMASK   __set_PRIMASK_Target
+#define __RINGBUF_H__
+#include "NUC1261.h"
+#undef __DMB
+#undef __set_PRIMASK
+#undef __RINGBUF_H__
+#define __DMB()             __sync_synchronize()
+#define __set_PRIMASK(x)    ((void)(x))
+#include "ringbuf.h"
+
+static int s_i32HostFail = 0;
+
+/* Report a failed check and go on, so one run shows all failures */
+#define CHECK(expr)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if(!(expr))                                                         \
+        {                                                                   \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            s_i32HostFail++;                                                \
+        }                                                                   \
+    } while(0)
+
+/* Exit code of a check program */
+#define HOST_RESULT()                                                       \
+    (printf("%s: %s\n", __FILE__, s_i32HostFail ? "FAIL" : "PASS"), s_i32HostFail ? 1 : 0)
+
+#endif /* __HOST_H__ */
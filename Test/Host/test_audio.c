@@ -0,0 +1,241 @@
+/**************************************************************************//**
+ * @file     test_audio.c
+ * @version  V3.00
+ * @brief    Host check of the play resampler and the software mixer of USBD_Audio_NAU8822
+ *
+ * @note     Built with UAC_PLAY_SYNC = UAC_SYNC_RESAMPLE and UAC_SW_MIXER = 1. The kernels are compared
+ *           with a plain 64-bit implementation of the same arithmetic.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include "host.h"
+#include "usbd_audio.h"
+
+#undef UAC_PLAY_SYNC
+#undef UAC_SW_MIXER
+#define UAC_PLAY_SYNC   UAC_SYNC_RESAMPLE
+#define UAC_SW_MIXER    1
+
+#include "usbd_audio.c"
+
+#define FILL_LEN        1000
+#define RING_LEN        (BUF_LEN)
+
+static int32_t s_ai32In[FILL_LEN][PLAY_CHANNELS];
+
+/* Arithmetic shift of a signed 64-bit value, rounded to minus infinity */
+static int32_t Floor15(int64_t i64Val)
+{
+    return (int32_t)((i64Val >= 0) ? (i64Val >> 15) : -((-i64Val + 0x7FFF) >> 15));
+}
+
+static int32_t Clip24(int32_t i32Val)
+{
+    return (i32Val > 0x7FFFFF) ? 0x7FFFFF : (i32Val < -0x800000) ? -0x800000 : i32Val;
+}
+
+/*---------------------------------------------------------------------------------------------------------*/
+/*  Resampler                                                                                              */
+/*---------------------------------------------------------------------------------------------------------*/
+/* Output k is at (k + 1) * step. The 4 taps are the 4 input samples before that position. */
+static int32_t RefResample(uint32_t u32Step, uint32_t k, uint32_t j)
+{
+    uint64_t u64Pos = (uint64_t)(k + 1) * u32Step;
+    int32_t n = (int32_t)(u64Pos >> 24), i, x;
+    const int16_t *pi16Coef = s_ai16RsCoef[(u64Pos & (UAC_RS_ONE - 1)) >> 19];
+    int64_t i64Acc = 0;
+
+    for(i = 0; i < 4; i++)
+    {
+        x = ((n - 4 + i) >= 0) && ((n - 4 + i) < FILL_LEN) ? s_ai32In[n - 4 + i][j] : 0;
+        i64Acc += (int64_t)pi16Coef[i] * x;
+    }
+
+    return Clip24(Floor15(i64Acc + 0x4000));
+}
+
+static void CheckResample(uint32_t u32Step, uint32_t u32Start, int32_t i32Amp)
+{
+    uint32_t au32Out[PLAY_CHANNELS];
+    uint32_t i, j, k, u32Err = 0, u32Count;
+
+    /* Random data. Full scale data makes the filter overshoot, so the output is clipped. */
+    for(i = 0; i < FILL_LEN; i++)
+        for(j = 0; j < PLAY_CHANNELS; j++)
+            s_ai32In[i][j] = (int32_t)((uint32_t)rand() << 8) / 256 % i32Amp;
+
+    /* The samples start near the ring end, so the ring wraps around */
+    for(i = 0; i < FILL_LEN; i++)
+        for(j = 0; j < PLAY_CHANNELS; j++)
+            g_au32PcmPlayBuf[((u32Start + i) % RING_LEN) * PLAY_CHANNELS + j] = (uint32_t)s_ai32In[i][j] << 8;
+
+    s_u32PlayBufLen = RING_LEN;
+    g_u32PlayPos_Out = u32Start;
+    g_u32PlayPos_In = (u32Start + FILL_LEN) % RING_LEN;
+    g_u8PlayEn = 1;
+    g_u32PlayUnderrun = 0;
+    s_u32RsStep = u32Step;
+    s_u32RsPos = 0;
+    memset(s_au32RsHist, 0, sizeof(s_au32RsHist));
+
+    /* Until the input runs out, and a few samples more to play the silence after underrun */
+    u32Count = (uint32_t)(((uint64_t)FILL_LEN << 24) / u32Step) + 8;
+    for(k = 0; k < u32Count; k++)
+    {
+        UAC_ResampleNext(au32Out);
+
+        for(j = 0; j < PLAY_CHANNELS; j++)
+        {
+            if((au32Out[j] & 0xFF) || ((int32_t)au32Out[j] >> 8 != RefResample(u32Step, k, j)))
+                u32Err++;
+        }
+    }
+
+    CHECK(u32Err == 0);
+    CHECK(g_u8PlayEn == 0);
+    CHECK(g_u32PlayUnderrun == 1);
+    CHECK(g_u32PlayPos_Out == g_u32PlayPos_In);
+}
+
+/*---------------------------------------------------------------------------------------------------------*/
+/*  Mixer                                                                                                  */
+/*---------------------------------------------------------------------------------------------------------*/
+static int32_t RefMix(int32_t i32In, int32_t i32Gain, int32_t i32Mic)
+{
+    int32_t i32Out = Floor15((int64_t)i32In * i32Gain) + Floor15((int64_t)i32Mic * UAC_MIX_SIDETONE);
+
+    if(i32Out > UAC_MIX_KNEE)
+        i32Out = UAC_MIX_KNEE + ((i32Out - UAC_MIX_KNEE) >> 2);
+    else if(i32Out < -UAC_MIX_KNEE)
+        i32Out = -UAC_MIX_KNEE + ((i32Out + UAC_MIX_KNEE) >> 2);
+
+    return Clip24(i32Out);
+}
+
+/* MixMul() floors the 2 partial products, so it could be 1 less than the exact product.
+   The sum of 2 products could be 2 less. */
+static int32_t MixErr(uint32_t u32Out, int32_t i32Ref)
+{
+    return i32Ref - ((int32_t)u32Out >> 8);
+}
+
+static void SetGain(int32_t i32Gain)
+{
+    uint32_t j;
+
+    for(j = 0; j < PLAY_CHANNELS; j++)
+    {
+        s_asMixCh[j].i32Next = s_asMixCh[j].i32Target = s_asMixCh[j].i32Gain = i32Gain;
+        s_asMixCh[j].i32Last = 0;
+        s_asMixCh[j].u32ZcWait = 0;
+    }
+}
+
+#define MIX_LEN     48
+
+static void CheckMix(void)
+{
+    uint32_t au32Src[MIX_LEN * PLAY_CHANNELS], au32Dst[MIX_LEN * PLAY_CHANNELS];
+    uint32_t i, n, u32Err;
+    int32_t i32Gain, i32In, i32Mic;
+
+    g_u8RecEn = 0;
+
+    /* Steady gain over the whole range of the input, including the soft clipper */
+    for(i32Gain = 0; i32Gain <= 32767; i32Gain += 4681)
+    {
+        SetGain(i32Gain);
+        u32Err = 0;
+        for(n = 0; n < 1000; n++)
+        {
+            for(i = 0; i < MIX_LEN * PLAY_CHANNELS; i++)
+                au32Src[i] = (uint32_t)rand() << 8;
+            UAC_MixBlock(au32Dst, au32Src, MIX_LEN);
+
+            for(i = 0; i < MIX_LEN * PLAY_CHANNELS; i++)
+            {
+                if((au32Dst[i] & 0xFF) || (MixErr(au32Dst[i], RefMix((int32_t)au32Src[i] >> 8, i32Gain, 0)) > 1)
+                        || (MixErr(au32Dst[i], RefMix((int32_t)au32Src[i] >> 8, i32Gain, 0)) < 0))
+                    u32Err++;
+            }
+        }
+        CHECK(u32Err == 0);
+    }
+
+    /* Full scale stays in range and a full scale input is not clipped hard */
+    SetGain(32767);
+    au32Src[0] = 0x7FFFFF00;
+    au32Src[1] = 0x80000000;
+    UAC_MixBlock(au32Dst, au32Src, 1);
+    CHECK(((int32_t)au32Dst[0] >> 8) > UAC_MIX_KNEE && ((int32_t)au32Dst[0] >> 8) < 0x7FFFFF);
+    CHECK(((int32_t)au32Dst[1] >> 8) < -UAC_MIX_KNEE && ((int32_t)au32Dst[1] >> 8) > -0x800000);
+
+    /* Mute is taken at the zero cross, then ramped to. The mixing is in place. */
+    SetGain(32767);
+    for(i = 0; i < PLAY_CHANNELS; i++)
+        s_asMixCh[i].i32Next = 0;
+    for(i = 0; i < MIX_LEN; i++)
+    {
+        au32Src[i * PLAY_CHANNELS] = (uint32_t)((i < 10) ? 0x100000 : -0x100000) << 8;
+        au32Src[i * PLAY_CHANNELS + 1] = 0x100000 << 8;
+    }
+    UAC_MixBlock(au32Src, au32Src, MIX_LEN);
+    CHECK(s_asMixCh[0].i32Target == 0);
+    CHECK(s_asMixCh[0].i32Gain == 32767 - (MIX_LEN - 10) * UAC_MIX_RAMP_STEP);
+    CHECK(s_asMixCh[1].i32Target == 32767);
+    CHECK(s_asMixCh[1].i32Gain == 32767);
+
+    /* Without a zero cross the new gain is taken after UAC_MIX_ZC_TIMEOUT samples */
+    for(n = MIX_LEN; n < UAC_MIX_ZC_TIMEOUT; n += MIX_LEN)
+    {
+        for(i = 0; i < MIX_LEN * PLAY_CHANNELS; i++)
+            au32Src[i] = 0x100000 << 8;
+        UAC_MixBlock(au32Dst, au32Src, MIX_LEN);
+    }
+    CHECK(s_asMixCh[1].i32Target == 0);
+    CHECK(s_asMixCh[1].i32Gain == 32767 - (n - UAC_MIX_ZC_TIMEOUT + 1) * UAC_MIX_RAMP_STEP);
+
+    /* Ramp ends at the target */
+    for(n = 0; n < 32768 / UAC_MIX_RAMP_STEP / MIX_LEN + 1; n++)
+        UAC_MixBlock(au32Dst, au32Src, MIX_LEN);
+    CHECK((s_asMixCh[0].i32Gain == 0) && (s_asMixCh[1].i32Gain == 0));
+    CHECK((au32Dst[0] == 0) && (au32Dst[MIX_LEN * PLAY_CHANNELS - 1] == 0));
+
+    /* Sidetone is the last record block when record runs at the same block length */
+    SetGain(32767);
+    g_u8RecEn = 1;
+    s_u32RecBlkLen = MIX_LEN;
+    s_u32RecBufLen = MIX_LEN * REC_BLK_NUM;
+    g_u32RecPos_In = 0;
+    for(i = 0; i < s_u32RecBufLen * REC_CHANNELS; i++)
+        g_au32PcmRecBuf[i] = (uint32_t)rand() << 8;
+    u32Err = 0;
+    for(i = 0; i < MIX_LEN * PLAY_CHANNELS; i++)
+        au32Src[i] = (uint32_t)rand() << 8;
+    UAC_MixBlock(au32Dst, au32Src, MIX_LEN);
+    for(i = 0; i < MIX_LEN * PLAY_CHANNELS; i++)
+    {
+        i32In = (int32_t)au32Src[i] >> 8;
+        i32Mic = (int32_t)g_au32PcmRecBuf[(s_u32RecBufLen - MIX_LEN) * REC_CHANNELS + i] >> 8;
+        if((MixErr(au32Dst[i], RefMix(i32In, 32767, i32Mic)) > 2) || (MixErr(au32Dst[i], RefMix(i32In, 32767, i32Mic)) < 0))
+            u32Err++;
+    }
+    CHECK(u32Err == 0);
+    g_u8RecEn = 0;
+}
+
+int main(void)
+{
+    srand(1);
+
+    CheckResample(UAC_RS_ONE, 0, 0x800000);
+    CheckResample(UAC_RS_ONE, RING_LEN - 100, 0x400000);
+    CheckResample(UAC_RS_ONE + UAC_RS_MAX_ADJ, RING_LEN - 1, 0x800000);
+    CheckResample(UAC_RS_ONE - UAC_RS_MAX_ADJ, 7, 0x800000);
+    CheckResample((uint32_t)((uint64_t)UAC_RS_ONE * 44100 / 48000), 500, 0x800000);
+
+    CheckMix();
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,133 @@
+/**************************************************************************//**
+ * @file     test_crc32.c
+ * @version  V3.00
+ * @brief    Host check that the CRC controller settings of the ISP page verify give the CRC32 of Host
+ *
+ * @note     isp_user.c verifies a page by comparing its FMC checksum with the CRC controller result.
+ *           Host compares the FMC checksum with the common CRC32 of the image. This checks a bit level
+ *           model of the CRC controller, as described in the TRM, with the settings of PageCrcStart()
+ *           against the common CRC32. It is a check of the model, not of the hardware.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include "host.h"
+
+/* Settings of PageCrcStart() */
+#define ISP_CRC_CTL     (CRC_CTL_CRCEN_Msk | CRC_32 | CRC_CPU_WDATA_32 | CRC_WDATA_RVS | CRC_CHECKSUM_RVS | CRC_CHECKSUM_COM)
+
+static uint32_t BitRev(uint32_t u32Data, uint32_t u32Bits)
+{
+    uint32_t i, u32Rev = 0;
+
+    for(i = 0; i < u32Bits; i++)
+        u32Rev |= ((u32Data >> i) & 1) << (u32Bits - 1 - i);
+
+    return u32Rev;
+}
+
+/*---------------------------------------------------------------------------------------------------------*/
+/*  CRC controller model in CRC32 mode. The shift register runs MSB first from the seed.                   */
+/*  The bytes of a 32-bit write are taken from byte 0, each reversed by WDATA_RVS.                         */
+/*  The checksum is reversed by CHECKSUM_RVS and complemented by CHECKSUM_COM.                             */
+/*---------------------------------------------------------------------------------------------------------*/
+typedef struct
+{
+    uint32_t u32Ctl;
+    uint32_t u32Reg;
+} CRC_MODEL_T;
+
+static void ModelStart(CRC_MODEL_T *psCrc, uint32_t u32Ctl, uint32_t u32Seed)
+{
+    psCrc->u32Ctl = u32Ctl;
+    psCrc->u32Reg = u32Seed;
+}
+
+static void ModelWrite(CRC_MODEL_T *psCrc, uint32_t u32Data)
+{
+    uint32_t i, j, u32Byte;
+
+    for(i = 0; i < 4; i++)
+    {
+        u32Byte = (u32Data >> (i * 8)) & 0xFF;
+        if(psCrc->u32Ctl & CRC_WDATA_RVS)
+            u32Byte = BitRev(u32Byte, 8);
+
+        for(j = 0; j < 8; j++)
+        {
+            if(((psCrc->u32Reg >> 31) ^ (u32Byte >> (7 - j))) & 1)
+                psCrc->u32Reg = (psCrc->u32Reg << 1) ^ 0x04C11DB7;
+            else
+                psCrc->u32Reg <<= 1;
+        }
+    }
+}
+
+static uint32_t ModelChecksum(CRC_MODEL_T *psCrc)
+{
+    uint32_t u32Sum = psCrc->u32Reg;
+
+    if(psCrc->u32Ctl & CRC_CHECKSUM_RVS)
+        u32Sum = BitRev(u32Sum, 32);
+    if(psCrc->u32Ctl & CRC_CHECKSUM_COM)
+        u32Sum = ~u32Sum;
+
+    return u32Sum;
+}
+
+/* Common CRC32 of Host, e.g. zlib crc32() */
+static uint32_t RefCrc32(const uint8_t *pu8Buf, uint32_t u32Len)
+{
+    uint32_t i, u32Crc = 0xFFFFFFFF;
+
+    while(u32Len--)
+    {
+        u32Crc ^= *pu8Buf++;
+        for(i = 0; i < 8; i++)
+            u32Crc = (u32Crc >> 1) ^ ((u32Crc & 1) ? 0xEDB88320 : 0);
+    }
+
+    return ~u32Crc;
+}
+
+int main(void)
+{
+    static uint8_t au8Page[FMC_FLASH_PAGE_SIZE];
+    CRC_MODEL_T sCrc;
+    uint32_t i, u32Addr, u32End;
+
+    CHECK(RefCrc32((const uint8_t *)"123456789", 9) == 0xCBF43926);
+
+    /* A page programmed from u32Addr to u32End. The data before u32Addr is added from the page first,
+       as PageCrcStart() does, and the erased rest after u32End as VerifyPage() does. */
+    srand(1);
+    for(u32Addr = 0; u32Addr < FMC_FLASH_PAGE_SIZE; u32Addr += 4 * 37)
+    {
+        for(u32End = u32Addr + 4; u32End <= FMC_FLASH_PAGE_SIZE; u32End += 4 * 53)
+        {
+            for(i = 0; i < FMC_FLASH_PAGE_SIZE; i++)
+                au8Page[i] = (i < u32End) ? (uint8_t)rand() : 0xFF;
+
+            ModelStart(&sCrc, ISP_CRC_CTL, 0xFFFFFFFF);
+            for(i = 0; i < u32End; i += 4)
+                ModelWrite(&sCrc, au8Page[i] | (au8Page[i + 1] << 8) | (au8Page[i + 2] << 16) | ((uint32_t)au8Page[i + 3] << 24));
+            for(; i < FMC_FLASH_PAGE_SIZE; i += 4)
+                ModelWrite(&sCrc, 0xFFFFFFFF);
+
+            CHECK(ModelChecksum(&sCrc) == RefCrc32(au8Page, FMC_FLASH_PAGE_SIZE));
+        }
+    }
+
+    /* Each of the reverse and complement settings is needed */
+    ModelStart(&sCrc, ISP_CRC_CTL & ~CRC_WDATA_RVS, 0xFFFFFFFF);
+    for(i = 0; i < FMC_FLASH_PAGE_SIZE; i += 4)
+        ModelWrite(&sCrc, inpw(&au8Page[i]));
+    CHECK(ModelChecksum(&sCrc) != RefCrc32(au8Page, FMC_FLASH_PAGE_SIZE));
+
+    ModelStart(&sCrc, ISP_CRC_CTL & ~CRC_CHECKSUM_COM, 0xFFFFFFFF);
+    for(i = 0; i < FMC_FLASH_PAGE_SIZE; i += 4)
+        ModelWrite(&sCrc, inpw(&au8Page[i]));
+    CHECK(ModelChecksum(&sCrc) == ~RefCrc32(au8Page, FMC_FLASH_PAGE_SIZE));
+
+    return HOST_RESULT();
+}
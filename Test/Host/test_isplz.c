@@ -0,0 +1,240 @@
+/**************************************************************************//**
+ * @file     test_isplz.c
+ * @version  V3.00
+ * @brief    Host check of the CMD_UPDATE_APROM_LZ decoder of the ISP loader
+ *
+ * @note     Build with ISP_MULTI_WORD and ISP_LZ. The update packets go through ParseCmd() of ISP_SPI
+ *           to a flash image in RAM. The CRC controller is a plain struct here, so the page verify
+ *           always passes. The CRC settings are checked by test_crc32.c.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include "host.h"
+#include "isp_user.h"
+
+#undef CRC
+static CRC_T s_sCrc;
+#define CRC     (&s_sCrc)
+
+#include "isp_user.c"
+
+#define FLASH_SIZE      (64 * 1024)
+#define IMAGE_MAX       (8 * 1024)
+#define PKT_SIZE        64
+
+static uint8_t s_au8Flash[FLASH_SIZE];
+
+/*---------------------------------------------------------------------------------------------------------*/
+/*  Flash of fmc_user.c                                                                                    */
+/*---------------------------------------------------------------------------------------------------------*/
+int EraseAP(unsigned int addr_start, unsigned int size)
+{
+    if(addr_start < FLASH_SIZE)
+        memset(&s_au8Flash[addr_start], 0xFF, (size < FLASH_SIZE - addr_start) ? size : FLASH_SIZE - addr_start);
+
+    return 0;
+}
+
+void UpdateConfig(unsigned int *data, unsigned int *res)
+{
+}
+
+void ReadData(unsigned int addr_start, unsigned int addr_end, unsigned int *data)
+{
+    /* CONFIG0 of an unlocked chip */
+    if(addr_start == Config0)
+    {
+        data[0] = data[1] = 0xFFFFFFFF;
+        return;
+    }
+
+    memcpy(data, &s_au8Flash[addr_start], addr_end - addr_start);
+}
+
+int WriteData(unsigned int addr_start, unsigned int addr_end, unsigned int *data)
+{
+    uint8_t *pu8Data = (uint8_t *)data;
+
+    /* Programming only clears bits */
+    for(; addr_start < addr_end; addr_start++)
+        s_au8Flash[addr_start] &= *pu8Data++;
+
+    return 0;
+}
+
+int FMC_Erase_User(unsigned int u32Addr)
+{
+    return EraseAP(u32Addr, FMC_FLASH_PAGE_SIZE);
+}
+
+void GetDataFlashInfo(uint32_t *addr, uint32_t *size)
+{
+    *addr = g_dataFlashAddr;
+    *size = g_dataFlashSize;
+}
+
+int FMC_GetCheckSum_User(unsigned int u32Addr, unsigned int u32Size, unsigned int *data)
+{
+    *data = CRC->CHECKSUM;
+    return 0;
+}
+
+/*---------------------------------------------------------------------------------------------------------*/
+/*  Encoder of the stream format in isp_user.h                                                             */
+/*---------------------------------------------------------------------------------------------------------*/
+static uint32_t LzEncode(const uint8_t *pu8In, uint32_t u32Len, uint8_t *pu8Out)
+{
+    uint32_t u32Pos = 0, u32Out = 0, u32Flag = 0, u32Item = 8;
+    uint32_t u32Off, u32Best, u32BestOff, n;
+
+    while(u32Pos < u32Len)
+    {
+        if(u32Item == 8)
+        {
+            u32Flag = u32Out++;
+            pu8Out[u32Flag] = 0;
+            u32Item = 0;
+        }
+
+        /* Longest match in the window. The first one found wins. */
+        u32Best = 0;
+        u32BestOff = 0;
+        for(u32Off = 1; (u32Off <= LZ_WIN_SIZE) && (u32Off <= u32Pos); u32Off++)
+        {
+            for(n = 0; (n < 66) && (u32Pos + n < u32Len) && (pu8In[u32Pos + n] == pu8In[u32Pos + n - u32Off]); n++);
+            if(n > u32Best)
+            {
+                u32Best = n;
+                u32BestOff = u32Off;
+            }
+        }
+
+        if(u32Best >= 3)
+        {
+            n = ((u32BestOff - 1) << 6) | (u32Best - 3);
+            pu8Out[u32Out++] = (uint8_t)n;
+            pu8Out[u32Out++] = (uint8_t)(n >> 8);
+            u32Pos += u32Best;
+        }
+        else
+        {
+            pu8Out[u32Flag] |= 1 << u32Item;
+            pu8Out[u32Out++] = pu8In[u32Pos++];
+        }
+        u32Item++;
+    }
+
+    return u32Out;
+}
+
+/* Send the update by 64-byte packets as Host does. Return the checksum error of the last response. */
+static int SendUpdate(uint32_t u32OutLen, const uint8_t *pu8Stream, uint32_t u32Len)
+{
+    uint8_t au8Pkt[PKT_SIZE];
+    uint32_t n, u32Hdr = 16;
+    uint16_t u16Sum;
+
+    /* Flash left from the last update must be erased by the command */
+    memset(s_au8Flash, 0x5A, sizeof(s_au8Flash));
+
+    memset(au8Pkt, 0, sizeof(au8Pkt));
+    outpw(au8Pkt, CMD_UPDATE_APROM_LZ);
+    outpw(au8Pkt + 8, u32OutLen);
+    outpw(au8Pkt + 12, u32Len);
+
+    do
+    {
+        n = (u32Len < PKT_SIZE - u32Hdr) ? u32Len : PKT_SIZE - u32Hdr;
+        memcpy(au8Pkt + u32Hdr, pu8Stream, n);
+        pu8Stream += n;
+        u32Len -= n;
+
+        ParseCmd(au8Pkt, PKT_SIZE);
+        u16Sum = Checksum(au8Pkt, PKT_SIZE);
+
+        /* Following packets only have the command 0 and the packet number */
+        memset(au8Pkt, 0, sizeof(au8Pkt));
+        u32Hdr = 8;
+    }
+    while(u32Len);
+
+    /* The checksum is inverted if programming failed */
+    return (inpw(response_buff) & 0xFFFF) != u16Sum ? -1 : 0;
+}
+
+static uint8_t s_au8Image[IMAGE_MAX], s_au8Stream[IMAGE_MAX * 2];
+
+static void CheckImage(uint32_t u32Len)
+{
+    uint32_t i, u32StreamLen;
+
+    u32StreamLen = LzEncode(s_au8Image, u32Len, s_au8Stream);
+
+    CHECK(SendUpdate(u32Len, s_au8Stream, u32StreamLen) == 0);
+    CHECK(memcmp(s_au8Flash, s_au8Image, u32Len) == 0);
+    for(i = u32Len; i < FLASH_SIZE; i++)
+    {
+        if(s_au8Flash[i] != 0xFF)
+            break;
+    }
+    CHECK(i == FLASH_SIZE);
+
+    /* A stream that decodes to more or less than the length is rejected */
+    if(u32Len)
+    {
+        CHECK(SendUpdate(u32Len - 1, s_au8Stream, u32StreamLen) != 0);
+        CHECK(SendUpdate(u32Len + 1, s_au8Stream, u32StreamLen) != 0);
+    }
+}
+
+int main(void)
+{
+    uint8_t au8Bad[4];
+    uint32_t i;
+
+    g_apromSize = FLASH_SIZE;
+    g_dataFlashAddr = FLASH_SIZE;
+    g_dataFlashSize = 0;
+
+    /* Random data is mostly literals */
+    srand(1);
+    for(i = 0; i < IMAGE_MAX; i++)
+        s_au8Image[i] = (uint8_t)rand();
+    CheckImage(1);
+    CheckImage(255);
+    CheckImage(1000);
+    CheckImage(4096);
+
+    /* Text is literals and short matches */
+    for(i = 0; i < IMAGE_MAX; i++)
+        s_au8Image[i] = "NUC1261 ISP loader "[i % 19] + (i / 997);
+    CheckImage(17);
+    CheckImage(IMAGE_MAX - 3);
+
+    /* Zeros are overlapping matches of offset 1. A period of the window size needs the longest offset. */
+    memset(s_au8Image, 0, IMAGE_MAX);
+    CheckImage(IMAGE_MAX);
+    for(i = 0; i < IMAGE_MAX; i++)
+        s_au8Image[i] = (i < LZ_WIN_SIZE) ? (uint8_t)rand() : s_au8Image[i - LZ_WIN_SIZE];
+    CheckImage(IMAGE_MAX);
+
+    /* A match before the stream start */
+    au8Bad[0] = 0x00;
+    au8Bad[1] = 0x00;
+    au8Bad[2] = 0x00;
+    CHECK(SendUpdate(3, au8Bad, 3) != 0);
+
+    /* A stream that ends in a match */
+    au8Bad[0] = 0x01;
+    au8Bad[1] = 'A';
+    au8Bad[2] = 0x00;
+    CHECK(SendUpdate(1, au8Bad, 3) != 0);
+
+    /* A literal and a match of offset 1 */
+    au8Bad[3] = 0x00;
+    CHECK(SendUpdate(4, au8Bad, 4) == 0);
+    CHECK(memcmp(s_au8Flash, "AAAA", 4) == 0);
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,127 @@
+/**************************************************************************//**
+ * @file     test_memcopy.c
+ * @version  V3.00
+ * @brief    Host check and benchmark of USBD_MemCopy() in usbd.c
+ *
+ * @note     The USB SRAM address range is mapped to host memory, so the byte mode path is taken as on
+ *           the target. "./test_memcopy bench" compares the time with the byte loop of the ISP loaders.
+ *           The time is of the host CPU. It shows the relative cost of the loops, not Cortex-M0 cycles.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include <sys/mman.h>
+#include <time.h>
+#include "host.h"
+#include "usbd.c"
+
+#define MAX_SIZE        64
+#define GUARD           8
+#define BENCH_LOOP      200000
+
+/* Copy of the ISP loaders and the old inline function */
+__attribute__((noinline)) static void ByteCopy(uint8_t *dest, uint8_t *src, int32_t size)
+{
+    while(size--) *dest++ = *src++;
+}
+
+typedef void (*COPY_FUNC)(uint8_t *dest, uint8_t *src, int32_t size);
+
+__attribute__((aligned(4))) static uint8_t s_au8Src[MAX_SIZE + 2 * GUARD];
+__attribute__((aligned(4))) static uint8_t s_au8Dst[MAX_SIZE + 2 * GUARD];
+static uint8_t *s_pu8UsbBuf;
+
+/* Copy every size at every alignment, and check nothing around the destination is written */
+static void CheckCopy(uint8_t *pu8Dst, uint8_t *pu8Src)
+{
+    uint32_t i, u32Size, u32DstOff, u32SrcOff, u32Err = 0;
+
+    for(u32Size = 0; u32Size <= MAX_SIZE; u32Size++)
+    {
+        for(u32DstOff = 0; u32DstOff < 4; u32DstOff++)
+        {
+            for(u32SrcOff = 0; u32SrcOff < 4; u32SrcOff++)
+            {
+                for(i = 0; i < MAX_SIZE + 2 * GUARD; i++)
+                {
+                    pu8Src[i] = (uint8_t)rand();
+                    pu8Dst[i] = 0xA5;
+                }
+
+                USBD_MemCopy(pu8Dst + GUARD + u32DstOff, pu8Src + GUARD + u32SrcOff, (int32_t)u32Size);
+
+                for(i = 0; i < MAX_SIZE + 2 * GUARD; i++)
+                {
+                    if((i >= GUARD + u32DstOff) && (i < GUARD + u32DstOff + u32Size))
+                    {
+                        if(pu8Dst[i] != pu8Src[i - u32DstOff + u32SrcOff])
+                            u32Err++;
+                    }
+                    else if(pu8Dst[i] != 0xA5)
+                        u32Err++;
+                }
+            }
+        }
+    }
+
+    CHECK(u32Err == 0);
+}
+
+static double BenchCopy(COPY_FUNC pfnCopy, uint8_t *pu8Dst, uint8_t *pu8Src, int32_t i32Size)
+{
+    struct timespec sStart, sEnd;
+    uint32_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &sStart);
+    for(i = 0; i < BENCH_LOOP; i++)
+    {
+        pfnCopy(pu8Dst, pu8Src, i32Size);
+        __asm__ volatile("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sEnd);
+
+    return ((sEnd.tv_sec - sStart.tv_sec) * 1e9 + (sEnd.tv_nsec - sStart.tv_nsec)) / BENCH_LOOP;
+}
+
+static void Bench(void)
+{
+    int32_t i32Size;
+
+    printf("Host ns per copy. SRAM: both word aligned. USB: system SRAM to USB SRAM.\n");
+    printf("size  SRAM byte  SRAM MemCopy  USB byte  USB MemCopy\n");
+    for(i32Size = 0; i32Size <= MAX_SIZE; i32Size += (i32Size < 16) ? 1 : 8)
+    {
+        printf("%4d  %9.1f  %12.1f", i32Size, BenchCopy(ByteCopy, s_au8Dst, s_au8Src, i32Size),
+               BenchCopy(USBD_MemCopy, s_au8Dst, s_au8Src, i32Size));
+        if(s_pu8UsbBuf)
+            printf("  %8.1f  %11.1f", BenchCopy(ByteCopy, s_pu8UsbBuf, s_au8Src, i32Size),
+                   BenchCopy(USBD_MemCopy, s_pu8UsbBuf, s_au8Src, i32Size));
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t u32Page = USBD_BUF_BASE & ~0xFFFUL;
+    void *pvMap;
+
+    /* Host memory at the USB SRAM address, if the address is free on this host */
+    pvMap = mmap((void *)(uintptr_t)u32Page, 0x1000, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    s_pu8UsbBuf = (pvMap == (void *)(uintptr_t)u32Page) ? (uint8_t *)(uintptr_t)USBD_BUF_BASE : NULL;
+
+    srand(1);
+    CheckCopy(s_au8Dst, s_au8Src);
+    if(s_pu8UsbBuf)
+    {
+        CheckCopy(s_pu8UsbBuf, s_au8Src);
+        CheckCopy(s_au8Dst, s_pu8UsbBuf + USBD_BUF_SIZE - MAX_SIZE - 2 * GUARD);
+    }
+    else
+        printf("USB SRAM address is not free on this host. Only system SRAM copies are checked.\n");
+
+    if((argc > 1) && (strcmp(argv[1], "bench") == 0))
+        Bench();
+
+    return HOST_RESULT();
+}
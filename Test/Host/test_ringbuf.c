@@ -0,0 +1,108 @@
+/**************************************************************************//**
+ * @file     test_ringbuf.c
+ * @version  V3.00
+ * @brief    Host check of the byte ring buffer driver
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include "host.h"
+#include "ringbuf.c"
+
+#define RING_SIZE   16
+
+static uint8_t s_au8Ring[RING_SIZE];
+
+/* Put and get across the end of the buffer and around the 32-bit index wrap */
+static void CheckPutGet(uint32_t u32Start)
+{
+    S_RINGBUF_T sRing;
+    uint32_t i, n;
+    uint8_t u8In = 0, u8Out = 0;
+
+    RINGBUF_Init(&sRing, s_au8Ring, RING_SIZE);
+    sRing.u32Head = sRing.u32Tail = u32Start;
+
+    CHECK(RINGBUF_IS_EMPTY(&sRing));
+    CHECK(RINGBUF_Get(&sRing) == -1);
+
+    for(n = 0; n < 100; n++)
+    {
+        /* Fill to full. The next put is dropped. */
+        while(!RINGBUF_IS_FULL(&sRing))
+            CHECK(RINGBUF_Put(&sRing, u8In++) == 1);
+        CHECK(RINGBUF_GET_COUNT(&sRing) == RING_SIZE);
+        CHECK(RINGBUF_GET_FREE(&sRing) == 0);
+        CHECK(RINGBUF_Put(&sRing, 0xEE) == 0);
+
+        /* Drain part of it in order */
+        for(i = 0; i < (n % RING_SIZE) + 1; i++)
+            CHECK(RINGBUF_Get(&sRing) == u8Out++);
+    }
+
+    while(!RINGBUF_IS_EMPTY(&sRing))
+        CHECK(RINGBUF_Get(&sRing) == u8Out++);
+    CHECK(u8In == u8Out);
+}
+
+/* Write and read blocks of every length, so the spans are split at every position */
+static void CheckBlock(uint32_t u32Start)
+{
+    S_RINGBUF_T sRing;
+    uint8_t au8In[RING_SIZE + 4], au8Out[RING_SIZE + 4];
+    uint8_t *pu8Span;
+    uint32_t i, u32Len, u32Done, u32Span;
+    uint8_t u8Seq = 0;
+
+    RINGBUF_Init(&sRing, s_au8Ring, RING_SIZE);
+    sRing.u32Head = sRing.u32Tail = u32Start;
+
+    for(u32Len = 0; u32Len <= RING_SIZE + 4; u32Len++)
+    {
+        for(i = 0; i < u32Len; i++)
+            au8In[i] = u8Seq + i;
+
+        u32Done = RINGBUF_Write(&sRing, au8In, u32Len);
+        CHECK(u32Done == ((u32Len < RING_SIZE) ? u32Len : RING_SIZE));
+        CHECK(RINGBUF_GET_COUNT(&sRing) == u32Done);
+
+        /* A span never runs past the end of the buffer */
+        u32Span = RINGBUF_GetReadSpan(&sRing, &pu8Span);
+        CHECK(u32Span <= u32Done);
+        CHECK(pu8Span + u32Span <= s_au8Ring + RING_SIZE);
+
+        CHECK(RINGBUF_Read(&sRing, au8Out, sizeof(au8Out)) == u32Done);
+        for(i = 0; i < u32Done; i++)
+            CHECK(au8Out[i] == au8In[i]);
+        CHECK(RINGBUF_IS_EMPTY(&sRing));
+
+        /* Move the indexes so the next block starts at another position */
+        u8Seq += 7;
+        RINGBUF_Write(&sRing, au8In, 3);
+        RINGBUF_Read(&sRing, au8Out, 3);
+    }
+
+    /* Write spans directly, as PDMA or USBD_MemCopy does */
+    u32Done = 0;
+    while((u32Span = RINGBUF_GetWriteSpan(&sRing, &pu8Span)) != 0)
+    {
+        for(i = 0; i < u32Span; i++)
+            pu8Span[i] = (uint8_t)(u32Done + i);
+        RINGBUF_CommitWrite(&sRing, u32Span);
+        u32Done += u32Span;
+    }
+    CHECK(u32Done == RING_SIZE);
+    for(i = 0; i < RING_SIZE; i++)
+        CHECK(RINGBUF_Get(&sRing) == (int32_t)i);
+}
+
+int main(void)
+{
+    CheckPutGet(0);
+    CheckPutGet(5);
+    CheckPutGet(0xFFFFFFF8);
+    CheckBlock(0);
+    CheckBlock(0xFFFFFFF0 + 3);
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,83 @@
+/**************************************************************************//**
+ * @file     test_sdcrc.c
+ * @version  V3.00
+ * @brief    Host check of the SD card command CRC7 and data CRC16
+ *
+ * @note     Build with -DSD_TABLE=1 for the 256-entry tables and -DSD_TABLE=0 for the nibble tables.
+ *           The CRC controller path (SD_CRC_HW) needs the hardware and is not checked here.
+ *
+ * @copyright SPDX-License-Identifier: Apache-2.0
+ * @copyright Copyright (C) 2016 Nuvoton Technology Corp. All rights reserved.
+ *****************************************************************************/
+#include "host.h"
+#include "SDCARD.h"
+
+#undef SD_CRC_TABLE_BYTE
+#undef SD_CRC_HW
+#define SD_CRC_TABLE_BYTE   SD_TABLE
+#define SD_CRC_HW           0
+
+#include "SDCard.c"
+
+/* Bit by bit CRC7, x^7 + x^3 + 1. Returned in bits 7-1 with the end bit, as SD_Crc7(). */
+static uint32_t RefCrc7(const uint8_t *pu8Buf, uint32_t u32Len)
+{
+    uint32_t i, u32Crc = 0;
+
+    while(u32Len--)
+    {
+        for(i = 0x80; i; i >>= 1)
+        {
+            u32Crc = (u32Crc << 1) ^ (((u32Crc >> 6) ^ ((*pu8Buf & i) ? 1 : 0)) & 1 ? 0x09 : 0);
+            u32Crc &= 0x7F;
+        }
+        pu8Buf++;
+    }
+
+    return (u32Crc << 1) | 1;
+}
+
+/* Bit by bit CRC16-CCITT, x^16 + x^12 + x^5 + 1, initial value 0 */
+static uint32_t RefCrc16(const uint8_t *pu8Buf, uint32_t u32Len)
+{
+    uint32_t i, u32Crc = 0;
+
+    while(u32Len--)
+    {
+        u32Crc ^= (uint32_t)*pu8Buf++ << 8;
+        for(i = 0; i < 8; i++)
+            u32Crc = ((u32Crc << 1) ^ ((u32Crc & 0x8000) ? 0x1021 : 0)) & 0xFFFF;
+    }
+
+    return u32Crc;
+}
+
+int main(void)
+{
+    uint8_t au8Cmd0[5] = {0x40, 0x00, 0x00, 0x00, 0x00};
+    uint8_t au8Cmd8[5] = {0x48, 0x00, 0x00, 0x01, 0xAA};
+    uint8_t au8Cmd17[5] = {0x51, 0x00, 0x00, 0x00, 0x00};
+    uint8_t au8Blk[512];
+    uint32_t i, u32Len;
+
+    /* Values from the SD physical layer specification */
+    CHECK(SD_Crc7(au8Cmd0, 5) == 0x95);
+    CHECK(SD_Crc7(au8Cmd8, 5) == 0x87);
+    CHECK(SD_Crc7(au8Cmd17, 5) == 0x55);
+
+    memset(au8Blk, 0xFF, sizeof(au8Blk));
+    CHECK(SD_Crc16(au8Blk, 512) == 0x7FA1);
+
+    /* Random data of every length up to a block */
+    srand(1);
+    for(i = 0; i < sizeof(au8Blk); i++)
+        au8Blk[i] = (uint8_t)rand();
+
+    for(u32Len = 0; u32Len <= 16; u32Len++)
+        CHECK(SD_Crc7(au8Blk, u32Len) == RefCrc7(au8Blk, u32Len));
+
+    for(u32Len = 0; u32Len <= sizeof(au8Blk); u32Len++)
+        CHECK(SD_Crc16(au8Blk, u32Len) == RefCrc16(au8Blk, u32Len));
+
+    return HOST_RESULT();
+}